@@ -0,0 +1,344 @@
+#include "../include/slab.h"
+#include "../include/arena.h"
+#include "../include/mempool.h"
+#include "../include/sizeclass.h"
+#include "report.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Single-threaded allocation benchmark.
+ *
+ * latency   - alloc+free pairs through every allocator API, per block size
+ * burst     - allocate BURST blocks, then free them all (alloc-burst and
+ *             free-burst phases), per-block and through the bulk APIs
+ * mixed     - random sizes from a skewed distribution with a random
+ *             replacement working set: size-class allocator vs malloc
+ * stream    - FIFO reuse of a shuffled working set larger than the cache,
+ *             each block written in full: pool without and with
+ *             POOL_F_PREFETCH, and through pool_alloc_prefetch_n
+ *
+ * Usage: bench_alloc [--iters N] [--csv | --json]
+ */
+
+#define BURST        10000
+#define WORKING_SET  4096
+#define STREAM_SET   (1 << 16) /* Blocks in flight in the stream benchmark */
+#define STREAM_BATCH 16        /* Blocks per pool_alloc_prefetch_n */
+
+static const size_t sizes[] = { 64, 256, 4096 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static long iters = 1000000;
+
+/* Write each block once, which also keeps the loops from being elided */
+static inline void touch(void *p)
+{
+	*(volatile uint8_t *)p = (uint8_t)(uintptr_t)p;
+}
+
+static uint64_t xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/* ---- latency: alloc+free pairs ---- */
+
+static void latency(size_t size)
+{
+	double t0;
+
+	slab_allocator_t *slab = slab_create(size, 1024);
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		void *p = slab_alloc(slab);
+		touch(p);
+		slab_free(slab, p);
+	}
+	report_row("latency", "slab", 1, size, iters, report_now_ns() - t0);
+	slab_destroy(slab);
+
+	slab_config_t fast_cfg = { .block_size = size, .num_blocks = 1024,
+				   .flags = SLAB_F_FAST };
+	slab = slab_create_ex(&fast_cfg);
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		void *p = slab_alloc(slab);
+		touch(p);
+		slab_free(slab, p);
+	}
+	report_row("latency", "slab_fast", 1, size, iters, report_now_ns() - t0);
+	slab_destroy(slab);
+
+	mempool_t *pool = pool_create(size, 64, 1024);
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		void *p = pool_alloc(pool);
+		touch(p);
+		pool_free(pool, p);
+	}
+	report_row("latency", "pool", 1, size, iters, report_now_ns() - t0);
+
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		void *p = pool_alloc_fast(pool);
+		touch(p);
+		pool_free_fast(pool, p);
+	}
+	report_row("latency", "pool_fast", 1, size, iters, report_now_ns() - t0);
+	pool_destroy(pool);
+
+	/* Arenas free in bulk: rewind every 1024 allocations */
+	arena_allocator_t *arena = arena_create(1024 * size);
+	arena_mark_t start = arena_mark(arena);
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		if ((i & 1023) == 0)
+			arena_rewind(arena, start);
+		touch(arena_alloc(arena, size));
+	}
+	report_row("latency", "arena", 1, size, iters, report_now_ns() - t0);
+	arena_destroy(arena);
+
+	sizeclass_allocator_t *sc = sc_create(NULL);
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		void *p = sc_alloc(sc, size);
+		touch(p);
+		sc_free(sc, p);
+	}
+	report_row("latency", "sizeclass", 1, size, iters, report_now_ns() - t0);
+	sc_destroy(sc);
+
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		void *p = malloc(size);
+		touch(p);
+		free(p);
+	}
+	report_row("latency", "malloc", 1, size, iters, report_now_ns() - t0);
+}
+
+/* ---- burst: BURST allocations, then BURST frees ---- */
+
+static void burst(size_t size)
+{
+	void **ptrs = malloc(BURST * sizeof(void *));
+	long rounds = iters / BURST > 0 ? iters / BURST : 1;
+	double ops = (double)rounds * BURST * 2;
+	double t0;
+
+	slab_allocator_t *slab = slab_create(size, BURST);
+	t0 = report_now_ns();
+	for (long r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < BURST; i++) {
+			ptrs[i] = slab_alloc(slab);
+			touch(ptrs[i]);
+		}
+		for (size_t i = 0; i < BURST; i++)
+			slab_free(slab, ptrs[i]);
+	}
+	report_row("burst", "slab", 1, size, ops, report_now_ns() - t0);
+
+	t0 = report_now_ns();
+	for (long r = 0; r < rounds; r++) {
+		if (slab_alloc_n(slab, ptrs, BURST) != 0)
+			break;
+		for (size_t i = 0; i < BURST; i++)
+			touch(ptrs[i]);
+		slab_free_batch(slab, ptrs, BURST);
+	}
+	report_row("burst", "slab_alloc_n", 1, size, ops, report_now_ns() - t0);
+	slab_destroy(slab);
+
+	mempool_t *pool = pool_create(size, 256, 2 * BURST);
+	t0 = report_now_ns();
+	for (long r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < BURST; i++) {
+			ptrs[i] = pool_alloc(pool);
+			touch(ptrs[i]);
+		}
+		for (size_t i = 0; i < BURST; i++)
+			pool_free(pool, ptrs[i]);
+	}
+	report_row("burst", "pool", 1, size, ops, report_now_ns() - t0);
+
+	t0 = report_now_ns();
+	for (long r = 0; r < rounds; r++) {
+		if (pool_alloc_n(pool, ptrs, BURST) != 0)
+			break;
+		for (size_t i = 0; i < BURST; i++)
+			touch(ptrs[i]);
+		pool_free_n(pool, ptrs, BURST);
+	}
+	report_row("burst", "pool_alloc_n", 1, size, ops, report_now_ns() - t0);
+	pool_destroy(pool);
+
+	t0 = report_now_ns();
+	for (long r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < BURST; i++) {
+			ptrs[i] = malloc(size);
+			touch(ptrs[i]);
+		}
+		for (size_t i = 0; i < BURST; i++)
+			free(ptrs[i]);
+	}
+	report_row("burst", "malloc", 1, size, ops, report_now_ns() - t0);
+
+	free(ptrs);
+}
+
+/* ---- mixed: random sizes, random replacement ---- */
+
+/* 70% 16-128 bytes, 25% 128-1024, 5% 1-8 KB */
+static size_t pick_size(uint64_t *seed)
+{
+	uint64_t r = xorshift(seed);
+	unsigned int bucket = (unsigned int)(r % 100);
+
+	r >>= 8;
+	if (bucket < 70)
+		return 16 + r % 113;
+	if (bucket < 95)
+		return 128 + r % 897;
+	return 1024 + r % 7169;
+}
+
+static void mixed(void)
+{
+	void **slots = calloc(WORKING_SET, sizeof(void *));
+	sc_config_t cfg = { .bytes_per_class = 8u << 20 };
+	sizeclass_allocator_t *sc = sc_create(&cfg);
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	double t0 = report_now_ns();
+
+	for (long i = 0; i < iters; i++) {
+		size_t slot = xorshift(&seed) % WORKING_SET;
+
+		sc_free(sc, slots[slot]);
+		slots[slot] = sc_alloc(sc, pick_size(&seed));
+		touch(slots[slot]);
+	}
+	report_row("mixed", "sizeclass", 1, 0, iters, report_now_ns() - t0);
+	for (size_t i = 0; i < WORKING_SET; i++)
+		sc_free(sc, slots[i]);
+	sc_destroy(sc);
+
+	memset(slots, 0, WORKING_SET * sizeof(void *));
+	seed = 0x9E3779B97F4A7C15ULL;
+	t0 = report_now_ns();
+	for (long i = 0; i < iters; i++) {
+		size_t slot = xorshift(&seed) % WORKING_SET;
+
+		free(slots[slot]);
+		slots[slot] = malloc(pick_size(&seed));
+		touch(slots[slot]);
+	}
+	report_row("mixed", "malloc", 1, 0, iters, report_now_ns() - t0);
+	for (size_t i = 0; i < WORKING_SET; i++)
+		free(slots[i]);
+
+	free(slots);
+}
+
+/* ---- stream: cold blocks, FIFO reuse ---- */
+
+/*
+ * Run iters allocations in rounds of STREAM_BATCH: allocate and fill the
+ * blocks one after the other (or after one pool_alloc_prefetch_n), then
+ * free the oldest STREAM_BATCH of STREAM_SET live blocks. Blocks come back
+ * to the magazine long after their last use, in shuffled address order,
+ * so without prefetching every allocation's first write misses.
+ */
+static void stream_run(const char *name, unsigned int flags, int bulk, size_t size)
+{
+	pool_config_t cfg = { .block_size = size, .blocks_per_thread = 256,
+			      .total_blocks = STREAM_SET + 1024,
+			      .align = MEMPOOL_ALIGN_CACHE_LINE,
+			      .flags = POOL_F_BATCH | flags };
+	mempool_t *pool = pool_create_ex(&cfg);
+	void **ring = malloc(STREAM_SET * sizeof(void *));
+	void *fresh[STREAM_BATCH];
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	long rounds = iters / STREAM_BATCH > 0 ? iters / STREAM_BATCH : 1;
+	size_t head = 0;
+
+	if (!pool || !ring || pool_alloc_n(pool, ring, STREAM_SET) != 0) {
+		fprintf(stderr, "stream: cannot set up %s\n", name);
+		free(ring);
+		pool_destroy(pool);
+		return;
+	}
+	for (size_t i = STREAM_SET - 1; i > 0; i--) {
+		size_t j = xorshift(&seed) % (i + 1);
+		void *tmp = ring[i];
+
+		ring[i] = ring[j];
+		ring[j] = tmp;
+	}
+	for (size_t i = 0; i < STREAM_SET; i++)
+		memset(ring[i], 0, size);
+
+	double t0 = report_now_ns();
+	for (long r = 0; r < rounds; r++) {
+		if (bulk && pool_alloc_prefetch_n(pool, fresh, STREAM_BATCH) != 0)
+			break;
+		for (size_t i = 0; i < STREAM_BATCH; i++) {
+			if (!bulk)
+				fresh[i] = pool_alloc_fast(pool);
+			memset(fresh[i], (int)r, size);
+		}
+		for (size_t i = 0; i < STREAM_BATCH; i++) {
+			pool_free_fast(pool, ring[head]);
+			ring[head] = fresh[i];
+			head = (head + 1) % STREAM_SET;
+		}
+	}
+	report_row("stream", name, 1, size, (double)rounds * STREAM_BATCH,
+		   report_now_ns() - t0);
+
+	pool_free_n(pool, ring, STREAM_SET);
+	free(ring);
+	pool_destroy(pool);
+}
+
+static void stream(size_t size)
+{
+	stream_run("pool", 0, 0, size);
+	stream_run("pool_prefetch", POOL_F_PREFETCH, 0, size);
+	stream_run("pool_prefetch_n", 0, 1, size);
+}
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		if (report_parse_arg(argv[i]))
+			continue;
+		if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc)
+			iters = atol(argv[++i]);
+	}
+	if (iters < 1)
+		iters = 1;
+
+	FILE *log = report_log();
+	fprintf(log, "Single-threaded Allocation Benchmark\n");
+	fprintf(log, "====================================\n");
+	fprintf(log, "%ld operations per run (mixed: sizes from 16 B to 8 KB)\n\n", iters);
+
+	report_begin();
+	for (size_t i = 0; i < NUM_SIZES; i++)
+		latency(sizes[i]);
+	for (size_t i = 0; i < 2; i++)
+		burst(sizes[i]);
+	mixed();
+	for (size_t i = 0; i < 2; i++)
+		stream(sizes[i]);
+	report_end();
+
+	return 0;
+}
@@ -0,0 +1,235 @@
+#include "../include/slab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Multi-threaded slab contention benchmark.
+ *
+ * Every thread runs a tight loop that allocates a small working set and
+ * frees it again, so all threads hammer the same global free list. The
+ * slab's versioned Treiber stack is compared against a copy of the previous
+ * array-stack free list (a bare free_idx CAS), and both report how far the
+ * free count drifted from the truth once all threads are done. The copy
+ * skips the per-block magic/pointer bookkeeping, so its numbers are an
+ * upper bound for the old code.
+ *
+ * Usage: bench_contention [max_threads]   (default 64, doubling from 1)
+ */
+
+#define NUM_BLOCKS      4096
+#define BLOCK_SIZE      64
+#define OPS_PER_THREAD  100000
+#define WORKING_SET     8
+
+/* ---- Previous array-stack free list, kept for comparison ---- */
+
+typedef struct {
+	_Atomic(int) *free_list;
+	_Atomic(size_t) free_idx;
+	_Atomic(int) *is_free;
+	_Atomic(size_t) free_count;
+	size_t num_blocks;
+} legacy_slab_t;
+
+static legacy_slab_t *legacy_create(size_t num_blocks)
+{
+	legacy_slab_t *s = malloc(sizeof(*s));
+	s->free_list = malloc(num_blocks * sizeof(_Atomic(int)));
+	s->is_free = malloc(num_blocks * sizeof(_Atomic(int)));
+	s->num_blocks = num_blocks;
+	for (size_t i = 0; i < num_blocks; i++) {
+		atomic_store(&s->free_list[i], (int)i);
+		atomic_store(&s->is_free[i], 1);
+	}
+	atomic_store(&s->free_idx, num_blocks);
+	atomic_store(&s->free_count, num_blocks);
+	return s;
+}
+
+static void legacy_destroy(legacy_slab_t *s)
+{
+	free(s->free_list);
+	free(s->is_free);
+	free(s);
+}
+
+/* Same algorithm as the old slab_alloc: recursion turned into a loop */
+static long legacy_alloc(legacy_slab_t *s)
+{
+	for (;;) {
+		size_t old_idx = atomic_load(&s->free_idx);
+		if (old_idx == 0)
+			return -1;
+		if (!atomic_compare_exchange_strong(&s->free_idx, &old_idx,
+						    old_idx - 1))
+			continue;
+
+		int idx = atomic_load(&s->free_list[old_idx - 1]);
+		atomic_store(&s->is_free[idx], 0);
+		atomic_fetch_sub(&s->free_count, 1);
+		return idx;
+	}
+}
+
+/*
+ * Same algorithm as the old slab_free: the slot is written before the CAS,
+ * and a retry after losing the CAS sees the block already marked free and
+ * gives up, so the index is lost.
+ */
+static int legacy_free(legacy_slab_t *s, long idx)
+{
+	if (atomic_load(&s->is_free[idx]))
+		return -1;
+	atomic_store(&s->is_free[idx], 1);
+
+	size_t old_idx = atomic_load(&s->free_idx);
+	if (old_idx + 1 > s->num_blocks)
+		return -1;
+	atomic_store(&s->free_list[old_idx], (int)idx);
+	if (!atomic_compare_exchange_strong(&s->free_idx, &old_idx, old_idx + 1))
+		return -1; /* Retry would fail the double-free check */
+	atomic_fetch_add(&s->free_count, 1);
+	return 0;
+}
+
+/* ---- Benchmark driver ---- */
+
+typedef struct {
+	slab_allocator_t *slab;
+	legacy_slab_t *legacy;
+	_Atomic(int) *start;
+	size_t failed;
+} thread_arg_t;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void *slab_worker(void *arg)
+{
+	thread_arg_t *t = arg;
+	void *held[WORKING_SET];
+
+	while (!atomic_load(t->start))
+		;
+
+	for (int i = 0; i < OPS_PER_THREAD / WORKING_SET; i++) {
+		for (int j = 0; j < WORKING_SET; j++)
+			held[j] = slab_alloc(t->slab);
+		for (int j = 0; j < WORKING_SET; j++) {
+			if (!held[j] || slab_free(t->slab, held[j]) != 0)
+				t->failed++;
+		}
+	}
+	return NULL;
+}
+
+static void *legacy_worker(void *arg)
+{
+	thread_arg_t *t = arg;
+	long held[WORKING_SET];
+
+	while (!atomic_load(t->start))
+		;
+
+	for (int i = 0; i < OPS_PER_THREAD / WORKING_SET; i++) {
+		for (int j = 0; j < WORKING_SET; j++)
+			held[j] = legacy_alloc(t->legacy);
+		for (int j = 0; j < WORKING_SET; j++) {
+			if (held[j] < 0 || legacy_free(t->legacy, held[j]) != 0)
+				t->failed++;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Run one configuration; returns throughput in Mops/s, the drift and, for
+ * the Treiber slab, CAS retries per operation
+ */
+static double run(int legacy, int num_threads, long *drift, size_t *failed,
+		  double *retries)
+{
+	slab_allocator_t *slab = NULL;
+	legacy_slab_t *ls = NULL;
+	double ops = 2.0 * (OPS_PER_THREAD / WORKING_SET) * WORKING_SET * num_threads;
+
+	if (legacy)
+		ls = legacy_create(NUM_BLOCKS);
+	else
+		slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+
+	_Atomic(int) start = 0;
+	pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+	thread_arg_t *args = calloc(num_threads, sizeof(thread_arg_t));
+
+	for (int i = 0; i < num_threads; i++) {
+		args[i].slab = slab;
+		args[i].legacy = ls;
+		args[i].start = &start;
+		pthread_create(&threads[i], NULL, legacy ? legacy_worker : slab_worker,
+			       &args[i]);
+	}
+
+	double t0 = now_ms();
+	atomic_store(&start, 1);
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	double elapsed = now_ms() - t0;
+
+	*failed = 0;
+	for (int i = 0; i < num_threads; i++)
+		*failed += args[i].failed;
+
+	/* Every block was freed: the free count must equal NUM_BLOCKS */
+	if (legacy) {
+		*drift = (long)atomic_load(&ls->free_idx) - NUM_BLOCKS;
+		legacy_destroy(ls);
+	} else {
+		slab_stats_ex_t stats;
+		slab_stats_ex(slab, &stats);
+		*drift = (long)stats.free - NUM_BLOCKS;
+		*retries = (double)stats.cas_retries / ops;
+		slab_destroy(slab);
+	}
+
+	free(threads);
+	free(args);
+
+	return ops / (elapsed * 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : 64;
+	if (max_threads < 1)
+		max_threads = 1;
+
+	printf("Multi-threaded Contention Benchmark\n");
+	printf("===================================\n");
+	printf("%d blocks of %d bytes, %d alloc+free ops per thread\n\n",
+	       NUM_BLOCKS, BLOCK_SIZE, OPS_PER_THREAD);
+	printf("%-8s %14s %8s %8s %9s %18s %8s %8s\n", "threads",
+	       "treiber Mops/s", "drift", "failed", "retry/op",
+	       "array-stack Mops/s", "drift", "failed");
+
+	for (int n = 1; n <= max_threads; n *= 2) {
+		long drift, legacy_drift;
+		size_t failed, legacy_failed;
+		double retries;
+		double mops = run(0, n, &drift, &failed, &retries);
+		double legacy_mops = run(1, n, &legacy_drift, &legacy_failed, NULL);
+
+		printf("%-8d %14.2f %8ld %8zu %9.4f %18.2f %8ld %8zu\n", n, mops,
+		       drift, failed, retries, legacy_mops, legacy_drift,
+		       legacy_failed);
+	}
+
+	return 0;
+}
@@ -0,0 +1,878 @@
+#include "../include/mempool.h"
+#include "../include/slab.h"
+#include "../include/arena.h"
+#include "../include/sizeclass.h"
+#include "../include/latency.h"
+#include "../include/trace.h"
+#include "report.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Trace-replay benchmark.
+ *
+ * Plays an allocation trace (include/trace.h, recorded with
+ * build/libmptrace.so or the trace_* API) through each allocator:
+ *
+ * malloc     - the system allocator
+ * pool       - one growable pool_* pool per size class
+ * sizeclass  - sc_alloc/sc_free, the pools behind a malloc-style API
+ * slab       - one growable slab per size class
+ * arena      - a growable per-thread arena; frees are no-ops
+ *
+ * Every recorded thread gets a replay thread that issues its operations
+ * in order, as fast as possible. A free of a block allocated on another
+ * thread waits until that allocation has been replayed. Each allocator
+ * runs in a forked child so peak RSS is its own: one pass measures
+ * throughput, a second times every call for the latency percentiles.
+ * Requests above SC_MAX_SIZE go to malloc in the pool and slab runs.
+ *
+ * Usage: bench_replay [options] TRACE
+ *   --only NAME         Replay through one allocator
+ *   --magazine N        pool: thread cache capacity in blocks (default 64)
+ *   --adaptive          pool, sizeclass: POOL_F_ADAPTIVE magazines (--magazine
+ *                       is then the floor)
+ *   --cache-bytes N     sizeclass: per-thread cache budget per class
+ *   --class-bytes N     sizeclass: global slab budget per class
+ *   --csv | --json      Machine-readable output
+ *
+ *        bench_replay --synth TRACE [--threads N] [--iters N]
+ *   Record a synthetic multi-threaded trace (mixed sizes, 1 in 8 blocks
+ *   freed by another thread) for trying the harness out.
+ */
+
+#define NO_CLASS   0xFFFF
+#define CLASS_ZONE (1u << 20) /* Arena/slab growth step in bytes */
+
+/* One replayed call */
+typedef struct {
+	uint32_t id;   /* Dense object id */
+	uint32_t size; /* Requested bytes (allocations) */
+	uint16_t cls;  /* Index into class_sizes, or NO_CLASS */
+	uint8_t alloc; /* 1 = allocate, 0 = free */
+} op_t;
+
+/* Calls issued by one replay thread */
+typedef struct {
+	op_t *ops;
+	size_t count;
+	size_t cap;
+} op_list_t;
+
+static op_list_t *lists; /* One per recorded thread */
+static int num_threads;
+static size_t num_ids;
+static size_t num_ops;
+static size_t class_sizes[SC_NUM_CLASSES];
+static unsigned int num_classes;
+
+static size_t magazine = 64;
+static unsigned int adaptive;
+static sc_config_t sc_cfg = { .bytes_per_class = 16u << 20, .pool_flags = POOL_F_BATCH };
+
+/* ---- Preparation: addresses to dense ids, per-thread op lists ---- */
+
+/*
+ * Open-addressing map from live block address to object id. Address 0 is
+ * the empty key, 1 a deleted slot; neither is a valid allocation.
+ */
+typedef struct {
+	uint64_t *keys;
+	uint32_t *ids;
+	size_t cap;
+	size_t used; /* Live plus deleted slots */
+} addr_map_t;
+
+#define KEY_EMPTY   0
+#define KEY_DELETED 1
+
+static size_t hash_addr(uint64_t a, size_t cap)
+{
+	a ^= a >> 33;
+	a *= 0xFF51AFD7ED558CCDULL;
+	a ^= a >> 33;
+	return (size_t)a & (cap - 1);
+}
+
+static int map_rehash(addr_map_t *m, size_t cap)
+{
+	uint64_t *keys = calloc(cap, sizeof(uint64_t));
+	uint32_t *ids = malloc(cap * sizeof(uint32_t));
+	if (!keys || !ids) {
+		free(keys);
+		free(ids);
+		return -1;
+	}
+
+	size_t used = 0;
+	for (size_t i = 0; i < m->cap; i++) {
+		if (m->keys[i] <= KEY_DELETED)
+			continue;
+		size_t h = hash_addr(m->keys[i], cap);
+		while (keys[h] != KEY_EMPTY)
+			h = (h + 1) & (cap - 1);
+		keys[h] = m->keys[i];
+		ids[h] = m->ids[i];
+		used++;
+	}
+
+	free(m->keys);
+	free(m->ids);
+	m->keys = keys;
+	m->ids = ids;
+	m->cap = cap;
+	m->used = used;
+	return 0;
+}
+
+/* Slot holding addr, or the empty slot where it would go */
+static size_t map_find(const addr_map_t *m, uint64_t addr)
+{
+	size_t h = hash_addr(addr, m->cap);
+
+	while (m->keys[h] != KEY_EMPTY && m->keys[h] != addr)
+		h = (h + 1) & (m->cap - 1);
+	return h;
+}
+
+static int map_put(addr_map_t *m, uint64_t addr, uint32_t id)
+{
+	if (2 * (m->used + 1) > m->cap && map_rehash(m, 2 * m->cap) != 0)
+		return -1;
+
+	size_t h = map_find(m, addr);
+	if (m->keys[h] == KEY_EMPTY)
+		m->used++;
+	m->keys[h] = addr;
+	m->ids[h] = id;
+	return 0;
+}
+
+static int list_push(op_list_t *l, op_t op)
+{
+	if (l->count == l->cap) {
+		size_t cap = l->cap ? 2 * l->cap : 1024;
+		op_t *ops = realloc(l->ops, cap * sizeof(op_t));
+		if (!ops)
+			return -1;
+		l->ops = ops;
+		l->cap = cap;
+	}
+	l->ops[l->count++] = op;
+	return 0;
+}
+
+static uint16_t class_index(size_t size)
+{
+	size_t cs = sc_class_size(size ? size : 1);
+	if (cs == 0)
+		return NO_CLASS;
+
+	for (unsigned int c = 0; c < num_classes; c++) {
+		if (class_sizes[c] == cs)
+			return (uint16_t)c;
+	}
+	class_sizes[num_classes] = cs;
+	return (uint16_t)num_classes++;
+}
+
+/**
+ * Turn sorted trace records into per-thread op lists. Frees of addresses
+ * the trace never saw allocated (allocated before recording started) are
+ * dropped; blocks still live at the end are freed by their allocating
+ * thread after its last recorded call.
+ */
+static int prepare(const trace_record_t *rec, size_t n)
+{
+	static int thread_map[TRACE_MAX_THREADS];
+	addr_map_t map = { 0 };
+	op_t *owner = NULL; /* Allocation op of each id */
+	uint16_t *owner_thread = NULL;
+	size_t id_cap = 0;
+	size_t dropped = 0, live_bytes = 0, peak_bytes = 0;
+
+	memset(thread_map, -1, sizeof(thread_map));
+	lists = calloc(TRACE_MAX_THREADS, sizeof(op_list_t));
+	if (!lists || map_rehash(&map, 1024) != 0)
+		return -1;
+
+	for (size_t i = 0; i < n; i++) {
+		const trace_record_t *r = &rec[i];
+		unsigned int t = trace_thread(r);
+
+		if (thread_map[t] < 0)
+			thread_map[t] = num_threads++;
+		op_list_t *l = &lists[thread_map[t]];
+
+		if (trace_op(r) == TRACE_ALLOC) {
+			if (num_ids == id_cap) {
+				id_cap = id_cap ? 2 * id_cap : 4096;
+				owner = realloc(owner, id_cap * sizeof(op_t));
+				owner_thread = realloc(owner_thread, id_cap * sizeof(uint16_t));
+				if (!owner || !owner_thread)
+					return -1;
+			}
+
+			op_t op = { .id = (uint32_t)num_ids,
+				    .size = r->size > UINT32_MAX ? UINT32_MAX : (uint32_t)r->size,
+				    .cls = class_index(r->size), .alloc = 1 };
+			owner[num_ids] = op;
+			owner_thread[num_ids] = (uint16_t)thread_map[t];
+			if (map_put(&map, r->addr, op.id) != 0 || list_push(l, op) != 0)
+				return -1;
+			num_ids++;
+
+			live_bytes += r->size;
+			if (live_bytes > peak_bytes)
+				peak_bytes = live_bytes;
+		} else if (trace_op(r) == TRACE_FREE) {
+			size_t h = map_find(&map, r->addr);
+			if (map.keys[h] == KEY_EMPTY) {
+				dropped++;
+				continue;
+			}
+
+			op_t op = owner[map.ids[h]];
+			op.alloc = 0;
+			map.keys[h] = KEY_DELETED;
+			owner[op.id].alloc = 0; /* Mark freed */
+			live_bytes -= op.size;
+			if (list_push(l, op) != 0)
+				return -1;
+		}
+	}
+
+	size_t leaked = 0;
+	for (size_t id = 0; id < num_ids; id++) {
+		if (!owner[id].alloc)
+			continue;
+		op_t op = owner[id];
+		op.alloc = 0;
+		if (list_push(&lists[owner_thread[id]], op) != 0)
+			return -1;
+		leaked++;
+	}
+
+	for (int t = 0; t < num_threads; t++)
+		num_ops += lists[t].count;
+
+	fprintf(report_log(), "Trace: %zu records, %d threads, %zu objects, %u size classes, "
+		"peak live %.1f MB\n", n, num_threads, num_ids, num_classes,
+		peak_bytes / 1048576.0);
+	if (dropped || leaked)
+		fprintf(report_log(), "       %zu frees of unrecorded blocks dropped, "
+			"%zu leaked blocks freed at the end\n", dropped, leaked);
+
+	free(map.keys);
+	free(map.ids);
+	free(owner);
+	free(owner_thread);
+	return 0;
+}
+
+/* ---- Allocators ---- */
+
+typedef struct {
+	const char *name;
+	void *(*create)(void);
+	void (*destroy)(void *ctx);
+	void *(*alloc)(void *ctx, unsigned int cls, size_t size);
+	void (*free)(void *ctx, unsigned int cls, void *ptr);
+} target_t;
+
+static void *malloc_create(void)
+{
+	return (void *)1;
+}
+
+static void malloc_destroy(void *ctx)
+{
+	(void)ctx;
+}
+
+static void *malloc_alloc(void *ctx, unsigned int cls, size_t size)
+{
+	(void)ctx;
+	(void)cls;
+	return malloc(size);
+}
+
+static void malloc_free(void *ctx, unsigned int cls, void *ptr)
+{
+	(void)ctx;
+	(void)cls;
+	free(ptr);
+}
+
+static void *pool_target_create(void)
+{
+	mempool_t **pools = calloc(num_classes ? num_classes : 1, sizeof(mempool_t *));
+	if (!pools)
+		return NULL;
+
+	for (unsigned int c = 0; c < num_classes; c++) {
+		size_t chunk = CLASS_ZONE / class_sizes[c];
+		pool_config_t cfg = {
+			.block_size = class_sizes[c],
+			.blocks_per_thread = magazine,
+			.total_blocks = chunk > magazine ? chunk : magazine,
+			.flags = POOL_F_BATCH | adaptive,
+			.slab_flags = SLAB_F_GROW,
+			.chunk_blocks = chunk > 16 ? chunk : 16,
+		};
+
+		pools[c] = pool_create_ex(&cfg);
+		if (!pools[c]) {
+			while (c-- > 0)
+				pool_destroy(pools[c]);
+			free(pools);
+			return NULL;
+		}
+	}
+	return pools;
+}
+
+static void pool_target_destroy(void *ctx)
+{
+	mempool_t **pools = ctx;
+
+	for (unsigned int c = 0; c < num_classes; c++)
+		pool_destroy(pools[c]);
+	free(pools);
+}
+
+static void *pool_target_alloc(void *ctx, unsigned int cls, size_t size)
+{
+	if (cls == NO_CLASS)
+		return malloc(size);
+	return pool_alloc_fast(((mempool_t **)ctx)[cls]);
+}
+
+static void pool_target_free(void *ctx, unsigned int cls, void *ptr)
+{
+	if (cls == NO_CLASS)
+		free(ptr);
+	else
+		pool_free_fast(((mempool_t **)ctx)[cls], ptr);
+}
+
+static void *sc_target_create(void)
+{
+	return sc_create(&sc_cfg);
+}
+
+static void sc_target_destroy(void *ctx)
+{
+	sc_destroy(ctx);
+}
+
+static void *sc_target_alloc(void *ctx, unsigned int cls, size_t size)
+{
+	(void)cls;
+	return sc_alloc(ctx, size);
+}
+
+static void sc_target_free(void *ctx, unsigned int cls, void *ptr)
+{
+	(void)cls;
+	sc_free(ctx, ptr);
+}
+
+static void *slab_target_create(void)
+{
+	slab_allocator_t **slabs = calloc(num_classes ? num_classes : 1,
+					  sizeof(slab_allocator_t *));
+	if (!slabs)
+		return NULL;
+
+	for (unsigned int c = 0; c < num_classes; c++) {
+		size_t chunk = CLASS_ZONE / class_sizes[c];
+		slab_config_t cfg = {
+			.block_size = class_sizes[c],
+			.num_blocks = 0,
+			.flags = SLAB_F_GROW,
+			.chunk_blocks = chunk > 16 ? chunk : 16,
+		};
+
+		slabs[c] = slab_create_ex(&cfg);
+		if (!slabs[c]) {
+			while (c-- > 0)
+				slab_destroy(slabs[c]);
+			free(slabs);
+			return NULL;
+		}
+	}
+	return slabs;
+}
+
+static void slab_target_destroy(void *ctx)
+{
+	slab_allocator_t **slabs = ctx;
+
+	for (unsigned int c = 0; c < num_classes; c++)
+		slab_destroy(slabs[c]);
+	free(slabs);
+}
+
+static void *slab_target_alloc(void *ctx, unsigned int cls, size_t size)
+{
+	if (cls == NO_CLASS)
+		return malloc(size);
+	return slab_alloc(((slab_allocator_t **)ctx)[cls]);
+}
+
+static void slab_target_free(void *ctx, unsigned int cls, void *ptr)
+{
+	if (cls == NO_CLASS)
+		free(ptr);
+	else
+		slab_free(((slab_allocator_t **)ctx)[cls], ptr);
+}
+
+static void *arena_target_create(void)
+{
+	arena_config_t cfg = { .capacity = CLASS_ZONE,
+			       .flags = ARENA_F_GROW | ARENA_F_PER_THREAD };
+	return arena_create_ex(&cfg);
+}
+
+static void arena_target_destroy(void *ctx)
+{
+	arena_destroy(ctx);
+}
+
+static void *arena_target_alloc(void *ctx, unsigned int cls, size_t size)
+{
+	(void)cls;
+	return arena_alloc(ctx, size ? size : 1);
+}
+
+static void arena_target_free(void *ctx, unsigned int cls, void *ptr)
+{
+	(void)ctx;
+	(void)cls;
+	(void)ptr;
+}
+
+static const target_t targets[] = {
+	{ "malloc", malloc_create, malloc_destroy, malloc_alloc, malloc_free },
+	{ "pool", pool_target_create, pool_target_destroy, pool_target_alloc, pool_target_free },
+	{ "sizeclass", sc_target_create, sc_target_destroy, sc_target_alloc, sc_target_free },
+	{ "slab", slab_target_create, slab_target_destroy, slab_target_alloc, slab_target_free },
+	{ "arena", arena_target_create, arena_target_destroy, arena_target_alloc,
+	  arena_target_free },
+};
+#define NUM_TARGETS (sizeof(targets) / sizeof(targets[0]))
+
+/* ---- Replay ---- */
+
+typedef struct {
+	const target_t *target;
+	void *ctx;
+	op_list_t *list;
+	_Atomic(void *) *slots;
+	_Atomic(int) *start;
+	int timed;             /* Time every call into hist */
+	latency_hist_t *hist;
+	size_t failures;
+} replayer_t;
+
+static void *replay_thread(void *arg)
+{
+	replayer_t *r = arg;
+	const target_t *t = r->target;
+
+	while (!atomic_load(r->start))
+		sched_yield();
+
+	for (size_t i = 0; i < r->list->count; i++) {
+		const op_t *op = &r->list->ops[i];
+		double t0 = 0;
+
+		if (op->alloc) {
+			if (r->timed)
+				t0 = report_now_ns();
+			void *p = t->alloc(r->ctx, op->cls, op->size);
+			if (r->timed)
+				latency_hist_add(r->hist, (uint64_t)(report_now_ns() - t0));
+			if (!p) {
+				r->failures++;
+				p = (void *)(uintptr_t)1; /* Unblock a waiting free */
+			} else {
+				*(volatile uint8_t *)p = (uint8_t)op->id;
+			}
+			atomic_store_explicit(&r->slots[op->id], p, memory_order_release);
+		} else {
+			void *p;
+
+			/* Allocated on another thread: wait for it to be replayed */
+			while (!(p = atomic_load_explicit(&r->slots[op->id], memory_order_acquire)))
+				sched_yield();
+			atomic_store_explicit(&r->slots[op->id], NULL, memory_order_relaxed);
+			if (p == (void *)(uintptr_t)1)
+				continue;
+
+			if (r->timed)
+				t0 = report_now_ns();
+			t->free(r->ctx, op->cls, p);
+			if (r->timed)
+				latency_hist_add(r->hist, (uint64_t)(report_now_ns() - t0));
+		}
+	}
+	return NULL;
+}
+
+/* Result of one allocator, passed from the child to the parent */
+typedef struct {
+	int ok;
+	double elapsed_ns;
+	size_t failures;
+	uint64_t p50, p99, p999, max;
+	long base_rss_kb;
+	long peak_rss_kb;
+} result_t;
+
+/**
+ * Replay the whole trace once. Returns wall time in nanoseconds, or a
+ * negative value if the allocator could not be created.
+ */
+static double replay(const target_t *target, int timed, latency_hist_t *hist, size_t *failures)
+{
+	void *ctx = target->create();
+	if (!ctx)
+		return -1;
+
+	_Atomic(void *) *slots = calloc(num_ids ? num_ids : 1, sizeof(*slots));
+	replayer_t *r = calloc((size_t)num_threads, sizeof(replayer_t));
+	pthread_t *tids = calloc((size_t)num_threads, sizeof(pthread_t));
+	latency_hist_t *hists = timed ? calloc((size_t)num_threads, sizeof(latency_hist_t)) : NULL;
+	_Atomic(int) start = 0;
+
+	if (!slots || !r || !tids || (timed && !hists)) {
+		free(slots);
+		free(r);
+		free(tids);
+		free(hists);
+		target->destroy(ctx);
+		return -1;
+	}
+
+	for (int i = 0; i < num_threads; i++) {
+		r[i] = (replayer_t){ .target = target, .ctx = ctx, .list = &lists[i],
+				     .slots = slots, .start = &start, .timed = timed,
+				     .hist = timed ? &hists[i] : NULL };
+		pthread_create(&tids[i], NULL, replay_thread, &r[i]);
+	}
+
+	double t0 = report_now_ns();
+	atomic_store(&start, 1);
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(tids[i], NULL);
+	double elapsed = report_now_ns() - t0;
+
+	for (int i = 0; i < num_threads; i++) {
+		*failures += r[i].failures;
+		if (timed)
+			latency_hist_merge(hist, &hists[i]);
+	}
+
+	target->destroy(ctx);
+	free(slots);
+	free(r);
+	free(tids);
+	free(hists);
+	return elapsed;
+}
+
+static long max_rss_kb(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+/* Child side: both passes, result written to fd */
+static void run_child(const target_t *target, int fd)
+{
+	result_t res = { .base_rss_kb = max_rss_kb() };
+	latency_hist_t *hist = calloc(1, sizeof(*hist));
+	size_t failures = 0;
+
+	res.elapsed_ns = replay(target, 0, NULL, &res.failures);
+	if (hist && res.elapsed_ns >= 0 && replay(target, 1, hist, &failures) >= 0) {
+		res.ok = 1;
+		res.p50 = latency_hist_value_at(hist, 0.50);
+		res.p99 = latency_hist_value_at(hist, 0.99);
+		res.p999 = latency_hist_value_at(hist, 0.999);
+		res.max = hist->max;
+	}
+	res.peak_rss_kb = max_rss_kb();
+
+	if (write(fd, &res, sizeof(res)) != (ssize_t)sizeof(res))
+		res.ok = 0;
+	free(hist);
+}
+
+static int run_target(const target_t *target, result_t *res)
+{
+	int fds[2];
+
+	fflush(stdout);
+	fflush(stderr);
+	if (pipe(fds) != 0)
+		return -1;
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		run_child(target, fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	ssize_t got = read(fds[0], res, sizeof(*res));
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+
+	return got == (ssize_t)sizeof(*res) && res->ok ? 0 : -1;
+}
+
+/* ---- Output ---- */
+
+static void print_header(void)
+{
+	if (report_format == REPORT_CSV)
+		printf("allocator,threads,ops,ns_per_op,mops,p50_ns,p99_ns,p999_ns,max_ns,"
+		       "peak_rss_kb,rss_growth_kb,failures\n");
+	else if (report_format == REPORT_JSON)
+		printf("[\n");
+	else
+		printf("%-10s %7s %10s %8s %8s %8s %8s %8s %10s %10s %10s\n", "allocator",
+		       "threads", "ops", "ns/op", "Mops/s", "p50", "p99", "p99.9", "max",
+		       "peak RSS", "growth");
+}
+
+static void print_row(const char *name, const result_t *r, int first)
+{
+	double ns_per_op = r->elapsed_ns * num_threads / (double)num_ops;
+	double mops = (double)num_ops / r->elapsed_ns * 1e3;
+	long growth = r->peak_rss_kb - r->base_rss_kb;
+
+	if (report_format == REPORT_CSV) {
+		printf("%s,%d,%zu,%.2f,%.2f,%llu,%llu,%llu,%llu,%ld,%ld,%zu\n", name,
+		       num_threads, num_ops, ns_per_op, mops, (unsigned long long)r->p50,
+		       (unsigned long long)r->p99, (unsigned long long)r->p999,
+		       (unsigned long long)r->max, r->peak_rss_kb, growth, r->failures);
+	} else if (report_format == REPORT_JSON) {
+		printf("%s  {\"allocator\": \"%s\", \"threads\": %d, \"ops\": %zu, "
+		       "\"ns_per_op\": %.2f, \"mops\": %.2f, \"p50_ns\": %llu, "
+		       "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, "
+		       "\"peak_rss_kb\": %ld, \"rss_growth_kb\": %ld, \"failures\": %zu}",
+		       first ? "" : ",\n", name, num_threads, num_ops, ns_per_op, mops,
+		       (unsigned long long)r->p50, (unsigned long long)r->p99,
+		       (unsigned long long)r->p999, (unsigned long long)r->max,
+		       r->peak_rss_kb, growth, r->failures);
+	} else {
+		printf("%-10s %7d %10zu %8.2f %8.2f %8llu %8llu %8llu %10llu %8.1fMB %8.1fMB\n",
+		       name, num_threads, num_ops, ns_per_op, mops,
+		       (unsigned long long)r->p50, (unsigned long long)r->p99,
+		       (unsigned long long)r->p999, (unsigned long long)r->max,
+		       r->peak_rss_kb / 1024.0, growth / 1024.0);
+		if (r->failures)
+			printf("           (%zu allocations failed)\n", r->failures);
+	}
+	fflush(stdout);
+}
+
+/* ---- Synthetic trace ---- */
+
+#define SYNTH_SLOTS   512
+#define MAILBOX_SLOTS 64
+
+static long synth_iters = 200000;
+static void *mailbox[MAILBOX_SLOTS];
+static pthread_mutex_t mailbox_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/* 70% 16-128 bytes, 25% 128-1024, 5% 1-8 KB */
+static size_t pick_size(uint64_t *seed)
+{
+	uint64_t r = xorshift(seed);
+	unsigned int bucket = (unsigned int)(r % 100);
+
+	r >>= 8;
+	if (bucket < 70)
+		return 16 + r % 113;
+	if (bucket < 95)
+		return 128 + r % 897;
+	return 1024 + r % 7169;
+}
+
+static void synth_free(void *p)
+{
+	trace_free(p);
+	free(p);
+}
+
+/* Random replacement over a private working set; 1 in 8 evictions swap through the mailbox */
+static void *synth_worker(void *arg)
+{
+	uint64_t seed = 0x9E3779B97F4A7C15ULL * ((uintptr_t)arg + 1);
+	void *slots[SYNTH_SLOTS] = { 0 };
+
+	for (long i = 0; i < synth_iters; i++) {
+		size_t s = xorshift(&seed) % SYNTH_SLOTS;
+		void *victim = slots[s];
+
+		if (victim && (xorshift(&seed) & 7) == 0) {
+			size_t m = xorshift(&seed) % MAILBOX_SLOTS;
+
+			pthread_mutex_lock(&mailbox_lock);
+			void *other = mailbox[m];
+			mailbox[m] = victim;
+			pthread_mutex_unlock(&mailbox_lock);
+			victim = other;
+		}
+		if (victim)
+			synth_free(victim);
+
+		size_t size = pick_size(&seed);
+		slots[s] = malloc(size);
+		trace_alloc(slots[s], size);
+	}
+
+	for (size_t s = 0; s < SYNTH_SLOTS; s++) {
+		if (slots[s])
+			synth_free(slots[s]);
+	}
+	return NULL;
+}
+
+static int synth(const char *path, int threads)
+{
+	pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+
+	if (!tids || trace_open(path) != 0) {
+		fprintf(stderr, "cannot write %s\n", path);
+		free(tids);
+		return 1;
+	}
+
+	for (int i = 0; i < threads; i++)
+		pthread_create(&tids[i], NULL, synth_worker, (void *)(uintptr_t)i);
+	for (int i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	for (size_t m = 0; m < MAILBOX_SLOTS; m++) {
+		if (mailbox[m])
+			synth_free(mailbox[m]);
+	}
+	free(tids);
+
+	if (trace_close() != 0) {
+		fprintf(stderr, "write to %s failed\n", path);
+		return 1;
+	}
+	printf("Wrote %s: %d threads, %ld calls each\n", path, threads, synth_iters);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	const char *only = NULL;
+	const char *synth_path = NULL;
+	int synth_threads = 4;
+
+	for (int i = 1; i < argc; i++) {
+		if (report_parse_arg(argv[i]))
+			continue;
+		if (strcmp(argv[i], "--only") == 0 && i + 1 < argc)
+			only = argv[++i];
+		else if (strcmp(argv[i], "--magazine") == 0 && i + 1 < argc)
+			magazine = (size_t)atol(argv[++i]);
+		else if (strcmp(argv[i], "--adaptive") == 0)
+			adaptive = POOL_F_ADAPTIVE;
+		else if (strcmp(argv[i], "--cache-bytes") == 0 && i + 1 < argc)
+			sc_cfg.cache_bytes = (size_t)atol(argv[++i]);
+		else if (strcmp(argv[i], "--class-bytes") == 0 && i + 1 < argc)
+			sc_cfg.bytes_per_class = (size_t)atol(argv[++i]);
+		else if (strcmp(argv[i], "--synth") == 0 && i + 1 < argc)
+			synth_path = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			synth_threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc)
+			synth_iters = atol(argv[++i]);
+		else
+			path = argv[i];
+	}
+	if (magazine < 1)
+		magazine = 1;
+	sc_cfg.pool_flags |= adaptive;
+
+	if (synth_path)
+		return synth(synth_path, synth_threads > 0 ? synth_threads : 1);
+
+	if (!path) {
+		fprintf(stderr, "usage: bench_replay [--only NAME] [--magazine N] [--adaptive] "
+			"[--cache-bytes N] [--class-bytes N] [--csv | --json] TRACE\n"
+			"       bench_replay --synth TRACE [--threads N] [--iters N]\n");
+		return 1;
+	}
+
+	size_t n;
+	trace_record_t *records = trace_load(path, &n);
+	if (!records) {
+		fprintf(stderr, "cannot read trace %s\n", path);
+		return 1;
+	}
+
+	FILE *log = report_log();
+	fprintf(log, "Trace Replay Benchmark\n");
+	fprintf(log, "======================\n");
+	int rc = prepare(records, n);
+	free(records);
+	if (rc != 0 || num_ops == 0) {
+		fprintf(stderr, "%s: nothing to replay\n", path);
+		return 1;
+	}
+	fprintf(log, "Latency in ns per call; RSS growth is over the loaded trace\n\n");
+
+	print_header();
+	int rows = 0;
+	for (size_t i = 0; i < NUM_TARGETS; i++) {
+		result_t res;
+
+		if (only && strcmp(only, targets[i].name) != 0)
+			continue;
+		if (run_target(&targets[i], &res) != 0) {
+			fprintf(log, "%s: replay failed\n", targets[i].name);
+			continue;
+		}
+		print_row(targets[i].name, &res, rows++ == 0);
+	}
+	if (report_format == REPORT_JSON)
+		printf("%s]\n", rows ? "\n" : "");
+
+	return 0;
+}
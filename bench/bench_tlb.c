@@ -0,0 +1,159 @@
+#include "../include/slab.h"
+#include "../include/backing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/*
+ * TLB benchmark for backing-memory providers.
+ *
+ * Allocates every block of a large slab, links them into one random cycle
+ * and chases the pointers, so each step lands on an unrelated page. The
+ * same walk runs over heap-backed, mmap-backed, THP and hugetlb slabs.
+ * dTLB load misses are read from perf events where the kernel allows it;
+ * otherwise only the time per access is shown.
+ *
+ * Usage: bench_tlb [pool_mb]   (default 512)
+ */
+
+#define BLOCK_SIZE 64
+#define STEPS      (8 * 1000 * 1000)
+
+typedef struct node {
+	struct node *next;
+} node_t;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Open a dTLB read-miss counter for this thread, or -1 */
+static int open_dtlb_counter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+static void run(const char *name, const mempool_backing_t *backing, size_t num_blocks)
+{
+	slab_config_t cfg = {
+		.block_size = BLOCK_SIZE,
+		.num_blocks = num_blocks,
+		.align = BLOCK_SIZE,
+		.flags = SLAB_F_FAST,
+		.backing = backing,
+	};
+
+	double t0 = now_ns();
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	if (!slab) {
+		printf("%-16s %12s\n", name, "unavailable");
+		return;
+	}
+
+	node_t **nodes = malloc(num_blocks * sizeof(node_t *));
+	for (size_t i = 0; i < num_blocks; i++)
+		nodes[i] = slab_alloc(slab);
+	double setup_ms = (now_ns() - t0) / 1e6;
+
+	/* Fisher-Yates shuffle, then link into a single cycle */
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	for (size_t i = num_blocks - 1; i > 0; i--) {
+		size_t j = xorshift(&seed) % (i + 1);
+		node_t *tmp = nodes[i];
+		nodes[i] = nodes[j];
+		nodes[j] = tmp;
+	}
+	for (size_t i = 0; i < num_blocks; i++)
+		nodes[i]->next = nodes[(i + 1) % num_blocks];
+
+	int fd = open_dtlb_counter();
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	node_t *p = nodes[0];
+	t0 = now_ns();
+	for (long i = 0; i < STEPS; i++)
+		p = p->next;
+	double ns = (now_ns() - t0) / STEPS;
+
+	uint64_t misses = 0;
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+			misses = 0;
+		close(fd);
+	}
+
+	if (fd >= 0)
+		printf("%-16s %12.2f %14.3f %12.1f\n", name, ns,
+		       (double)misses / STEPS, setup_ms);
+	else
+		printf("%-16s %12.2f %14s %12.1f\n", name, ns, "n/a", setup_ms);
+
+	/* Keep the walk from being optimized away */
+	if (!p)
+		printf("unreachable\n");
+
+	free(nodes);
+	slab_destroy(slab);
+}
+
+int main(int argc, char **argv)
+{
+	size_t pool_mb = argc > 1 ? (size_t)atol(argv[1]) : 512;
+	if (pool_mb == 0)
+		pool_mb = 1;
+
+	size_t num_blocks = pool_mb * 1024 * 1024 / BLOCK_SIZE;
+
+	printf("Backing Memory TLB Benchmark\n");
+	printf("============================\n");
+	printf("%zu MB slab, %d-byte blocks, %d random pointer-chase steps\n\n",
+	       pool_mb, BLOCK_SIZE, STEPS);
+	printf("%-16s %12s %14s %12s\n", "backing", "ns/access", "dTLB miss/acc",
+	       "setup ms");
+
+	mempool_backing_t plain = backing_mmap(0);
+	mempool_backing_t populate = backing_mmap(BACKING_F_POPULATE);
+	mempool_backing_t thp = backing_mmap(BACKING_F_THP);
+	mempool_backing_t hugetlb = backing_mmap(BACKING_F_HUGETLB);
+
+	run("heap", NULL, num_blocks);
+	run("mmap", &plain, num_blocks);
+	run("mmap+populate", &populate, num_blocks);
+	run("mmap+thp", &thp, num_blocks);
+	run("mmap+hugetlb", &hugetlb, num_blocks);
+
+	return 0;
+}
@@ -0,0 +1,435 @@
+#include "../include/mempool.h"
+#include "../include/slab.h"
+#include "../include/sizeclass.h"
+#include "report.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+/*
+ * Head-to-head comparison with general-purpose allocators.
+ *
+ * glibc malloc is always measured; jemalloc and tcmalloc are loaded with
+ * dlopen when their shared libraries are installed, so the benchmark
+ * builds and runs without them. The mempool side is a fixed-size pool
+ * (block-sized workloads) and the size-class allocator (malloc-like).
+ *
+ * scaling   - N threads, each allocating and freeing a working set of
+ *             fixed-size blocks (1, 2, 4, ... up to --threads)
+ * prodcons  - producer/consumer pairs; every block is freed by a thread
+ *             other than the one that allocated it
+ * mixed     - N threads, random sizes 16 B - 8 KB with random replacement
+ *
+ * Usage: bench_vs_malloc [--iters N] [--threads N] [--csv | --json]
+ */
+
+#define WORKING_SET 64
+#define MIXED_SLOTS 1024
+#define RING_SIZE   1024 /* Producer/consumer queue depth, power of two */
+
+static long iters = 1000000; /* Operations per thread */
+static int max_threads;
+
+/* ---- Allocator table ---- */
+
+typedef struct {
+	const char *name;
+	void *(*alloc)(void *ctx, size_t size);
+	void (*free)(void *ctx, void *ptr);
+	void *ctx;
+} impl_t;
+
+typedef void *(*malloc_fn)(size_t);
+typedef void (*free_fn)(void *);
+
+/* A malloc family, resolved from the process or from a dlopen'd library */
+typedef struct {
+	const char *name;
+	malloc_fn malloc;
+	free_fn free;
+} malloc_lib_t;
+
+#define MAX_LIBS 3
+static malloc_lib_t libs[MAX_LIBS];
+static int num_libs;
+
+static void *lib_alloc(void *ctx, size_t size)
+{
+	return ((malloc_lib_t *)ctx)->malloc(size);
+}
+
+static void lib_free(void *ctx, void *ptr)
+{
+	((malloc_lib_t *)ctx)->free(ptr);
+}
+
+static void *pool_impl_alloc(void *ctx, size_t size)
+{
+	(void)size;
+	return pool_alloc_fast(ctx);
+}
+
+static void pool_impl_free(void *ctx, void *ptr)
+{
+	pool_free_fast(ctx, ptr);
+}
+
+static void *sc_impl_alloc(void *ctx, size_t size)
+{
+	return sc_alloc(ctx, size);
+}
+
+static void sc_impl_free(void *ctx, void *ptr)
+{
+	sc_free(ctx, ptr);
+}
+
+/**
+ * Load the first library in names that exports malloc and free.
+ */
+static void load_lib(const char *label, const char *const *names)
+{
+	for (; *names; names++) {
+		void *h = dlopen(*names, RTLD_NOW | RTLD_LOCAL);
+		if (!h)
+			continue;
+
+		malloc_fn m;
+		free_fn f;
+
+		/* POSIX-sanctioned way to turn dlsym's result into a function pointer */
+		*(void **)&m = dlsym(h, "malloc");
+		*(void **)&f = dlsym(h, "free");
+		if (m && f) {
+			libs[num_libs++] = (malloc_lib_t){ label, m, f };
+			return;
+		}
+		dlclose(h);
+	}
+	fprintf(report_log(), "%s: not installed, skipped\n", label);
+}
+
+static void load_libs(void)
+{
+	static const char *const jemalloc[] = { "libjemalloc.so.2", "libjemalloc.so", NULL };
+	static const char *const tcmalloc[] = { "libtcmalloc_minimal.so.4", "libtcmalloc.so.4",
+						"libtcmalloc_minimal.so", "libtcmalloc.so", NULL };
+
+	libs[num_libs++] = (malloc_lib_t){ "glibc", malloc, free };
+	load_lib("jemalloc", jemalloc);
+	load_lib("tcmalloc", tcmalloc);
+}
+
+static impl_t lib_impl(malloc_lib_t *lib)
+{
+	return (impl_t){ lib->name, lib_alloc, lib_free, lib };
+}
+
+/* Growable pool for size-byte blocks, so no thread count can exhaust it */
+static mempool_t *make_pool(size_t size, unsigned int flags)
+{
+	pool_config_t cfg = {
+		.block_size = size,
+		.blocks_per_thread = 256,
+		.total_blocks = 16384,
+		.flags = flags,
+		.slab_flags = SLAB_F_GROW,
+		.chunk_blocks = 16384,
+	};
+
+	return pool_create_ex(&cfg);
+}
+
+/* ---- Thread harness ---- */
+
+typedef struct {
+	impl_t *impl;
+	size_t size;
+	int index;
+	_Atomic(int) *start;
+	struct ring *ring;
+} worker_t;
+
+/**
+ * Start n threads running fn and return the wall time from release to
+ * the last join, in nanoseconds.
+ */
+static double run_threads(int n, void *(*fn)(void *), worker_t *w)
+{
+	pthread_t *tids = malloc(n * sizeof(pthread_t));
+	_Atomic(int) start = 0;
+
+	for (int i = 0; i < n; i++) {
+		w[i].start = &start;
+		pthread_create(&tids[i], NULL, fn, &w[i]);
+	}
+
+	double t0 = report_now_ns();
+	atomic_store(&start, 1);
+	for (int i = 0; i < n; i++)
+		pthread_join(tids[i], NULL);
+	double elapsed = report_now_ns() - t0;
+
+	free(tids);
+	return elapsed;
+}
+
+static void wait_start(worker_t *w)
+{
+	while (!atomic_load(w->start))
+		sched_yield();
+}
+
+static uint64_t xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/* ---- scaling ---- */
+
+static void *scaling_worker(void *arg)
+{
+	worker_t *w = arg;
+	void *held[WORKING_SET];
+
+	wait_start(w);
+	for (long r = 0; r < iters / (2 * WORKING_SET); r++) {
+		for (int i = 0; i < WORKING_SET; i++) {
+			held[i] = w->impl->alloc(w->impl->ctx, w->size);
+			*(volatile uint8_t *)held[i] = (uint8_t)i;
+		}
+		for (int i = 0; i < WORKING_SET; i++)
+			w->impl->free(w->impl->ctx, held[i]);
+	}
+	return NULL;
+}
+
+static void scaling_one(impl_t *impl, size_t size)
+{
+	worker_t *w = calloc(max_threads, sizeof(worker_t));
+	double ops_per_thread = (double)(iters / (2 * WORKING_SET)) * 2 * WORKING_SET;
+
+	for (int n = 1; n <= max_threads; n *= 2) {
+		for (int i = 0; i < n; i++)
+			w[i] = (worker_t){ .impl = impl, .size = size, .index = i };
+		double ns = run_threads(n, scaling_worker, w);
+		report_row("scaling", impl->name, n, size, ops_per_thread * n, ns);
+	}
+	free(w);
+}
+
+static void scaling(size_t size)
+{
+	mempool_t *pool = make_pool(size, POOL_F_BATCH);
+	impl_t impl = { "mempool", pool_impl_alloc, pool_impl_free, pool };
+
+	scaling_one(&impl, size);
+	pool_destroy(pool);
+
+	for (int i = 0; i < num_libs; i++) {
+		impl = lib_impl(&libs[i]);
+		scaling_one(&impl, size);
+	}
+}
+
+/* ---- prodcons: single-producer single-consumer rings ---- */
+
+struct ring {
+	_Atomic(size_t) head CACHE_ALIGNED; /* Next slot the consumer reads */
+	_Atomic(size_t) tail CACHE_ALIGNED; /* Next slot the producer writes */
+	void *slots[RING_SIZE];
+};
+
+static void *producer(void *arg)
+{
+	worker_t *w = arg;
+	struct ring *ring = w->ring;
+
+	wait_start(w);
+	for (long i = 0; i < iters; i++) {
+		void *p = w->impl->alloc(w->impl->ctx, w->size);
+		*(volatile uint8_t *)p = (uint8_t)i;
+
+		size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == RING_SIZE)
+			sched_yield();
+		ring->slots[tail & (RING_SIZE - 1)] = p;
+		atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	worker_t *w = arg;
+	struct ring *ring = w->ring;
+
+	wait_start(w);
+	for (long i = 0; i < iters; i++) {
+		size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+			sched_yield();
+		void *p = ring->slots[head & (RING_SIZE - 1)];
+		atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+		w->impl->free(w->impl->ctx, p);
+	}
+	return NULL;
+}
+
+static void *prodcons_worker(void *arg)
+{
+	worker_t *w = arg;
+
+	return (w->index & 1) ? consumer(arg) : producer(arg);
+}
+
+static void prodcons_one(impl_t *impl, size_t size)
+{
+	int max_pairs = max_threads / 2 > 0 ? max_threads / 2 : 1;
+	worker_t *w = calloc(2 * max_pairs, sizeof(worker_t));
+	struct ring *rings = cache_aligned_alloc(max_pairs * sizeof(struct ring));
+
+	for (int pairs = 1; pairs <= max_pairs; pairs *= 2) {
+		for (int i = 0; i < 2 * pairs; i++) {
+			struct ring *ring = &rings[i / 2];
+
+			atomic_store(&ring->head, 0);
+			atomic_store(&ring->tail, 0);
+			w[i] = (worker_t){ .impl = impl, .size = size, .index = i,
+					   .ring = ring };
+		}
+		double ns = run_threads(2 * pairs, prodcons_worker, w);
+		/* One alloc and one free per block, split across the pair */
+		report_row("prodcons", impl->name, 2 * pairs, size,
+			   2.0 * iters * pairs, ns);
+	}
+
+	free(rings);
+	free(w);
+}
+
+static void prodcons(size_t size)
+{
+	mempool_t *pool = make_pool(size, POOL_F_REMOTE_FREE);
+	impl_t impl = { "mempool", pool_impl_alloc, pool_impl_free, pool };
+
+	prodcons_one(&impl, size);
+	pool_destroy(pool);
+
+	for (int i = 0; i < num_libs; i++) {
+		impl = lib_impl(&libs[i]);
+		prodcons_one(&impl, size);
+	}
+}
+
+/* ---- mixed sizes ---- */
+
+/* 70% 16-128 bytes, 25% 128-1024, 5% 1-8 KB */
+static size_t pick_size(uint64_t *seed)
+{
+	uint64_t r = xorshift(seed);
+	unsigned int bucket = (unsigned int)(r % 100);
+
+	r >>= 8;
+	if (bucket < 70)
+		return 16 + r % 113;
+	if (bucket < 95)
+		return 128 + r % 897;
+	return 1024 + r % 7169;
+}
+
+static void *mixed_worker(void *arg)
+{
+	worker_t *w = arg;
+	void **slots = calloc(MIXED_SLOTS, sizeof(void *));
+	uint64_t seed = 0x9E3779B97F4A7C15ULL * (uint64_t)(w->index + 1);
+
+	wait_start(w);
+	for (long i = 0; i < iters; i++) {
+		size_t slot = xorshift(&seed) % MIXED_SLOTS;
+
+		if (slots[slot])
+			w->impl->free(w->impl->ctx, slots[slot]);
+		slots[slot] = w->impl->alloc(w->impl->ctx, pick_size(&seed));
+		*(volatile uint8_t *)slots[slot] = (uint8_t)i;
+	}
+	for (size_t i = 0; i < MIXED_SLOTS; i++) {
+		if (slots[i])
+			w->impl->free(w->impl->ctx, slots[i]);
+	}
+
+	free(slots);
+	return NULL;
+}
+
+static void mixed_one(impl_t *impl)
+{
+	worker_t *w = calloc(max_threads, sizeof(worker_t));
+
+	for (int n = 1; n <= max_threads; n *= 2) {
+		for (int i = 0; i < n; i++)
+			w[i] = (worker_t){ .impl = impl, .index = i };
+		double ns = run_threads(n, mixed_worker, w);
+		report_row("mixed", impl->name, n, 0, (double)iters * n, ns);
+	}
+	free(w);
+}
+
+static void mixed(void)
+{
+	sc_config_t cfg = { .bytes_per_class = 16u << 20 };
+	sizeclass_allocator_t *sc = sc_create(&cfg);
+	impl_t impl = { "mempool", sc_impl_alloc, sc_impl_free, sc };
+
+	mixed_one(&impl);
+	sc_destroy(sc);
+
+	for (int i = 0; i < num_libs; i++) {
+		impl = lib_impl(&libs[i]);
+		mixed_one(&impl);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	max_threads = cpus > 2 ? (int)cpus : 2;
+	for (int i = 1; i < argc; i++) {
+		if (report_parse_arg(argv[i]))
+			continue;
+		if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc)
+			iters = atol(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			max_threads = atoi(argv[++i]);
+	}
+	if (iters < 2 * WORKING_SET)
+		iters = 2 * WORKING_SET;
+	if (max_threads < 1)
+		max_threads = 1;
+
+	FILE *log = report_log();
+	fprintf(log, "Memory Pool vs Malloc Head-to-Head\n");
+	fprintf(log, "==================================\n");
+	load_libs();
+	fprintf(log, "%ld operations per thread, up to %d threads\n\n", iters, max_threads);
+
+	report_begin();
+	scaling(64);
+	scaling(1024);
+	prodcons(64);
+	mixed();
+	report_end();
+
+	return 0;
+}
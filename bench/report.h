@@ -0,0 +1,101 @@
+#ifndef MEMPOOL_BENCH_REPORT_H
+#define MEMPOOL_BENCH_REPORT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Result output shared by the benchmarks. Every measurement is one row
+ * (benchmark, allocator, threads, size, ns/op, Mops/s), printed as an
+ * aligned table, as CSV with a header line, or as a JSON array, so runs
+ * can be diffed and tracked over time.
+ *
+ * Benchmarks accept --csv or --json to pick the format; anything that is
+ * not a result row goes to stderr in those modes.
+ */
+
+typedef enum {
+	REPORT_TEXT,
+	REPORT_CSV,
+	REPORT_JSON
+} report_format_t;
+
+static report_format_t report_format = REPORT_TEXT;
+static int report_rows;
+
+static inline double report_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Pick the output format from argv; returns 1 if argv[i] was a format flag.
+ */
+static inline int report_parse_arg(const char *arg)
+{
+	if (strcmp(arg, "--csv") == 0) {
+		report_format = REPORT_CSV;
+		return 1;
+	}
+	if (strcmp(arg, "--json") == 0) {
+		report_format = REPORT_JSON;
+		return 1;
+	}
+	return 0;
+}
+
+/* Stream for banners and section headings: stdout only for text output */
+static inline FILE *report_log(void)
+{
+	return report_format == REPORT_TEXT ? stdout : stderr;
+}
+
+static inline void report_begin(void)
+{
+	report_rows = 0;
+	if (report_format == REPORT_CSV)
+		printf("benchmark,allocator,threads,size,ns_per_op,mops\n");
+	else if (report_format == REPORT_JSON)
+		printf("[\n");
+	else
+		printf("%-14s %-18s %7s %7s %10s %10s\n", "benchmark", "allocator",
+		       "threads", "size", "ns/op", "Mops/s");
+}
+
+/**
+ * Emit one result: ops operations took elapsed_ns nanoseconds of wall time
+ * across threads threads. ns/op is per thread, Mops/s is aggregate.
+ */
+static inline void report_row(const char *bench, const char *allocator, int threads,
+			      size_t size, double ops, double elapsed_ns)
+{
+	double ns_per_op = elapsed_ns * threads / ops;
+	double mops = ops / elapsed_ns * 1e3;
+
+	if (report_format == REPORT_CSV) {
+		printf("%s,%s,%d,%zu,%.2f,%.2f\n", bench, allocator, threads, size,
+		       ns_per_op, mops);
+	} else if (report_format == REPORT_JSON) {
+		printf("%s  {\"benchmark\": \"%s\", \"allocator\": \"%s\", "
+		       "\"threads\": %d, \"size\": %zu, \"ns_per_op\": %.2f, "
+		       "\"mops\": %.2f}", report_rows ? ",\n" : "", bench, allocator,
+		       threads, size, ns_per_op, mops);
+	} else {
+		printf("%-14s %-18s %7d %7zu %10.2f %10.2f\n", bench, allocator,
+		       threads, size, ns_per_op, mops);
+	}
+	report_rows++;
+	fflush(stdout);
+}
+
+static inline void report_end(void)
+{
+	if (report_format == REPORT_JSON)
+		printf("%s]\n", report_rows ? "\n" : "");
+}
+
+#endif /* MEMPOOL_BENCH_REPORT_H */
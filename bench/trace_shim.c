@@ -0,0 +1,95 @@
+#include "../include/trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+/*
+ * LD_PRELOAD allocation recorder.
+ *
+ * Interposes the malloc family, forwards to glibc through its __libc_*
+ * entry points (so there is no dlsym bootstrap to get through) and logs
+ * every call with trace_alloc/trace_free:
+ *
+ *   MEMPOOL_TRACE=app.trace LD_PRELOAD=build/libmptrace.so ./app
+ *
+ * Recording starts when the library loads and stops at exit; the trace
+ * then drives bench_replay. realloc is logged as a free of the old block
+ * and an allocation of the new one.
+ */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+__attribute__((constructor)) static void shim_init(void)
+{
+	const char *path = getenv("MEMPOOL_TRACE");
+
+	if (path && *path && trace_open(path) != 0)
+		fprintf(stderr, "trace_shim: cannot open %s\n", path);
+}
+
+__attribute__((destructor)) static void shim_fini(void)
+{
+	trace_close();
+}
+
+void *malloc(size_t size)
+{
+	void *p = __libc_malloc(size);
+	trace_alloc(p, size);
+	return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	void *p = __libc_calloc(nmemb, size);
+	trace_alloc(p, nmemb * size);
+	return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	void *p = __libc_realloc(ptr, size);
+
+	/* On failure the old block stays live; realloc(p, 0) frees it */
+	if (p || size == 0)
+		trace_free(ptr);
+	trace_alloc(p, size);
+	return p;
+}
+
+void free(void *ptr)
+{
+	trace_free(ptr);
+	__libc_free(ptr);
+}
+
+int posix_memalign(void **out, size_t align, size_t size)
+{
+	if (align < sizeof(void *) || (align & (align - 1)) != 0)
+		return EINVAL;
+
+	void *p = __libc_memalign(align, size);
+	if (!p)
+		return ENOMEM;
+	trace_alloc(p, size);
+	*out = p;
+	return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+	void *p = __libc_memalign(align, size);
+	trace_alloc(p, size);
+	return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+	void *p = __libc_memalign(align, size);
+	trace_alloc(p, size);
+	return p;
+}
@@ -4,19 +4,59 @@
 #include <stddef.h>
 #include <stdint.h>
 
-/* Cache-line size detection */
-#ifdef __x86_64__
-  #define CACHE_LINE_SIZE 64
-#elif defined(__aarch64__)
-  #define CACHE_LINE_SIZE 64
-#elif defined(__arm__)
-  #define CACHE_LINE_SIZE 32
+/*
+ * Cache geometry, fixed at build time (override with -DCACHE_LINE_SIZE=N
+ * and -DCACHE_DESTRUCTIVE_SIZE=N, or make CACHE_LINE=N):
+ *
+ *   CACHE_LINE_SIZE         coherence unit; block alignment and line
+ *                           rounding use it
+ *   CACHE_DESTRUCTIVE_SIZE  distance at which two independently written
+ *                           objects stop false-sharing (C++17
+ *                           hardware_destructive_interference_size); the
+ *                           x86 spatial prefetcher pulls lines in pairs,
+ *                           and Apple M-series and Neoverse V cores move
+ *                           128-byte lines
+ *
+ * Both are integer constant expressions, usable in _Alignas, static
+ * asserts and C++ constexpr. cache_line_size() reports what the running
+ * CPU actually uses.
+ */
+#ifndef CACHE_LINE_SIZE
+  #if defined(__aarch64__) && defined(__APPLE__)
+    #define CACHE_LINE_SIZE 128
+  #else
+    #define CACHE_LINE_SIZE 64
+  #endif
+#endif
+
+#ifndef CACHE_DESTRUCTIVE_SIZE
+  #if defined(__x86_64__) || defined(__aarch64__)
+    #define CACHE_DESTRUCTIVE_SIZE 128
+  #else
+    #define CACHE_DESTRUCTIVE_SIZE CACHE_LINE_SIZE
+  #endif
+#endif
+
+/* Alignment attribute: keeps a field clear of its neighbours' lines */
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_DESTRUCTIVE_SIZE)))
+
+/* Start loading the line at p for a coming write; never faults */
+#if defined(__GNUC__) || defined(__clang__)
+  #define PREFETCH_WRITE(p) __builtin_prefetch((p), 1, 3)
 #else
-  #define CACHE_LINE_SIZE 64
+  #define PREFETCH_WRITE(p) ((void)(p))
 #endif
 
-/* Alignment attribute */
-#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+/*
+ * Block alignment choices for the *_create_ex configs. Any power of two
+ * >= MEMPOOL_ALIGN_MIN is accepted; cache-line alignment is opt-in for
+ * objects that must not false-share.
+ */
+#define MEMPOOL_ALIGN_DEFAULT    0                /* 16 bytes, like malloc */
+#define MEMPOOL_ALIGN_MIN        8
+#define MEMPOOL_ALIGN_NATURAL    16
+#define MEMPOOL_ALIGN_CACHE_LINE CACHE_LINE_SIZE
+#define MEMPOOL_ALIGN_PAGE       ((size_t)-1)     /* System page size */
 
 /**
  * Align pointer to the next cache-line boundary.
@@ -38,6 +78,43 @@ static inline size_t align_size_to_cache_line(size_t sz)
 	return (sz + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
 }
 
+/**
+ * Round sz up to a multiple of align (a power of two).
+ */
+static inline size_t align_up(size_t sz, size_t align)
+{
+	return (sz + align - 1) & ~(align - 1);
+}
+
+/**
+ * Resolve a requested block alignment to a byte count.
+ * Returns 0 if align is not a supported power of two.
+ */
+size_t resolve_alignment(size_t align);
+
+/**
+ * Cache-line size of the running CPU: sysconf, then sysfs, then the
+ * cache type register (cpuid leaf 1 or CTR_EL0), else CACHE_LINE_SIZE.
+ * Probed once; later calls return the cached value.
+ */
+size_t cache_line_size(void);
+
+/**
+ * Padding for objects that must not false-share on the running CPU: the
+ * larger of CACHE_DESTRUCTIVE_SIZE and cache_line_size().
+ */
+size_t cache_padding(void);
+
+/**
+ * Allocate size bytes aligned to and rounded up to cache_padding(), so
+ * that no other allocation shares a line with the object. Also satisfies
+ * the alignment of any type with CACHE_ALIGNED members. Release with free().
+ *
+ * @param size Object size in bytes
+ * @return Pointer to uninitialized memory, or NULL on error
+ */
+void *cache_aligned_alloc(size_t size);
+
 /**
  * Calculate padding needed to align ptr to cache-line.
  */
@@ -2,9 +2,54 @@
 #define MEMPOOL_ARENA_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "align.h"
+#include "backing.h"
 
 typedef struct arena_allocator arena_allocator_t;
 
+/* Arena creation flags */
+#define ARENA_F_GROW          (1u << 0) /* Chain a new block when the current one is full */
+#define ARENA_F_SINGLE_THREAD (1u << 1) /* One owner thread: plain bump, no atomics */
+#define ARENA_F_PER_THREAD    (1u << 2) /* Each thread bumps in a private chunk */
+
+/* Extended arena configuration for arena_create_ex */
+typedef struct {
+	size_t capacity;       /* Capacity of the first block in bytes */
+	size_t align;          /* Allocation alignment: MEMPOOL_ALIGN_* or a power of two >= 8 */
+	unsigned int flags;    /* ARENA_F_* */
+	size_t max_block_size; /* ARENA_F_GROW: block size stops doubling here (0 = no limit) */
+	size_t max_capacity;   /* ARENA_F_GROW: cap on bytes across all blocks (0 = no cap) */
+	size_t thread_chunk;   /* ARENA_F_PER_THREAD: bytes per private chunk (0 = 16 KB) */
+	const mempool_backing_t *backing; /* Block memory provider (NULL = heap) */
+	unsigned int decay_ms; /* Release cached blocks idle this long (0 = only arena_trim) */
+} arena_config_t;
+
+/* Arena statistics including contention counters, see arena_stats_ex */
+typedef struct {
+	size_t used;            /* Bytes used in the active chain */
+	size_t capacity;        /* Capacity of the active chain */
+	uint64_t cas_retries;   /* Shared-offset CASes that lost a race and retried */
+	uint64_t backoff_spins; /* Pause instructions spun backing off after them */
+	size_t purged;          /* Bytes of cached blocks released to the OS */
+} arena_stats_ex_t;
+
+/*
+ * Header-visible prefix of every arena, read by the inline single-owner
+ * fast path. Only meaningful for ARENA_F_SINGLE_THREAD arenas.
+ */
+typedef struct {
+	uint8_t *bump;     /* Next free byte in the current block */
+	uint8_t *end;      /* End of the current block */
+	size_t align_mask; /* Allocation alignment minus one */
+} arena_local_t;
+
+/* Saved arena position for arena_rewind */
+typedef struct {
+	void *block;   /* Block that was current at arena_mark */
+	size_t offset; /* Its bump offset at arena_mark */
+} arena_mark_t;
+
 /**
  * Create an arena (bump) allocator.
  *
@@ -13,24 +58,115 @@ typedef struct arena_allocator arena_allocator_t;
  */
 arena_allocator_t *arena_create(size_t capacity);
 
+/**
+ * Create an arena from an extended configuration.
+ * Allocation sizes are rounded to cfg->align only (16 bytes by default),
+ * so small objects pack densely; cache-line alignment is opt-in.
+ *
+ * With ARENA_F_GROW a full arena chains a new block instead of failing.
+ * Each new block doubles the previous size (starting from capacity) up to
+ * max_block_size, and is large enough for the request that triggered it;
+ * growth stops once max_capacity bytes are chained.
+ *
+ * ARENA_F_SINGLE_THREAD arenas are owned by one thread at a time: the bump
+ * is a plain add and compare, inlined by arena_alloc_local. With
+ * ARENA_F_PER_THREAD, every thread carves a private thread_chunk from the
+ * arena with one atomic operation and bumps inside it without atomics;
+ * requests larger than half a chunk go to the shared block directly.
+ * A rewind or reset retires every thread's chunk. Each thread keeps its
+ * chunks in a small set-associative table; an arena whose set is full of
+ * other arenas in recent use bumps in the shared block instead of
+ * evicting one of their chunks.
+ *
+ * Block memory comes from cfg->backing (see backing.h); cached blocks are
+ * kept mapped until arena_destroy. With decay_ms set, the pages of a
+ * cached block that has not been reused for that long are released,
+ * checked whenever the arena rewinds or grows; arena_trim releases them
+ * at once.
+ *
+ * @param cfg Arena configuration
+ * @return Pointer to arena allocator, or NULL on error
+ */
+arena_allocator_t *arena_create_ex(const arena_config_t *cfg);
+
 /**
  * Allocate memory from the arena.
  * Fast sequential allocation without free (use arena_reset instead).
  *
  * @param alloc Pointer to arena allocator
- * @param size  Number of bytes to allocate (will be aligned to cache line)
- * @return Pointer to allocated memory (cache-line aligned), or NULL on overflow
+ * @param size  Number of bytes to allocate (rounded to the arena alignment)
+ * @return Pointer to allocated memory (arena-aligned), or NULL on overflow
  */
 void *arena_alloc(arena_allocator_t *alloc, size_t size);
 
+/**
+ * Slow path of arena_alloc_local: chain a block, or fall back to
+ * arena_alloc for arenas that are not single-owner. Not for direct use.
+ */
+void *arena_alloc_slow(arena_allocator_t *alloc, size_t size);
+
+/**
+ * Allocate from a single-owner (ARENA_F_SINGLE_THREAD) arena with an
+ * inlined bump. On other arenas this is equivalent to arena_alloc.
+ *
+ * @param alloc Pointer to arena allocator
+ * @param size  Number of bytes to allocate (rounded to the arena alignment)
+ * @return Pointer to allocated memory (arena-aligned), or NULL on overflow
+ */
+static inline void *arena_alloc_local(arena_allocator_t *alloc, size_t size)
+{
+	arena_local_t *local = (arena_local_t *)alloc;
+
+	size_t rounded = (size + local->align_mask) & ~local->align_mask;
+	if (rounded < size)
+		return NULL; /* Rounding wrapped past SIZE_MAX */
+	if (rounded && (size_t)(local->end - local->bump) >= rounded) {
+		void *ptr = local->bump;
+		local->bump += rounded;
+		return ptr;
+	}
+
+	return arena_alloc_slow(alloc, rounded);
+}
+
+/**
+ * Record the current arena position.
+ *
+ * @param alloc Pointer to arena allocator
+ * @return Mark to pass to arena_rewind
+ */
+arena_mark_t arena_mark(arena_allocator_t *alloc);
+
+/**
+ * Release everything allocated since mark was taken, in O(1) plus one
+ * step per block chained since then. Blocks chained after the mark go to
+ * the arena's block cache. Marks must be rewound in LIFO order and not
+ * concurrently with arena_alloc on the same arena.
+ *
+ * @param alloc Pointer to arena allocator
+ * @param mark  Mark returned by arena_mark
+ */
+void arena_rewind(arena_allocator_t *alloc, arena_mark_t mark);
+
 /**
  * Reset the arena, freeing all allocations at once.
- * This is the only way to free memory in an arena allocator.
+ * The first block is kept; extra chained blocks go to a cache and are
+ * reused before new memory is requested on later growth.
  *
  * @param alloc Pointer to arena allocator
  */
 void arena_reset(arena_allocator_t *alloc);
 
+/**
+ * Give the pages of the cached blocks (those left over by arena_reset and
+ * arena_rewind) back to the OS. The blocks stay in the cache, and their
+ * pages fault back in when growth reuses them.
+ *
+ * @param alloc Pointer to arena allocator
+ * @return Bytes released
+ */
+size_t arena_trim(arena_allocator_t *alloc);
+
 /**
  * Destroy the arena allocator and free all resources.
  *
@@ -42,10 +178,20 @@ void arena_destroy(arena_allocator_t *alloc);
  * Get statistics from the arena allocator.
  *
  * @param alloc     Pointer to arena allocator
- * @param used      Out parameter for bytes used
- * @param capacity  Out parameter for total capacity
+ * @param used      Out parameter for bytes used in the active chain
+ * @param capacity  Out parameter for capacity of the active chain
  * @return 0 on success, -1 on error
  */
 int arena_stats(arena_allocator_t *alloc, size_t *used, size_t *capacity);
 
+/**
+ * Get usage and contention statistics from the arena allocator.
+ * Frequent retries on a shared arena suggest ARENA_F_PER_THREAD.
+ *
+ * @param alloc Pointer to arena allocator
+ * @param stats Out parameter for the statistics
+ * @return 0 on success, -1 on error
+ */
+int arena_stats_ex(arena_allocator_t *alloc, arena_stats_ex_t *stats);
+
 #endif /* MEMPOOL_ARENA_H */
@@ -0,0 +1,98 @@
+#ifndef MEMPOOL_BACKING_H
+#define MEMPOOL_BACKING_H
+
+#include <stddef.h>
+
+/* Flags for the built-in mmap provider */
+#define BACKING_F_HUGETLB  (1u << 0) /* MAP_HUGETLB; falls back to regular pages + THP */
+#define BACKING_F_THP      (1u << 1) /* madvise(MADV_HUGEPAGE) on 2 MB-aligned mappings */
+#define BACKING_F_POPULATE (1u << 2) /* Prefault pages at map/commit time */
+
+typedef struct mempool_backing mempool_backing_t;
+
+/*
+ * Backing-memory provider: where slabs and arenas get their bulk memory.
+ * Allocators copy the provider at creation, so a caller-built provider
+ * (or its ctx) only has to outlive the allocators that use it.
+ *
+ * alloc/free are required. reserve/commit/release are optional: when all
+ * three are set, a growable slab with a block cap reserves its whole
+ * address range up front and commits one chunk at a time.
+ *
+ * purge is optional too: it hands the pages of an idle range back to the
+ * OS while the range stays mapped and usable (reads then see zeros), and
+ * returns the bytes released. Trimming (slab_trim, arena_trim) does
+ * nothing for providers without it.
+ */
+struct mempool_backing {
+	void *(*alloc)(const mempool_backing_t *b, size_t size, size_t align);
+	void (*free)(const mempool_backing_t *b, void *ptr, size_t size);
+	void *(*reserve)(const mempool_backing_t *b, size_t size, size_t align);
+	int (*commit)(const mempool_backing_t *b, void *ptr, size_t size);
+	void (*release)(const mempool_backing_t *b, void *ptr, size_t size);
+	size_t (*purge)(const mempool_backing_t *b, void *ptr, size_t size);
+	unsigned int flags; /* BACKING_F_* for the built-in mmap provider */
+	int node;           /* NUMA node to bind memory to, or -1 for first touch */
+	void *ctx;          /* Provider-private data */
+};
+
+/**
+ * Heap provider: aligned_alloc/free, no reservation. Purging releases the
+ * whole pages of a range with madvise(MADV_DONTNEED). This is what every
+ * allocator uses when no provider is given.
+ */
+extern const mempool_backing_t backing_heap;
+
+/**
+ * Build an mmap provider.
+ * Mappings are page-aligned (2 MB-aligned with hugepage flags), and
+ * reserve/commit map PROT_NONE address space that is made accessible
+ * piecewise with mprotect. Purging uses madvise(MADV_DONTNEED), so the
+ * resident set shrinks at once.
+ *
+ * @param flags BACKING_F_* flags
+ * @return Provider to pass in an allocator configuration
+ */
+mempool_backing_t backing_mmap(unsigned int flags);
+
+/**
+ * Derive a provider that places memory on one NUMA node.
+ * The heap provider (or NULL) becomes an mmap provider, since heap memory
+ * cannot be bound; the mmap provider keeps its flags and binds each mapping
+ * with mbind before first touch. Custom providers are copied with node set
+ * and are expected to honour it themselves.
+ *
+ * @param b    Base provider, or NULL for the heap
+ * @param node Node to bind to
+ * @return Node-bound provider
+ */
+mempool_backing_t backing_on_node(const mempool_backing_t *b, int node);
+
+/**
+ * Pick the provider for an allocator configuration.
+ *
+ * @param b Provider from the configuration, or NULL
+ * @return b, or &backing_heap when b is NULL
+ */
+const mempool_backing_t *backing_or_default(const mempool_backing_t *b);
+
+/**
+ * Check whether a provider supports reserve-then-commit.
+ *
+ * @param b Provider
+ * @return Non-zero if reserve, commit and release are all set
+ */
+int backing_can_reserve(const mempool_backing_t *b);
+
+/**
+ * Release the whole pages inside [ptr, ptr + size) through b->purge.
+ * Their contents are lost.
+ *
+ * @param b    Provider the range came from
+ * @param ptr  Start of the range
+ * @param size Length in bytes
+ * @return Bytes released (0 if b cannot purge or the range holds no whole page)
+ */
+size_t backing_purge(const mempool_backing_t *b, void *ptr, size_t size);
+
+#endif /* MEMPOOL_BACKING_H */
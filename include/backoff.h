@@ -0,0 +1,54 @@
+#ifndef MEMPOOL_BACKOFF_H
+#define MEMPOOL_BACKOFF_H
+
+#include <stdint.h>
+
+/* Spin bounds for a failed CAS: the wait doubles from MIN up to MAX pauses */
+#ifndef BACKOFF_MIN_SPINS
+  #define BACKOFF_MIN_SPINS 1
+#endif
+#ifndef BACKOFF_MAX_SPINS
+  #define BACKOFF_MAX_SPINS 256
+#endif
+
+/* Per-operation backoff state; start each retry loop with BACKOFF_INIT */
+typedef struct {
+	unsigned int spins; /* Pauses to spin on the next failure */
+} backoff_t;
+
+#define BACKOFF_INIT { BACKOFF_MIN_SPINS }
+
+/**
+ * Hint to the CPU that this is a spin-wait (pause on x86, yield on ARM).
+ */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/**
+ * Wait after a failed CAS, then double the next wait up to the bound.
+ * Backing off lets the winning thread's cache line settle instead of
+ * every loser hammering it again at once.
+ *
+ * @param b Backoff state of the current operation
+ * @return Number of pauses spun
+ */
+static inline unsigned int backoff_pause(backoff_t *b)
+{
+	unsigned int spins = b->spins;
+
+	for (unsigned int i = 0; i < spins; i++)
+		cpu_relax();
+	if (b->spins < BACKOFF_MAX_SPINS)
+		b->spins <<= 1;
+	return spins;
+}
+
+#endif /* MEMPOOL_BACKOFF_H */
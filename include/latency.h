@@ -0,0 +1,207 @@
+#ifndef MEMPOOL_LATENCY_H
+#define MEMPOOL_LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Opt-in latency instrumentation for the alloc/free paths.
+ *
+ * Built with -DMEMPOOL_INSTRUMENT (make INSTRUMENT=1), every instrumented
+ * operation reads the cycle counter before and after and adds the delta
+ * to a per-thread log-linear (HDR-style) histogram: 16 sub-buckets per
+ * power of two, so any recorded value is within 1/16 of its bucket. The
+ * owning thread is the only writer, so recording takes no locks and no
+ * atomic read-modify-writes; snapshots merge all threads on demand.
+ *
+ * Without MEMPOOL_INSTRUMENT the hooks compile to nothing and the
+ * snapshot functions return -1. Code that inlines pool_alloc_fast and
+ * friends must be built with the same setting to have those paths
+ * recorded.
+ */
+
+/* Instrumented events */
+typedef enum {
+	LAT_EV_POOL_ALLOC_FAST, /* pool_alloc served by the thread cache */
+	LAT_EV_POOL_ALLOC_SLOW, /* pool_alloc that missed the thread cache */
+	LAT_EV_POOL_FREE_FAST,  /* pool_free absorbed by the thread cache */
+	LAT_EV_POOL_FREE_SLOW,  /* pool_free through the slow path */
+	LAT_EV_POOL_REFILL,     /* Magazine refill inside a slow alloc */
+	LAT_EV_POOL_FLUSH,      /* Magazine flush inside a slow free */
+	LAT_EV_SLAB_ALLOC,      /* slab_alloc without CAS retries */
+	LAT_EV_SLAB_FREE,       /* slab_free without CAS retries */
+	LAT_EV_SLAB_CONTENDED,  /* slab_alloc/slab_free that retried a CAS */
+	LAT_EV_SLAB_GROW,       /* Chunk added to a growable slab */
+	LAT_EV_ARENA_ALLOC,     /* arena_alloc, including any growth */
+	LAT_EV_ARENA_GROW,      /* Block chained onto an arena */
+	LAT_EV_COUNT
+} latency_event_t;
+
+/* Histogram layout: values below 16 are exact, then 16 buckets per octave */
+#define LAT_SUB_BITS    4
+#define LAT_SUB_COUNT   (1u << LAT_SUB_BITS)
+#define LAT_MAX_EXP     40 /* Ticks of 2^40 and above share the last bucket */
+#define LAT_BUCKETS     ((LAT_MAX_EXP - LAT_SUB_BITS + 1) * LAT_SUB_COUNT)
+
+/* Merged histogram of one event, in cycle-counter ticks */
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[LAT_BUCKETS];
+} latency_hist_t;
+
+/* Percentile summary of one event, in nanoseconds */
+typedef struct {
+	uint64_t count;
+	double mean;
+	double min;
+	double p50;
+	double p90;
+	double p99;
+	double p999;
+	double max;
+} latency_summary_t;
+
+#ifdef MEMPOOL_INSTRUMENT
+
+/* CAS retries seen by the calling thread, for contended-event routing */
+extern _Thread_local unsigned int latency_retries;
+
+/* Monotonic clock in nanoseconds, the tick source without a cycle counter */
+uint64_t latency_clock_ns(void);
+
+/**
+ * Read the cycle counter: rdtsc on x86, cntvct on AArch64, the monotonic
+ * clock in nanoseconds elsewhere.
+ */
+static inline uint64_t latency_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+	uint64_t v;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+#else
+	return latency_clock_ns();
+#endif
+}
+
+/**
+ * Add one sample to the calling thread's histogram for ev.
+ * Not for direct use; see LATENCY_END.
+ */
+void latency_record(latency_event_t ev, uint64_t ticks);
+
+#define LATENCY_START(t) uint64_t t = latency_ticks()
+#define LATENCY_END(ev, t) latency_record((ev), latency_ticks() - (t))
+#define LATENCY_START_CONTENDED(t) \
+	LATENCY_START(t); \
+	unsigned int t##_retries = latency_retries
+#define LATENCY_END_CONTENDED(ev, contended, t) \
+	latency_record(latency_retries != t##_retries ? (contended) : (ev), \
+		       latency_ticks() - (t))
+#define LATENCY_RETRY() (latency_retries++)
+
+#else
+
+#define LATENCY_START(t)                        ((void)0)
+#define LATENCY_END(ev, t)                      ((void)0)
+#define LATENCY_START_CONTENDED(t)              ((void)0)
+#define LATENCY_END_CONTENDED(ev, contended, t) ((void)0)
+#define LATENCY_RETRY()                         ((void)0)
+
+#endif /* MEMPOOL_INSTRUMENT */
+
+/**
+ * Get the name of an event, e.g. "pool_alloc_fast".
+ *
+ * @param ev Event
+ * @return Static string, or "unknown"
+ */
+const char *latency_event_name(latency_event_t ev);
+
+/**
+ * Merge every thread's histogram for one event, including threads that
+ * have exited. Live threads keep recording while this runs, so counts
+ * from different buckets may be a few samples apart.
+ *
+ * @param ev   Event
+ * @param hist Out: merged histogram in ticks
+ * @return 0 on success, -1 if instrumentation is compiled out
+ */
+int latency_snapshot(latency_event_t ev, latency_hist_t *hist);
+
+/**
+ * Add one value to a histogram. Lets tools that take their own timings
+ * (in any unit) reuse the bucket layout and latency_hist_value_at.
+ *
+ * @param hist  Histogram, zero-initialized before first use
+ * @param value Sample
+ */
+void latency_hist_add(latency_hist_t *hist, uint64_t value);
+
+/**
+ * Add every sample of src into dst.
+ *
+ * @param dst Histogram to add to
+ * @param src Histogram to add
+ */
+void latency_hist_merge(latency_hist_t *dst, const latency_hist_t *src);
+
+/**
+ * Value at quantile q of a histogram, in the units it was recorded in.
+ * Returns the upper edge of the bucket holding the q-th sample, capped at
+ * the maximum, so the error is at most one bucket width (1/16 of the value).
+ *
+ * @param hist Histogram
+ * @param q    Quantile in [0, 1], e.g. 0.999
+ * @return Sample value, 0 for an empty histogram
+ */
+uint64_t latency_hist_value_at(const latency_hist_t *hist, double q);
+
+/**
+ * Value at quantile q of a histogram, converted to nanoseconds.
+ * Same as latency_hist_value_at scaled by latency_ticks_per_ns.
+ *
+ * @param hist Histogram from latency_snapshot
+ * @param q    Quantile in [0, 1], e.g. 0.999
+ * @return Latency in nanoseconds, 0 for an empty histogram
+ */
+double latency_quantile(const latency_hist_t *hist, double q);
+
+/**
+ * Summarize one event: count, mean, min, p50/p90/p99/p99.9 and max.
+ *
+ * @param ev  Event
+ * @param out Out: summary in nanoseconds
+ * @return 0 on success, -1 if instrumentation is compiled out
+ */
+int latency_summary(latency_event_t ev, latency_summary_t *out);
+
+/**
+ * Write one CSV line per event with samples:
+ * event,count,mean_ns,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns
+ *
+ * @param f Output stream
+ * @return 0 on success, -1 if instrumentation is compiled out
+ */
+int latency_export(FILE *f);
+
+/**
+ * Clear all histograms. Samples recorded concurrently may survive.
+ */
+void latency_reset(void);
+
+/**
+ * Get the cycle-counter rate used to convert ticks to nanoseconds.
+ * Calibrated once against the monotonic clock on first use.
+ *
+ * @return Ticks per nanosecond
+ */
+double latency_ticks_per_ns(void);
+
+#endif /* MEMPOOL_LATENCY_H */
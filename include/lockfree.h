@@ -0,0 +1,133 @@
+#ifndef MEMPOOL_LOCKFREE_H
+#define MEMPOOL_LOCKFREE_H
+
+#include <stddef.h>
+
+/*
+ * Lock-free containers of block pointers.
+ *
+ * Three MPMC containers for handing pool blocks between threads:
+ *
+ *   lf_ring_t   bounded ring (Vyukov): one CAS per operation, FIFO
+ *   lf_queue_t  Michael-Scott queue: linked FIFO, producers and consumers
+ *               contend on different ends
+ *   lf_stack_t  Treiber stack: LIFO, hands back the most recently pushed
+ *               (cache-hot) block first
+ *
+ * Each container is a single cache-line-aligned allocation made at
+ * create time: the shared counters or list heads sit on cache lines of
+ * their own, followed by the ring cells or the node pool. Nodes are
+ * padded to a cache line so that a producer filling one node never
+ * shares a line with a consumer draining its neighbour. The queue and the
+ * stack keep their free nodes on a Treiber stack of node indices, like
+ * the slab free list, and link nodes by index with a version tag, so a
+ * node that is popped and pushed back while a thread still looks at it
+ * (ABA) makes that thread's CAS fail instead of corrupting the list.
+ * Nodes never leave the container, so no reclamation scheme is needed;
+ * push and pop never allocate.
+ *
+ * Capacity is fixed: push fails when the container is full. NULL cannot
+ * be stored, as pop returns NULL for an empty container.
+ */
+
+typedef struct lf_ring lf_ring_t;
+typedef struct lf_queue lf_queue_t;
+typedef struct lf_stack lf_stack_t;
+
+/**
+ * Create a bounded MPMC ring.
+ *
+ * @param capacity Number of slots, rounded up to a power of two
+ * @return Pointer to ring, or NULL on error
+ */
+lf_ring_t *lf_ring_create(size_t capacity);
+
+/**
+ * Append a pointer to the ring.
+ *
+ * @param ring Pointer to ring
+ * @param ptr  Pointer to store (not NULL)
+ * @return 0 on success, -1 if the ring is full or ptr is NULL
+ */
+int lf_ring_push(lf_ring_t *ring, void *ptr);
+
+/**
+ * Remove the oldest pointer from the ring.
+ *
+ * @param ring Pointer to ring
+ * @return Oldest pointer, or NULL if the ring is empty
+ */
+void *lf_ring_pop(lf_ring_t *ring);
+
+/**
+ * Destroy a ring. Pointers still stored in it are dropped.
+ *
+ * @param ring Pointer to ring
+ */
+void lf_ring_destroy(lf_ring_t *ring);
+
+/**
+ * Create a Michael-Scott queue with a pool of capacity nodes.
+ *
+ * @param capacity Maximum number of queued pointers
+ * @return Pointer to queue, or NULL on error
+ */
+lf_queue_t *lf_queue_create(size_t capacity);
+
+/**
+ * Append a pointer to the queue.
+ *
+ * @param queue Pointer to queue
+ * @param ptr   Pointer to store (not NULL)
+ * @return 0 on success, -1 if no node is free or ptr is NULL
+ */
+int lf_queue_push(lf_queue_t *queue, void *ptr);
+
+/**
+ * Remove the oldest pointer from the queue.
+ *
+ * @param queue Pointer to queue
+ * @return Oldest pointer, or NULL if the queue is empty
+ */
+void *lf_queue_pop(lf_queue_t *queue);
+
+/**
+ * Destroy a queue. Pointers still stored in it are dropped.
+ *
+ * @param queue Pointer to queue
+ */
+void lf_queue_destroy(lf_queue_t *queue);
+
+/**
+ * Create a Treiber stack with a pool of capacity nodes.
+ *
+ * @param capacity Maximum number of stacked pointers
+ * @return Pointer to stack, or NULL on error
+ */
+lf_stack_t *lf_stack_create(size_t capacity);
+
+/**
+ * Push a pointer onto the stack.
+ *
+ * @param stack Pointer to stack
+ * @param ptr   Pointer to store (not NULL)
+ * @return 0 on success, -1 if no node is free or ptr is NULL
+ */
+int lf_stack_push(lf_stack_t *stack, void *ptr);
+
+/**
+ * Pop the most recently pushed pointer.
+ *
+ * @param stack Pointer to stack
+ * @return Top pointer, or NULL if the stack is empty
+ */
+void *lf_stack_pop(lf_stack_t *stack);
+
+/**
+ * Destroy a stack. Pointers still stored in it are dropped.
+ *
+ * @param stack Pointer to stack
+ */
+void lf_stack_destroy(lf_stack_t *stack);
+
+#endif /* MEMPOOL_LOCKFREE_H */
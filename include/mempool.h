@@ -2,9 +2,128 @@
 #define MEMPOOL_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "align.h"
+#include "backing.h"
+#include "latency.h"
 
 typedef struct mempool mempool_t;
 
+/* Maximum number of live pools (size of each thread's slot table) */
+#ifndef MEMPOOL_MAX_POOLS
+  #define MEMPOOL_MAX_POOLS 256
+#endif
+
+/* Pool creation flags */
+#define POOL_F_BATCH (1u << 0) /* Refill/flush half a magazine at a time */
+#define POOL_F_NUMA  (1u << 1) /* One global slab per NUMA node, local-first refills */
+#define POOL_F_REMOTE_FREE (1u << 2) /* Caches own spans; cross-thread frees go to the owner */
+#define POOL_F_ADAPTIVE (1u << 3) /* Magazines grow on repeated misses, shrink when idle */
+#define POOL_F_REGISTER (1u << 4) /* Enter the pool's memory in the page map for mempool_free_any */
+#define POOL_F_PREFETCH (1u << 5) /* Prefetch the block the next allocation will get */
+
+/* Lines of each block pool_alloc_prefetch_n prefetches */
+#define POOL_PREFETCH_LINES 4
+
+/* Extended pool configuration for pool_create_ex */
+typedef struct {
+	size_t block_size;        /* Size of each block */
+	size_t blocks_per_thread; /* Thread cache (magazine) capacity */
+	size_t total_blocks;      /* Blocks in the global slab (initial size with SLAB_F_GROW) */
+	size_t align;             /* Block alignment: MEMPOOL_ALIGN_* or a power of two >= 8 */
+	unsigned int flags;       /* POOL_F_* */
+	unsigned int slab_flags;  /* SLAB_F_* for the global slab */
+	size_t chunk_blocks;      /* SLAB_F_GROW: blocks added per growth step */
+	size_t max_blocks;        /* SLAB_F_GROW: hard cap on global blocks (0 = no cap) */
+	const mempool_backing_t *backing; /* Global slab memory provider (NULL = heap) */
+	unsigned int numa_nodes;  /* POOL_F_NUMA: number of node slabs (0 = detect) */
+	size_t span_blocks;       /* POOL_F_REMOTE_FREE: blocks per span (0 = 64) */
+	size_t max_blocks_per_thread; /* POOL_F_ADAPTIVE: magazine ceiling (0 = 16x) */
+	size_t cache_limit;       /* POOL_F_ADAPTIVE: total magazine capacity bound (0 = none) */
+	void (*ctor)(void *obj, void *arg); /* Object constructor, run once per block (see slab.h) */
+	void (*dtor)(void *obj, void *arg); /* Object destructor, run at pool_destroy */
+	void *obj_arg;            /* Second argument to ctor and dtor */
+	unsigned int decay_ms;    /* Release pages left free this long, from a background thread (0 = off) */
+} pool_config_t;
+
+/* Aggregated pool statistics, see pool_stats_ex */
+typedef struct {
+	size_t allocated;    /* Blocks not in the global slab (as pool_stats) */
+	size_t free;         /* Free blocks in the global slab(s) */
+	size_t threads;      /* Thread caches alive or parked */
+	size_t alloc_hits;   /* Allocations served by a thread cache */
+	size_t free_hits;    /* Frees absorbed by a thread cache */
+	size_t misses;       /* Allocations that found the thread cache empty */
+	size_t refills;      /* Thread cache refills from the global slab */
+	size_t flushes;      /* Thread cache spills to the global slab */
+	size_t remote_frees; /* Frees handed to another thread's cache */
+	size_t high_water;   /* Peak occupancy of any single thread cache */
+	uint64_t slab_cas_retries;   /* Global slab free-list CAS retries */
+	uint64_t slab_backoff_spins; /* Pauses spun backing off after them */
+	size_t grows;          /* POOL_F_ADAPTIVE: magazine capacity increases */
+	size_t shrinks;        /* POOL_F_ADAPTIVE: magazine capacity decreases */
+	size_t idle_returned;  /* POOL_F_ADAPTIVE: idle cached blocks returned to the slab */
+	size_t cache_capacity; /* POOL_F_ADAPTIVE: magazine capacity summed over live caches */
+	size_t ebr_retired;    /* Blocks passed to pool_retire */
+	size_t ebr_reclaimed;  /* Retired blocks freed after their grace period */
+	uint64_t epoch;        /* Current reclamation epoch */
+	size_t purged;         /* Free blocks on pages released by pool_trim or decay */
+} pool_stats_ex_t;
+
+/* Cross-node traffic of a POOL_F_NUMA pool, in blocks */
+typedef struct {
+	unsigned int num_nodes; /* Node slabs in the pool */
+	size_t local_blocks;    /* Refilled from the allocating thread's node */
+	size_t remote_blocks;   /* Stolen from another node's slab */
+	size_t remote_frees;    /* Returned to a node other than the freeing thread's */
+} pool_numa_stats_t;
+
+/*
+ * Header-visible state for the inline fast paths. Every pool starts with
+ * a pool_head_t and every thread cache with a pool_magazine_t, so a cache
+ * hit is a thread-local slot load, a generation compare and a plain
+ * load/store on the magazine; no atomics and no call.
+ *
+ * The per-thread counters are written only by the owning thread. They are
+ * _Atomic so pool_stats_ex can read them from another thread, but are
+ * bumped with a relaxed load and store (POOL_STAT_INC), which compiles to
+ * a plain add; no locked instruction and no shared cache line.
+ */
+#define POOL_STAT_INC(c) POOL_STAT_ADD(c, 1)
+#define POOL_STAT_ADD(c, n)                                                   \
+	atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (n), \
+			      memory_order_relaxed)
+
+typedef struct {
+	void **blocks; /* Cached free blocks */
+	size_t count;  /* Blocks in the magazine (owning thread only) */
+	size_t size;   /* Magazine capacity */
+	_Atomic(size_t) alloc_hits; /* Allocations served from the magazine */
+	_Atomic(size_t) free_hits;  /* Frees absorbed by the magazine */
+	_Atomic(size_t) high_water; /* Peak magazine occupancy */
+	size_t low_water; /* POOL_F_ADAPTIVE: lowest count since the last tick (else 0) */
+} pool_magazine_t;
+
+/* POOL_F_ADAPTIVE: thread-cache hits per magazine resizing tick (power of two) */
+#define POOL_ADAPT_INTERVAL 1024
+
+typedef struct {
+	pool_magazine_t *magazine; /* This thread's cache, valid if gen matches */
+	uint64_t gen;              /* Generation of the pool owning magazine */
+} pool_tls_slot_t;
+
+typedef struct {
+	unsigned int id;        /* Index into each thread's slot table */
+	unsigned int free_fast; /* Frees of any block may go to the magazine */
+	unsigned int adaptive;  /* POOL_F_ADAPTIVE: free hits drive pool_adapt_tick */
+	unsigned int prefetch;  /* POOL_F_PREFETCH: warm the next magazine block */
+	uint64_t gen;           /* Unique generation, never reused */
+} pool_head_t;
+
+/* This thread's slot table, indexed by pool ID */
+extern _Thread_local pool_tls_slot_t pool_tls_slots[MEMPOOL_MAX_POOLS];
+
 /**
  * Create a memory pool with thread-local optimization.
  *
@@ -15,15 +134,162 @@ typedef struct mempool mempool_t;
  */
 mempool_t *pool_create(size_t block_size, size_t blocks_per_thread, size_t total_blocks);
 
+/**
+ * Create a memory pool from an extended configuration.
+ *
+ * Blocks are aligned to cfg->align (16 bytes by default); cache-line
+ * alignment is opt-in via MEMPOOL_ALIGN_CACHE_LINE.
+ *
+ * With SLAB_F_GROW in cfg->slab_flags the global slab starts at
+ * total_blocks (which may be 0) and grows chunk_blocks at a time on demand,
+ * up to max_blocks.
+ *
+ * With POOL_F_BATCH, a thread cache miss refills half a magazine from the
+ * global slab in one reservation, and an overflow flushes the older half
+ * of the magazine back, keeping the recently freed (cache-hot) blocks, so
+ * global traffic drops by roughly blocks_per_thread / 2.
+ *
+ * With POOL_F_NUMA the pool keeps one global slab per NUMA node, each
+ * holding total_blocks / nodes blocks (and max_blocks / nodes when
+ * growable) bound to its node with mbind. A thread refills its magazine
+ * from the slab of the node it is running on and steals from other nodes
+ * only when that slab is exhausted; blocks always go back to the node
+ * slab they came from.
+ *
+ * With POOL_F_REMOTE_FREE the global slab hands out spans of span_blocks
+ * blocks, and each thread cache owns the spans it carves blocks from. A
+ * free from the owning thread stays in its cache; a free from any other
+ * thread is pushed onto the owner's lock-free remote-free list, which the
+ * owner drains in one exchange on its next miss. Blocks never go back to
+ * the global slab, so producer/consumer flows recycle memory between the
+ * two threads only. A cache whose thread exits is parked with its spans
+ * and adopted by the next thread that uses the pool. Cannot be combined
+ * with POOL_F_NUMA; total_blocks, chunk_blocks and max_blocks are rounded
+ * up to whole spans.
+ *
+ * With POOL_F_ADAPTIVE each magazine starts at blocks_per_thread and sizes
+ * itself to its thread. Every POOL_ADAPT_INTERVAL cache hits (a tick) the
+ * owner returns three quarters of the blocks that sat unused in the
+ * magazine for the whole interval, and halves the capacity if the magazine
+ * needed no refill or flush and is left at most half full. A thread that
+ * refills or flushes twice within one tick doubles its magazine instead,
+ * up to max_blocks_per_thread, while the capacity of all magazines
+ * together stays within cache_limit; refill and flush batches
+ * (POOL_F_BATCH) scale with the magazine. Every cache keeps at least
+ * blocks_per_thread. A thread that stops using the pool is trimmed when it
+ * next uses it, or gives everything back when it exits. Cannot be combined
+ * with POOL_F_REMOTE_FREE.
+ *
+ * ctor and dtor turn the pool into a cache of constructed objects: the
+ * global slab constructs a block the first time it hands it out, thread
+ * caches pass blocks around untouched, and pool_destroy runs dtor on every
+ * block that was constructed. Objects must be freed in their constructed
+ * state. Not available with POOL_F_REMOTE_FREE, whose free lists live in
+ * the blocks, or with SLAB_F_FAST; typed_pool.h wraps this in type-safe
+ * inline functions.
+ *
+ * POOL_F_REGISTER enters the chunks of the pool's slabs in the global page
+ * map with the pool as owner, so mempool_free_any can free any of its
+ * blocks, whichever pool a caller holds.
+ *
+ * POOL_F_PREFETCH makes every allocation issue a write prefetch for the
+ * block behind it in the magazine, so the next allocation's first write
+ * to it does not stall on a miss. The global slab prefetches likewise
+ * (SLAB_F_PREFETCH). It pays off when freed blocks go cold before they
+ * are reused, e.g. streaming through a large working set; for hot LIFO
+ * reuse it is one wasted instruction per allocation.
+ *
+ * @param cfg Pool configuration
+ * @return Pointer to memory pool, or NULL on error
+ */
+mempool_t *pool_create_ex(const pool_config_t *cfg);
+
 /**
  * Allocate a block from the pool.
  * Uses thread-local cache first, steals from global pool if needed.
  *
  * @param pool Pointer to memory pool
- * @return Pointer to allocated block (cache-line aligned), or NULL
+ * @return Pointer to allocated block (aligned to the pool alignment), or NULL
  */
 void *pool_alloc(mempool_t *pool);
 
+/**
+ * Slow paths of pool_alloc_fast/pool_free_fast: create the thread cache,
+ * refill or flush the magazine, route remote frees. Not for direct use.
+ */
+void *pool_alloc_slow(mempool_t *pool);
+int pool_free_slow(mempool_t *pool, void *ptr);
+void pool_adapt_tick(mempool_t *pool);
+
+/**
+ * Allocate a block, inlining the thread-cache hit.
+ * Same semantics as pool_alloc, but pool must be a valid pool.
+ *
+ * @param pool Pointer to memory pool
+ * @return Pointer to allocated block, or NULL
+ */
+static inline void *pool_alloc_fast(mempool_t *pool)
+{
+	const pool_head_t *head = (const pool_head_t *)pool;
+	pool_tls_slot_t *slot = &pool_tls_slots[head->id];
+	LATENCY_START(t0);
+
+	if (slot->gen == head->gen && slot->magazine->count) {
+		pool_magazine_t *mag = slot->magazine;
+		void *ptr = mag->blocks[--mag->count];
+
+		/* Never true unless POOL_F_ADAPTIVE, whose caches track idle blocks */
+		if (mag->count < mag->low_water)
+			mag->low_water = mag->count;
+		if (head->prefetch && mag->count)
+			PREFETCH_WRITE(mag->blocks[mag->count - 1]);
+		POOL_STAT_INC(mag->alloc_hits);
+		LATENCY_END(LAT_EV_POOL_ALLOC_FAST, t0);
+		return ptr;
+	}
+
+	void *ptr = pool_alloc_slow(pool);
+	/* A refill leaves the next block in the magazine */
+	if (head->prefetch && slot->gen == head->gen && slot->magazine->count)
+		PREFETCH_WRITE(slot->magazine->blocks[slot->magazine->count - 1]);
+	LATENCY_END(LAT_EV_POOL_ALLOC_SLOW, t0);
+	return ptr;
+}
+
+/**
+ * Free a block, inlining the push onto a non-full thread cache.
+ * Same semantics as pool_free, but pool must be a valid pool.
+ *
+ * @param pool Pointer to memory pool
+ * @param ptr  Pointer to block to free
+ * @return 0 on success, -1 on error
+ */
+static inline int pool_free_fast(mempool_t *pool, void *ptr)
+{
+	const pool_head_t *head = (const pool_head_t *)pool;
+	pool_tls_slot_t *slot = &pool_tls_slots[head->id];
+	LATENCY_START(t0);
+
+	if (head->free_fast && ptr && slot->gen == head->gen &&
+	    slot->magazine->count < slot->magazine->size) {
+		pool_magazine_t *mag = slot->magazine;
+		size_t hits = atomic_load_explicit(&mag->free_hits, memory_order_relaxed) + 1;
+
+		atomic_store_explicit(&mag->free_hits, hits, memory_order_relaxed);
+		mag->blocks[mag->count++] = ptr;
+		if (mag->count > atomic_load_explicit(&mag->high_water, memory_order_relaxed))
+			atomic_store_explicit(&mag->high_water, mag->count, memory_order_relaxed);
+		if (head->adaptive && (hits & (POOL_ADAPT_INTERVAL - 1)) == 0)
+			pool_adapt_tick(pool);
+		LATENCY_END(LAT_EV_POOL_FREE_FAST, t0);
+		return 0;
+	}
+
+	int ret = pool_free_slow(pool, ptr);
+	LATENCY_END(LAT_EV_POOL_FREE_SLOW, t0);
+	return ret;
+}
+
 /**
  * Free a block back to the pool.
  * Returns to thread-local cache if space available, otherwise to global pool.
@@ -34,6 +300,125 @@ void *pool_alloc(mempool_t *pool);
  */
 int pool_free(mempool_t *pool, void *ptr);
 
+/**
+ * Free a block without naming its allocator.
+ * The owner is found in the global page map (pagemap.h): blocks of
+ * POOL_F_REGISTER pools go to their pool's thread cache as with
+ * pool_free, blocks of SLAB_F_REGISTER slabs outside any pool go back to
+ * their slab. The lookup is a few dependent loads, no locks.
+ *
+ * @param ptr Block from a registered pool or slab
+ * @return 0 on success, -1 if ptr is NULL or not in registered memory
+ */
+int mempool_free_any(void *ptr);
+
+/**
+ * Allocate exactly n blocks, or none.
+ * The thread cache is drained with one copy of pointers; the remainder
+ * comes from the global slab in as few reservations as its free list
+ * allows (or from magazine refills for NUMA and remote-free pools).
+ *
+ * @param pool Pointer to memory pool
+ * @param out  Array receiving n block pointers
+ * @param n    Number of blocks wanted
+ * @return 0 on success, -1 if n blocks are not available
+ */
+int pool_alloc_n(mempool_t *pool, void **out, size_t n);
+
+/**
+ * pool_alloc_n, then issue write prefetches for the first
+ * POOL_PREFETCH_LINES lines of every block, so that a batch is warming up
+ * while the caller works through it. Works on any pool.
+ *
+ * @param pool Pointer to memory pool
+ * @param out  Array receiving n block pointers
+ * @param n    Number of blocks wanted
+ * @return 0 on success, -1 if n blocks are not available
+ */
+int pool_alloc_prefetch_n(mempool_t *pool, void **out, size_t n);
+
+/**
+ * Free n blocks.
+ * As many as fit go to the thread cache with one copy of pointers; the
+ * rest go back to the global slab in one reservation.
+ *
+ * @param pool Pointer to memory pool
+ * @param ptrs Array of n block pointers to free
+ * @param n    Number of blocks
+ * @return 0 on success, -1 if any pointer was rejected (the rest are freed)
+ */
+int pool_free_n(mempool_t *pool, void **ptrs, size_t n);
+
+/*
+ * Deferred reclamation (epoch-based, after Fraser's EBR).
+ *
+ * Lock-free readers bracket every access to shared blocks with
+ * pool_enter/pool_exit; writers that unlink a block hand it to
+ * pool_retire instead of pool_free. A retired block is freed, in a batch
+ * through the thread cache, once every thread that was inside a critical
+ * section at retire time has left it: the pool epoch advances only when
+ * all active readers have seen the current one, so a block retired in
+ * epoch e is unreachable once the epoch reaches e + 2.
+ *
+ * Retired blocks wait in bags of the retiring thread; every
+ * POOL_EBR_BATCH retires the thread tries to advance the epoch and frees
+ * its bags that are old enough. A thread that exits hands its bags to the
+ * pool, and whichever thread advances the epoch next frees them. A reader
+ * stuck inside a critical section stalls reclamation (but nothing else).
+ */
+
+/* Retires between attempts to advance the epoch */
+#define POOL_EBR_BATCH 64
+
+/**
+ * Enter a read-side critical section. Blocks retired from now on are not
+ * freed until the matching pool_exit. Sections nest.
+ *
+ * @param pool Pointer to memory pool
+ * @return 0 on success, -1 on error (no thread cache)
+ */
+int pool_enter(mempool_t *pool);
+
+/**
+ * Leave a read-side critical section entered with pool_enter.
+ *
+ * @param pool Pointer to memory pool
+ */
+void pool_exit(mempool_t *pool);
+
+/**
+ * Free a block once no reader can still hold it.
+ * The caller must already have made the block unreachable; it may call
+ * this inside or outside a critical section.
+ *
+ * @param pool Pointer to memory pool
+ * @param ptr  Block to free
+ * @return 0 on success, -1 on error (the block is not retired)
+ */
+int pool_retire(mempool_t *pool, void *ptr);
+
+/**
+ * Try to advance the epoch, and free this thread's retired blocks (and
+ * those of exited threads) whose grace period has passed. Call it at a
+ * quiescent point to bound how long blocks wait, e.g. before pool_stats.
+ *
+ * @param pool Pointer to memory pool
+ * @return Number of this thread's retired blocks still waiting
+ */
+size_t pool_reclaim(mempool_t *pool);
+
+/**
+ * Give the free memory of the pool back to the OS. The calling thread's
+ * cached blocks are returned to the slab first, then every page of the
+ * node slabs that holds free blocks only is released (see slab_trim).
+ * Other threads' caches are left alone. Pools created with decay_ms do
+ * this in the background for pages that stay free that long.
+ *
+ * @param pool Pointer to memory pool
+ * @return Bytes released
+ */
+size_t pool_trim(mempool_t *pool);
+
 /**
  * Destroy the memory pool and free all resources.
  *
@@ -43,6 +428,8 @@ void pool_destroy(mempool_t *pool);
 
 /**
  * Get statistics from the memory pool.
+ * POOL_F_REMOTE_FREE pools count whole spans: every block of a span owned
+ * by a thread cache counts as allocated.
  *
  * @param pool       Pointer to memory pool
  * @param allocated  Out parameter for number of allocated blocks
@@ -51,4 +438,27 @@ void pool_destroy(mempool_t *pool);
  */
 int pool_stats(mempool_t *pool, size_t *allocated, size_t *free_count);
 
+/**
+ * Get pool statistics including per-thread cache counters.
+ * The counters live in each thread's cache and cost nothing shared on the
+ * fast path; this call sums them (plus the totals of exited threads)
+ * under the registry lock, so it is meant for occasional sampling.
+ * Cache hit rate is alloc_hits / (alloc_hits + misses).
+ *
+ * @param pool  Pointer to memory pool
+ * @param stats Out parameter for the statistics
+ * @return 0 on success, -1 on error
+ */
+int pool_stats_ex(mempool_t *pool, pool_stats_ex_t *stats);
+
+/**
+ * Get cross-node traffic counters of a POOL_F_NUMA pool.
+ * Non-NUMA pools report one node and zero counters.
+ *
+ * @param pool  Pointer to memory pool
+ * @param stats Out parameter for the counters
+ * @return 0 on success, -1 on error
+ */
+int pool_numa_stats(mempool_t *pool, pool_numa_stats_t *stats);
+
 #endif /* MEMPOOL_H */
@@ -0,0 +1,103 @@
+#ifndef MEMPOOL_PAGEMAP_H
+#define MEMPOOL_PAGEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Global pointer-to-owner registry.
+ *
+ * A three-level radix tree over the 48-bit address space maps each
+ * PAGEMAP_GRANULE of registered memory to the slab and chunk that hold it,
+ * plus an optional owner (the pool carving that slab). Lookups are three
+ * dependent loads with no locks; interior nodes are installed with a CAS
+ * and never freed, so a reader can never see one go away. Registered
+ * ranges must be granule-aligned so that no granule has two owners;
+ * SLAB_F_REGISTER slabs align their chunks accordingly.
+ */
+
+struct slab_allocator;
+
+#define PAGEMAP_SHIFT   12
+#define PAGEMAP_GRANULE ((size_t)1 << PAGEMAP_SHIFT)
+
+/* Radix levels: 12 bits each over address bits 12..47 */
+#define PAGEMAP_LEVEL_BITS 12
+#define PAGEMAP_FANOUT     (1u << PAGEMAP_LEVEL_BITS)
+#define PAGEMAP_ADDR_BITS  48
+
+/* What one granule belongs to; slab is NULL while unregistered */
+typedef struct {
+	_Atomic(struct slab_allocator *) slab; /* Slab whose chunk holds the granule */
+	_Atomic(void *) owner;                 /* Registered owner, e.g. the mempool_t */
+	_Atomic(uint32_t) chunk;               /* Chunk index within the slab */
+} pagemap_entry_t;
+
+typedef struct {
+	pagemap_entry_t entries[PAGEMAP_FANOUT];
+} pagemap_leaf_t;
+
+typedef struct {
+	_Atomic(pagemap_leaf_t *) leaves[PAGEMAP_FANOUT];
+} pagemap_node_t;
+
+/* Top level, indexed by address bits 36..47 */
+extern _Atomic(pagemap_node_t *) pagemap_root[PAGEMAP_FANOUT];
+
+/**
+ * Find the registry entry of the granule containing ptr.
+ * Any address inside a registered range resolves, not just block starts.
+ *
+ * @param ptr Address to look up
+ * @return Entry of a registered granule, or NULL
+ */
+static inline const pagemap_entry_t *pagemap_lookup(const void *ptr)
+{
+	uintptr_t key = (uintptr_t)ptr >> PAGEMAP_SHIFT;
+
+	if (key >> (PAGEMAP_ADDR_BITS - PAGEMAP_SHIFT))
+		return NULL;
+
+	pagemap_node_t *node = atomic_load_explicit(
+		&pagemap_root[key >> (2 * PAGEMAP_LEVEL_BITS)], memory_order_acquire);
+	if (!node)
+		return NULL;
+
+	pagemap_leaf_t *leaf = atomic_load_explicit(
+		&node->leaves[(key >> PAGEMAP_LEVEL_BITS) & (PAGEMAP_FANOUT - 1)],
+		memory_order_acquire);
+	if (!leaf)
+		return NULL;
+
+	const pagemap_entry_t *e = &leaf->entries[key & (PAGEMAP_FANOUT - 1)];
+	if (!atomic_load_explicit(&e->slab, memory_order_acquire))
+		return NULL;
+	return e;
+}
+
+/**
+ * Register [base, base + size) as chunk of slab, owned by owner.
+ * Fails without side effects if any granule is already registered.
+ *
+ * @param base  Start of the range, PAGEMAP_GRANULE-aligned
+ * @param size  Length in bytes, a multiple of PAGEMAP_GRANULE
+ * @param slab  Slab holding the range
+ * @param owner Owner pointer stored in the entries (may be NULL)
+ * @param chunk Chunk index stored in the entries
+ * @return 0 on success, -1 on error
+ */
+int pagemap_register(const void *base, size_t size, struct slab_allocator *slab,
+		     void *owner, uint32_t chunk);
+
+/**
+ * Remove the granules of [base, base + size) that are registered to slab.
+ * Call before the memory is released; lookups of the range then fail.
+ *
+ * @param base Start of the range
+ * @param size Length in bytes
+ * @param slab Slab the range was registered to
+ */
+void pagemap_unregister(const void *base, size_t size, struct slab_allocator *slab);
+
+#endif /* MEMPOOL_PAGEMAP_H */
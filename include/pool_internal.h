@@ -2,22 +2,98 @@
 #define MEMPOOL_POOL_INTERNAL_H
 
 #include "slab.h"
+#include "mempool.h"
+#include "topology.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdatomic.h>
 
-/* Thread-local data structure for each thread */
-typedef struct {
-	void **local_cache;      /* Thread-local free list cache */
-	size_t cache_size;       /* Max capacity of cache */
-	_Atomic(size_t) cache_count; /* Current items in cache */
+struct mempool;
+
+/* Blocks retired in one epoch, waiting for its grace period (pool_retire) */
+typedef struct pool_ebr_bag {
+	void **ptrs;               /* Retired blocks */
+	size_t count;              /* Blocks in the bag */
+	size_t cap;                /* Pointers ptrs has room for */
+	uint64_t epoch;            /* Global epoch the blocks were retired in */
+	struct pool_ebr_bag *next; /* Next orphaned bag (registry lock) */
+} pool_ebr_bag_t;
+
+/* Retirement bags per thread: epochs e, e-1 and e-2 are never all safe */
+#define POOL_EBR_BAGS 3
+
+/* Thread-local cache one thread holds for one pool */
+typedef struct thread_local_cache {
+	pool_magazine_t mag;     /* Cached free blocks; must stay first */
+	_Atomic(size_t) misses;  /* Owner-written counters, see POOL_STAT_INC */
+	_Atomic(size_t) refills;
+	_Atomic(size_t) flushes;
+	_Atomic(size_t) remote_frees;
+	_Atomic(size_t) grows;         /* POOL_F_ADAPTIVE counters */
+	_Atomic(size_t) shrinks;
+	_Atomic(size_t) idle_returned;
+	_Atomic(size_t) ebr_retired;   /* pool_retire counters */
+	_Atomic(size_t) ebr_reclaimed;
+	_Atomic(uint64_t) ebr_active;  /* (epoch << 1) | 1 inside pool_enter, else 0 */
+	unsigned int ebr_nest;   /* pool_enter nesting depth */
+	size_t ebr_since;        /* Retires since the last advance attempt */
+	pool_ebr_bag_t ebr_bags[POOL_EBR_BAGS]; /* Indexed by retire epoch % POOL_EBR_BAGS */
+	size_t blocks_cap;       /* Pointers mag.blocks has room for */
+	unsigned int slow_events;/* POOL_F_ADAPTIVE: refills and flushes this tick */
+	size_t tick_hits;        /* POOL_F_ADAPTIVE: cache hits at the last tick */
+	struct mempool *pool;    /* Owning pool */
+	unsigned int node;       /* POOL_F_NUMA: node of the last refill */
+	struct thread_local_cache *next; /* Next cache of the same pool */
+	int parked;              /* POOL_F_REMOTE_FREE: thread exited, awaiting adoption */
+	void *local_free;        /* POOL_F_REMOTE_FREE: owner-private list of free blocks */
+	uint8_t *carve;          /* POOL_F_REMOTE_FREE: next uncarved block of newest span */
+	uint8_t *carve_end;      /* POOL_F_REMOTE_FREE: end of newest span */
+	_Atomic(void *) remote_head CACHE_ALIGNED; /* MPSC list of blocks freed by other threads */
 } thread_local_cache_t;
 
+/* Header at the start of each POOL_F_REMOTE_FREE span */
+typedef struct {
+	thread_local_cache_t *owner; /* Cache that carved the span */
+	struct mempool *pool;        /* Owning pool */
+} pool_span_t;
+
+/* Free-list link threaded through a free block of a span */
+typedef struct pool_free_node {
+	struct pool_free_node *next;
+} pool_free_node_t;
+
 /* Main pool structure */
 typedef struct mempool {
+	pool_head_t head;              /* ID and generation; must stay first */
 	slab_allocator_t *global_slab; /* Shared global slab */
 	size_t block_size;             /* Size of each block */
-	size_t blocks_per_thread;      /* Max blocks per thread cache */
+	size_t blocks_per_thread;      /* Max blocks per thread cache (POOL_F_ADAPTIVE: min) */
+	size_t batch;                  /* Blocks per refill/flush (POOL_F_BATCH) */
+	unsigned int flags;            /* POOL_F_* */
 	_Atomic(int) initialized;      /* Initialization flag */
+	thread_local_cache_t *caches;  /* All thread caches (registry lock) */
+	pool_stats_ex_t retired;       /* Counters of released caches (registry lock) */
+	unsigned int num_nodes;        /* Node slabs (1 unless POOL_F_NUMA) */
+	slab_allocator_t *node_slabs[TOPO_MAX_NODES]; /* [0] is global_slab */
+	size_t span_bytes;             /* POOL_F_REMOTE_FREE: span size and alignment */
+	size_t span_header;            /* POOL_F_REMOTE_FREE: bytes before the first block */
+	size_t span_blocks;            /* POOL_F_REMOTE_FREE: blocks per span */
+	size_t max_blocks_per_thread;  /* POOL_F_ADAPTIVE: magazine capacity ceiling */
+	size_t cache_limit;            /* POOL_F_ADAPTIVE: capacity bound, 0 = none */
+	pool_ebr_bag_t *ebr_orphans;   /* Bags left by exited threads (registry lock) */
+	unsigned int decay_ms;         /* Decay thread interval, 0 = no decay */
+	uint64_t decay_next;           /* Decay thread: time of the next pass, ms (registry lock) */
+	int decaying;                  /* Decay thread: pass running unlocked (registry lock) */
+
+	/*
+	 * Written by every thread, away from the read-mostly fields above that
+	 * each fast-path call loads, and from each other.
+	 */
+	_Atomic(size_t) local_blocks CACHE_ALIGNED; /* Blocks refilled from the local node */
+	_Atomic(size_t) remote_blocks; /* Blocks stolen from a remote node */
+	_Atomic(size_t) remote_frees;  /* Blocks returned to a remote node */
+	_Atomic(size_t) cache_capacity CACHE_ALIGNED; /* POOL_F_ADAPTIVE: capacity of live caches */
+	_Atomic(uint64_t) epoch CACHE_ALIGNED; /* pool_retire: global reclamation epoch */
 } mempool_t;
 
 #endif /* MEMPOOL_POOL_INTERNAL_H */
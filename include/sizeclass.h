@@ -0,0 +1,80 @@
+#ifndef MEMPOOL_SIZECLASS_H
+#define MEMPOOL_SIZECLASS_H
+
+#include <stddef.h>
+
+typedef struct sizeclass_allocator sizeclass_allocator_t;
+
+/* Largest request the size-class table can serve from pools */
+#define SC_MAX_SIZE 32768
+
+/* Number of size classes: 16..128 step 16, then 4 classes per doubling */
+#define SC_NUM_CLASSES 40
+
+/* Configuration for sc_create; zero fields take the defaults */
+typedef struct {
+	size_t max_size;        /* Sizes above this go to malloc (default SC_MAX_SIZE) */
+	size_t bytes_per_class; /* Global slab budget per class (default 1 MB) */
+	size_t cache_bytes;     /* Per-thread cache budget per class (default 16 KB) */
+	unsigned int pool_flags;/* POOL_F_* for every class pool (default POOL_F_BATCH) */
+	unsigned int slab_flags;/* SLAB_F_* for every class slab */
+	unsigned int decay_ms;  /* Background page release of every class pool (pool_config_t) */
+} sc_config_t;
+
+/**
+ * Create a size-class allocator.
+ * Owns one thread-cached pool per size class, spaced jemalloc-style
+ * (16-byte steps up to 128, then four classes per power of two).
+ *
+ * @param cfg Configuration, or NULL for defaults
+ * @return Pointer to size-class allocator, or NULL on error
+ */
+sizeclass_allocator_t *sc_create(const sc_config_t *cfg);
+
+/**
+ * Allocate size bytes.
+ * Sizes up to max_size are served from the matching class pool via a
+ * table lookup; larger sizes, or an exhausted class, fall back to malloc.
+ *
+ * @param sc   Pointer to size-class allocator
+ * @param size Number of bytes to allocate
+ * @return Pointer to allocated memory, or NULL on error
+ */
+void *sc_alloc(sizeclass_allocator_t *sc, size_t size);
+
+/**
+ * Free memory returned by sc_alloc.
+ * The owning class is found from the pointer itself.
+ *
+ * @param sc  Pointer to size-class allocator
+ * @param ptr Pointer to free (NULL is ignored)
+ * @return 0 on success, -1 on error
+ */
+int sc_free(sizeclass_allocator_t *sc, void *ptr);
+
+/**
+ * Get the block size of the class that serves size.
+ *
+ * @param size Requested size
+ * @return Class size in bytes, or 0 if size is above SC_MAX_SIZE
+ */
+size_t sc_class_size(size_t size);
+
+/**
+ * Release the free pages of every class pool (see pool_trim).
+ *
+ * @param sc Pointer to size-class allocator
+ * @return Bytes released
+ */
+size_t sc_trim(sizeclass_allocator_t *sc);
+
+/**
+ * Destroy the size-class allocator and all of its pools.
+ * Memory that fell back to malloc is not tracked and must be freed
+ * with sc_free before this call.
+ *
+ * @param sc Pointer to size-class allocator
+ */
+void sc_destroy(sizeclass_allocator_t *sc);
+
+#endif /* MEMPOOL_SIZECLASS_H */
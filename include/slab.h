@@ -3,9 +3,56 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "align.h"
+#include "backing.h"
 
 typedef struct slab_allocator slab_allocator_t;
 
+/*
+ * Compact block reference: the block index in the low bits and the
+ * block's generation in the rest. The index takes just enough bits for the
+ * slab's index space (ceil(log2(max_blocks)), per whole chunks); every
+ * free bumps the generation, so a handle kept past its block's free is
+ * rejected until the generation wraps. Never equal to SLAB_HANDLE_NULL.
+ */
+typedef uint32_t slab_handle_t;
+
+#define SLAB_HANDLE_NULL ((slab_handle_t)0)
+
+/* Slab creation flags */
+#define SLAB_F_FAST     (1u << 0) /* Free list threaded through free blocks, no metadata arrays */
+#define SLAB_F_VALIDATE (1u << 1) /* Fast mode: track block state in a bitmap to catch bad frees */
+#define SLAB_F_GROW     (1u << 2) /* Add chunks on demand instead of failing when empty */
+#define SLAB_F_REGISTER (1u << 3) /* Enter chunks in the global page map (see pagemap.h) */
+#define SLAB_F_COLOR    (1u << 4) /* Start each chunk a rotating number of cache lines in */
+#define SLAB_F_SPREAD   (1u << 5) /* Chain fresh blocks so that list neighbours share no line */
+#define SLAB_F_PREFETCH (1u << 6) /* Prefetch the new free-list head's block after each pop */
+
+/* Extended slab configuration for slab_create_ex */
+typedef struct {
+	size_t block_size;  /* Size of each block */
+	size_t num_blocks;  /* Number of blocks to pre-allocate (may be 0 with SLAB_F_GROW) */
+	size_t align;       /* Block alignment: MEMPOOL_ALIGN_* or a power of two >= 8 */
+	unsigned int flags; /* SLAB_F_* */
+	size_t chunk_blocks;/* SLAB_F_GROW: blocks added per chunk, rounded to a power of two */
+	size_t max_blocks;  /* SLAB_F_GROW: hard cap on total blocks (0 = no cap) */
+	const mempool_backing_t *backing; /* Chunk memory provider (NULL = heap) */
+	void (*ctor)(void *obj, void *arg); /* Run on a block the first time it is handed out */
+	void (*dtor)(void *obj, void *arg); /* Run on every constructed block at slab_destroy */
+	void *obj_arg;      /* Second argument to ctor and dtor */
+	void *owner;        /* SLAB_F_REGISTER: owner recorded for the chunks (e.g. a pool) */
+	size_t spread;      /* SLAB_F_SPREAD: distance, MEMPOOL_ALIGN_* or a power of two (0 = line) */
+} slab_config_t;
+
+/* Slab statistics including contention counters, see slab_stats_ex */
+typedef struct {
+	size_t used;            /* Allocated blocks */
+	size_t free;            /* Free blocks */
+	uint64_t cas_retries;   /* Free-list CASes that lost a race and retried */
+	uint64_t backoff_spins; /* Pause instructions spun backing off after them */
+	size_t purged;          /* Free blocks on pages released by slab_trim/slab_decay */
+} slab_stats_ex_t;
+
 /**
  * Create a slab allocator with pre-allocated blocks.
  *
@@ -15,12 +62,73 @@ typedef struct slab_allocator slab_allocator_t;
  */
 slab_allocator_t *slab_create(size_t block_size, size_t num_blocks);
 
+/**
+ * Create a slab allocator from an extended configuration.
+ *
+ * Blocks are rounded up to cfg->align only (16 bytes by default), so small
+ * objects pack densely; pass MEMPOOL_ALIGN_CACHE_LINE for blocks that
+ * must not share a line with their neighbours.
+ *
+ * SLAB_F_FAST drops the per-block metadata and link arrays: the free list
+ * is threaded through the first word of each free block, so a hot alloc or
+ * free touches only the list head and the block itself. Bounds and
+ * alignment of freed pointers are still checked; double-free detection
+ * needs SLAB_F_VALIDATE, which keeps one state bit per block.
+ *
+ * SLAB_F_GROW makes the slab start with num_blocks (rounded up to whole
+ * chunks) and add chunk_blocks at a time when the free list runs dry, up to
+ * max_blocks. Growth takes a brief lock on the empty-list slow path only;
+ * the alloc/free fast path stays lock-free.
+ *
+ * Chunk memory comes from cfg->backing (see backing.h), e.g. an mmap
+ * provider with huge pages. A growable slab with max_blocks set reserves
+ * its whole address range when the provider supports it, and commits each
+ * chunk as it is added.
+ *
+ * cfg->ctor and cfg->dtor make the slab an object cache in the style of
+ * kmem_cache: ctor runs on a block the first time an allocation hands it
+ * out, and a freed block keeps its contents, so a recycled block comes
+ * back still constructed and callers must free objects in that state. At
+ * slab_destroy, dtor runs on every block that was ever constructed. The
+ * free-list link of SLAB_F_FAST would clobber a constructed object, so
+ * the two cannot be combined.
+ *
+ * SLAB_F_COLOR counters conflict misses: blocks of a power-of-two size
+ * sit at the same offsets within every page, so the same field of many
+ * blocks maps to a handful of cache sets. Each new chunk starts a
+ * rotating multiple of CACHE_LINE_SIZE (or of the alignment, if larger)
+ * past its base, cycling through one block's or one page's worth of
+ * offsets; the chunk costs that much extra memory.
+ *
+ * SLAB_F_SPREAD chains every fresh chunk so that consecutive free-list
+ * entries are at least cfg->spread bytes apart (a cache line by default,
+ * MEMPOOL_ALIGN_PAGE for pages). Back-to-back allocations, which on a
+ * shared slab usually go to different threads, then never false-share,
+ * at the cost of spatial locality for a single thread. Blocks freed later
+ * are reused in LIFO order like on any slab.
+ *
+ * SLAB_F_PREFETCH issues a write prefetch for the block that becomes the
+ * head of the free list whenever blocks are popped, so the next
+ * allocation (and, in fast mode, its link load) finds it in cache. The
+ * prefetch may hit a block another thread takes first; it never faults.
+ *
+ * SLAB_F_REGISTER enters every chunk in the global page map, so any
+ * pointer into the slab resolves to it (and to cfg->owner) with a few
+ * loads; see pagemap_lookup and mempool_free_any. Frees then find their
+ * chunk through the map instead of scanning the chunk table. Chunks are
+ * aligned and padded to PAGEMAP_GRANULE so that no granule is shared.
+ *
+ * @param cfg Slab configuration
+ * @return Pointer to slab allocator, or NULL on error
+ */
+slab_allocator_t *slab_create_ex(const slab_config_t *cfg);
+
 /**
  * Allocate a single block from the slab.
  * Returns NULL if all blocks are exhausted or allocator is invalid.
  *
  * @param alloc Pointer to slab allocator
- * @return Pointer to allocated block (cache-line aligned), or NULL
+ * @return Pointer to allocated block (aligned to the slab alignment), or NULL
  */
 void *slab_alloc(slab_allocator_t *alloc);
 
@@ -34,6 +142,141 @@ void *slab_alloc(slab_allocator_t *alloc);
  */
 int slab_free(slab_allocator_t *alloc, void *ptr);
 
+/**
+ * Allocate up to n blocks with a single free-list reservation.
+ * Cheaper than n calls to slab_alloc when refilling a cache.
+ *
+ * @param alloc Pointer to slab allocator
+ * @param out   Array receiving at least n block pointers
+ * @param n     Number of blocks wanted
+ * @return Number of blocks stored in out (0 if exhausted)
+ */
+size_t slab_alloc_batch(slab_allocator_t *alloc, void **out, size_t n);
+
+/**
+ * Free n blocks back to the slab, pushing them with one reservation
+ * per batch instead of one CAS per block.
+ * Invalid or already-freed pointers are skipped; the rest are freed.
+ *
+ * @param alloc Pointer to slab allocator
+ * @param ptrs  Array of n block pointers to free
+ * @param n     Number of blocks
+ * @return 0 on success, -1 if any pointer was rejected
+ */
+int slab_free_batch(slab_allocator_t *alloc, void **ptrs, size_t n);
+
+/**
+ * Allocate exactly n blocks, or none.
+ * Takes blocks in as few free-list reservations as the list allows; if
+ * fewer than n blocks can be had, the ones taken are returned. Free them
+ * with slab_free_batch.
+ *
+ * @param alloc Pointer to slab allocator
+ * @param out   Array receiving n block pointers
+ * @param n     Number of blocks wanted
+ * @return 0 on success, -1 if n blocks are not available
+ */
+int slab_alloc_n(slab_allocator_t *alloc, void **out, size_t n);
+
+/**
+ * Get the address range backing a fixed-size slab's blocks.
+ * Any block returned by slab_alloc lies in [base, base + size).
+ * Growable slabs are not contiguous and return -1.
+ *
+ * @param alloc Pointer to slab allocator
+ * @param base  Out parameter for the start of block memory
+ * @param size  Out parameter for the length of block memory in bytes
+ * @return 0 on success, -1 on error
+ */
+int slab_region(slab_allocator_t *alloc, void **base, size_t *size);
+
+/**
+ * Check whether ptr is a block of this slab.
+ * Does not look at the block's allocation state.
+ *
+ * @param alloc Pointer to slab allocator
+ * @param ptr   Pointer to check
+ * @return Non-zero if ptr is a block boundary inside the slab
+ */
+int slab_owns(slab_allocator_t *alloc, void *ptr);
+
+/**
+ * Allocate a block and return a handle to it instead of a pointer.
+ * Needs the per-block metadata: fast-mode slabs, and slabs whose index
+ * space takes all 32 bits, have no room for a generation and always fail.
+ * The block can also be freed with slab_free.
+ *
+ * @param alloc Pointer to slab allocator
+ * @return Handle of the allocated block, or SLAB_HANDLE_NULL
+ */
+slab_handle_t slab_alloc_handle(slab_allocator_t *alloc);
+
+/**
+ * Map a handle to its block.
+ * One load of the block's generation decides: a handle whose block has
+ * been freed since gives NULL, as does one outside the slab. Racing a free of the same
+ * block is the caller's bug, as with any use after free.
+ *
+ * @param alloc  Pointer to slab allocator
+ * @param handle Handle from slab_alloc_handle
+ * @return Pointer to the block, or NULL if the handle is stale or invalid
+ */
+void *slab_deref(slab_allocator_t *alloc, slab_handle_t handle);
+
+/**
+ * Free the block a handle refers to.
+ * The generation is advanced with a CAS, so of two frees through the same
+ * handle only one succeeds.
+ *
+ * @param alloc  Pointer to slab allocator
+ * @param handle Handle from slab_alloc_handle
+ * @return 0 on success, -1 if the handle is stale or invalid
+ */
+int slab_free_handle(slab_allocator_t *alloc, slab_handle_t handle);
+
+/**
+ * Give the memory of free pages back to the OS.
+ * Takes the whole free list, releases every page on which all blocks are
+ * free through the backing provider's purge (madvise(MADV_DONTNEED) for
+ * the built-in ones), and puts the other blocks back. Blocks on released
+ * pages are set aside and return to the free list, a batch at a time,
+ * only once it runs dry, so live data packs into the pages still
+ * resident. Constructed blocks (ctor) are kept. Meanwhile concurrent
+ * allocations that find the free list empty wait for the trim instead of
+ * failing.
+ *
+ * @param alloc Pointer to slab allocator
+ * @return Bytes released
+ */
+size_t slab_trim(slab_allocator_t *alloc);
+
+/**
+ * Decay pass: like slab_trim, but release only pages whose blocks were
+ * all free at the previous slab_decay call as well, so memory is given
+ * back once it has sat idle for a whole interval between calls.
+ *
+ * @param alloc Pointer to slab allocator
+ * @return Bytes released
+ */
+size_t slab_decay(slab_allocator_t *alloc);
+
+/**
+ * Hold the slab's internal lock across fork().
+ * The lock only serializes chunk creation; a pthread_atfork prepare
+ * handler takes it so that the child cannot inherit it locked by a thread
+ * that was not forked. Pools do this for their slabs automatically.
+ *
+ * @param alloc Pointer to slab allocator
+ */
+void slab_fork_lock(slab_allocator_t *alloc);
+
+/**
+ * Release the lock taken by slab_fork_lock, in the parent and the child.
+ *
+ * @param alloc Pointer to slab allocator
+ */
+void slab_fork_unlock(slab_allocator_t *alloc);
+
 /**
  * Destroy the slab allocator and free all resources.
  *
@@ -51,4 +294,15 @@ void slab_destroy(slab_allocator_t *alloc);
  */
 int slab_stats(slab_allocator_t *alloc, size_t *used_blocks, size_t *free_blocks);
 
+/**
+ * Get usage and contention statistics from the slab allocator.
+ * A retry rate that climbs with thread count means the shared free list
+ * is the bottleneck: give pools bigger magazines or POOL_F_BATCH.
+ *
+ * @param alloc Pointer to slab allocator
+ * @param stats Out parameter for the statistics
+ * @return 0 on success, -1 on error
+ */
+int slab_stats_ex(slab_allocator_t *alloc, slab_stats_ex_t *stats);
+
 #endif /* MEMPOOL_SLAB_H */
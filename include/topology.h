@@ -0,0 +1,45 @@
+#ifndef MEMPOOL_TOPOLOGY_H
+#define MEMPOOL_TOPOLOGY_H
+
+#include <stddef.h>
+
+/* Largest NUMA node count tracked */
+#ifndef TOPO_MAX_NODES
+  #define TOPO_MAX_NODES 64
+#endif
+
+/* Largest CPU number mapped to a node */
+#ifndef TOPO_MAX_CPUS
+  #define TOPO_MAX_CPUS 4096
+#endif
+
+/**
+ * Get the number of NUMA nodes on this machine.
+ * Read once from /sys/devices/system/node; 1 when the information is
+ * missing (non-NUMA kernels, containers without sysfs).
+ *
+ * @return Number of nodes, at least 1
+ */
+unsigned int topo_node_count(void);
+
+/**
+ * Get the NUMA node of the CPU the calling thread is running on.
+ * Uses sched_getcpu (vDSO) and a CPU-to-node table, so it is cheap enough
+ * for slow paths but should not be called on every allocation.
+ *
+ * @return Node number, or 0 if unknown
+ */
+unsigned int topo_current_node(void);
+
+/**
+ * Bind a page-aligned range to a NUMA node with mbind(MPOL_BIND).
+ * Must be called before the range is first touched to take effect.
+ *
+ * @param ptr  Start of the range (page-aligned)
+ * @param len  Length of the range in bytes
+ * @param node Node to bind to
+ * @return 0 on success, -1 if the kernel rejected the policy
+ */
+int topo_bind(void *ptr, size_t len, unsigned int node);
+
+#endif /* MEMPOOL_TOPOLOGY_H */
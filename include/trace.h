@@ -0,0 +1,118 @@
+#ifndef MEMPOOL_TRACE_H
+#define MEMPOOL_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Allocation trace recording.
+ *
+ * A trace is a trace_header_t followed by fixed-size trace_record_t
+ * entries, one per allocation or free, in host byte order. Each thread
+ * appends to a private buffer and writes it out in large chunks, so the
+ * file is ordered per thread but chunks of different threads interleave;
+ * readers sort by time (trace_load does). Timestamps come from the
+ * monotonic clock relative to trace_open, which keeps an allocation on one
+ * thread ordered before its free on another.
+ *
+ * bench/trace_shim.c interposes malloc and friends on top of this API to
+ * record unmodified programs under LD_PRELOAD; bench/bench_replay.c plays
+ * traces back against the pool, slab, arena and system allocators.
+ */
+
+#define TRACE_MAGIC   "MPTRACE1"
+#define TRACE_VERSION 1
+
+/* Record operations */
+#define TRACE_ALLOC 1
+#define TRACE_FREE  2
+
+/* Thread indices wrap at this many recording threads */
+#define TRACE_MAX_THREADS 4096
+
+/* File header */
+typedef struct {
+	char magic[8];        /* TRACE_MAGIC, not NUL-terminated */
+	uint32_t version;     /* TRACE_VERSION */
+	uint32_t record_size; /* sizeof(trace_record_t) */
+} trace_header_t;
+
+/*
+ * One event. stamp packs the time in nanoseconds since trace_open (upper
+ * 48 bits, about 78 hours), the recording thread's index (12 bits) and the
+ * operation (4 bits); use the accessors below.
+ */
+typedef struct {
+	uint64_t stamp;
+	uint64_t addr; /* Block address, which pairs a free with its allocation */
+	uint64_t size; /* Requested bytes; 0 for frees */
+} trace_record_t;
+
+static inline uint64_t trace_time_ns(const trace_record_t *r)
+{
+	return r->stamp >> 16;
+}
+
+static inline unsigned int trace_thread(const trace_record_t *r)
+{
+	return (unsigned int)(r->stamp >> 4) & (TRACE_MAX_THREADS - 1);
+}
+
+static inline unsigned int trace_op(const trace_record_t *r)
+{
+	return (unsigned int)r->stamp & 0xF;
+}
+
+/**
+ * Start recording to a file, truncating it.
+ * Buffers are mmap'd and the file is written with write(2), so the
+ * recorder never calls malloc and is safe to drive from a malloc shim.
+ *
+ * @param path Output file
+ * @return 0 on success, -1 on error or if a trace is already open
+ */
+int trace_open(const char *path);
+
+/**
+ * Record an allocation. Call after the allocation succeeded.
+ * A no-op when no trace is open.
+ *
+ * @param ptr  Allocated block
+ * @param size Requested size in bytes
+ */
+void trace_alloc(const void *ptr, size_t size);
+
+/**
+ * Record a free. Call before the block is actually released, so another
+ * thread reusing the address cannot be stamped ahead of this free.
+ * A no-op when no trace is open or ptr is NULL.
+ *
+ * @param ptr Block being freed
+ */
+void trace_free(const void *ptr);
+
+/**
+ * Write out the calling thread's buffered records.
+ * Threads flush on their own when the buffer fills and when they exit.
+ */
+void trace_flush(void);
+
+/**
+ * Flush every thread's buffer and close the trace.
+ * Other threads must not be recording concurrently; call it once the
+ * workload has quiesced, or at exit.
+ *
+ * @return 0 on success, -1 if no trace was open or a write failed
+ */
+int trace_close(void);
+
+/**
+ * Read a whole trace into memory, sorted by time.
+ *
+ * @param path  Trace file
+ * @param count Set to the number of records
+ * @return malloc'd record array (free with free), or NULL on error
+ */
+trace_record_t *trace_load(const char *path, size_t *count);
+
+#endif /* MEMPOOL_TRACE_H */
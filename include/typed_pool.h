@@ -0,0 +1,113 @@
+#ifndef MEMPOOL_TYPED_POOL_H
+#define MEMPOOL_TYPED_POOL_H
+
+#include <stddef.h>
+#include "mempool.h"
+
+/*
+ * Typed object pools.
+ *
+ * MEMPOOL_DEFINE_TYPED(name, T, init, fini) generates a pool of T objects
+ * with constructor caching, after the kmem_cache constructors of Solaris
+ * and Linux. init is a void (*)(T *) run once per block, when the global
+ * slab first hands the block out; freed objects keep their state through
+ * the thread caches and the slab, so name_alloc returns a recycled object
+ * already constructed. Callers must therefore free objects in their
+ * constructed state (locks unlocked, lists empty, ...). fini, also a
+ * void (*)(T *), runs on every constructed block when the pool is
+ * destroyed. Either may be NULL.
+ *
+ * The macro expands to:
+ *
+ *   name_pool_t                                  opaque pool type
+ *   name_pool_t *name_pool_create(size_t blocks_per_thread, size_t total_blocks)
+ *   name_pool_t *name_pool_create_ex(const pool_config_t *cfg)
+ *   T *name_alloc(name_pool_t *pool)
+ *   int name_free(name_pool_t *pool, T *obj)
+ *   mempool_t *name_pool_raw(name_pool_t *pool)   for pool_stats and friends
+ *   void name_pool_destroy(name_pool_t *pool)
+ *
+ * name_alloc and name_free are the inlined pool fast paths; the pool type
+ * is distinct per instantiation, so handing a widget to a gadget pool is a
+ * compile error. Use the macro at file scope:
+ *
+ *   static void widget_init(widget_t *w) { pthread_mutex_init(&w->lock, NULL); }
+ *   static void widget_fini(widget_t *w) { pthread_mutex_destroy(&w->lock); }
+ *   MEMPOOL_DEFINE_TYPED(widget, widget_t, widget_init, widget_fini)
+ *
+ *   widget_pool_t *wp = widget_pool_create(64, 4096);
+ *   widget_t *w = widget_alloc(wp);   (lock already initialized)
+ *   widget_free(wp, w);
+ */
+
+/* Slab alignment for T: its own alignment if stricter than the default */
+#define MEMPOOL_TYPED_ALIGN(T) \
+	(_Alignof(T) > MEMPOOL_ALIGN_NATURAL ? _Alignof(T) : MEMPOOL_ALIGN_DEFAULT)
+
+#define MEMPOOL_DEFINE_TYPED(name, T, init, fini)				\
+typedef struct name##_pool name##_pool_t;					\
+										\
+static void (*const name##_ctor_fn_)(T *) = init;				\
+static void (*const name##_dtor_fn_)(T *) = fini;				\
+										\
+static inline void name##_ctor_thunk_(void *obj, void *arg)			\
+{										\
+	(void)arg;								\
+	name##_ctor_fn_((T *)obj);						\
+}										\
+										\
+static inline void name##_dtor_thunk_(void *obj, void *arg)			\
+{										\
+	(void)arg;								\
+	name##_dtor_fn_((T *)obj);						\
+}										\
+										\
+static inline name##_pool_t *name##_pool_create_ex(const pool_config_t *cfg)	\
+{										\
+	pool_config_t c;							\
+										\
+	if (!cfg)								\
+		return NULL;							\
+	c = *cfg;								\
+	c.block_size = sizeof(T);						\
+	if (_Alignof(T) > MEMPOOL_ALIGN_NATURAL && c.align < _Alignof(T))	\
+		c.align = _Alignof(T);						\
+	c.ctor = name##_ctor_fn_ ? name##_ctor_thunk_ : NULL;			\
+	c.dtor = name##_dtor_fn_ ? name##_dtor_thunk_ : NULL;			\
+	c.obj_arg = NULL;							\
+	return (name##_pool_t *)pool_create_ex(&c);				\
+}										\
+										\
+static inline name##_pool_t *name##_pool_create(size_t blocks_per_thread,	\
+						size_t total_blocks)		\
+{										\
+	pool_config_t cfg = {							\
+		.blocks_per_thread = blocks_per_thread,				\
+		.total_blocks = total_blocks,					\
+		.align = MEMPOOL_TYPED_ALIGN(T),				\
+	};									\
+										\
+	return name##_pool_create_ex(&cfg);					\
+}										\
+										\
+static inline T *name##_alloc(name##_pool_t *pool)				\
+{										\
+	return (T *)pool_alloc_fast((mempool_t *)pool);				\
+}										\
+										\
+static inline int name##_free(name##_pool_t *pool, T *obj)			\
+{										\
+	return pool_free_fast((mempool_t *)pool, obj);				\
+}										\
+										\
+static inline mempool_t *name##_pool_raw(name##_pool_t *pool)			\
+{										\
+	return (mempool_t *)pool;						\
+}										\
+										\
+static inline void name##_pool_destroy(name##_pool_t *pool)			\
+{										\
+	pool_destroy((mempool_t *)pool);					\
+}
+
+#endif /* MEMPOOL_TYPED_POOL_H */
@@ -1,5 +1,15 @@
 #include "../include/align.h"
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+/* Probed line size, 0 until the first cache_line_size() call */
+static _Atomic(size_t) detected_line;
 
 /* This file provides implementations of inline functions from align.h
    Included for completeness and testing purposes. */
@@ -10,4 +20,110 @@ void _align_test_compile(void)
 	_Static_assert(CACHE_LINE_SIZE > 0, "Invalid cache line size");
 	_Static_assert((CACHE_LINE_SIZE & (CACHE_LINE_SIZE - 1)) == 0,
 		       "Cache line size must be power of 2");
+	_Static_assert((CACHE_DESTRUCTIVE_SIZE & (CACHE_DESTRUCTIVE_SIZE - 1)) == 0,
+		       "Destructive interference size must be power of 2");
+	_Static_assert(CACHE_DESTRUCTIVE_SIZE >= CACHE_LINE_SIZE,
+		       "Destructive interference size below the line size");
+}
+
+/**
+ * v if it is a plausible line size (a power of two in [16, 1024]), else 0.
+ */
+static size_t plausible_line(long v)
+{
+	if (v < 16 || v > 1024 || (v & (v - 1)) != 0)
+		return 0;
+	return (size_t)v;
+}
+
+/**
+ * Ask the OS, then the CPU, for the L1 data cache line size.
+ */
+static size_t probe_line(void)
+{
+	size_t line = 0;
+
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+	line = plausible_line(sysconf(_SC_LEVEL1_DCACHE_LINESIZE));
+	if (line)
+		return line;
+#endif
+
+	FILE *f = fopen("/sys/devices/system/cpu/cpu0/cache/index0/coherency_line_size", "r");
+	if (f) {
+		long v;
+
+		if (fscanf(f, "%ld", &v) == 1)
+			line = plausible_line(v);
+		fclose(f);
+		if (line)
+			return line;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+
+	/* CLFLUSH line size, in 8-byte units */
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		line = plausible_line(((ebx >> 8) & 0xff) * 8);
+#elif defined(__aarch64__)
+	uint64_t ctr;
+
+	/*
+	 * CTR_EL0: DminLine (bits 19:16) is log2 of the smallest data line in
+	 * words; CWG (bits 27:24) the writeback granule, 0 if not reported.
+	 */
+	__asm__ volatile("mrs %0, ctr_el0" : "=r"(ctr));
+	line = plausible_line(4L << ((ctr >> 16) & 0xf));
+	if ((ctr >> 24) & 0xf) {
+		size_t cwg = plausible_line(4L << ((ctr >> 24) & 0xf));
+
+		if (cwg > line)
+			line = cwg;
+	}
+#endif
+
+	return line ? line : CACHE_LINE_SIZE;
+}
+
+size_t cache_line_size(void)
+{
+	size_t line = atomic_load_explicit(&detected_line, memory_order_relaxed);
+
+	/* Racing first callers probe the same value */
+	if (!line) {
+		line = probe_line();
+		atomic_store_explicit(&detected_line, line, memory_order_relaxed);
+	}
+	return line;
+}
+
+size_t cache_padding(void)
+{
+	size_t line = cache_line_size();
+
+	return line > CACHE_DESTRUCTIVE_SIZE ? line : CACHE_DESTRUCTIVE_SIZE;
+}
+
+void *cache_aligned_alloc(size_t size)
+{
+	size_t pad = cache_padding();
+
+	return aligned_alloc(pad, align_up(size ? size : 1, pad));
+}
+
+size_t resolve_alignment(size_t align)
+{
+	if (align == MEMPOOL_ALIGN_DEFAULT)
+		return MEMPOOL_ALIGN_NATURAL;
+
+	if (align == MEMPOOL_ALIGN_PAGE) {
+		long page = sysconf(_SC_PAGESIZE);
+		return page > 0 ? (size_t)page : 4096;
+	}
+
+	if (align < MEMPOOL_ALIGN_MIN || (align & (align - 1)) != 0)
+		return 0;
+
+	return align;
 }
@@ -1,66 +1,503 @@
 #include "../include/arena.h"
 #include "../include/align.h"
+#include "../include/latency.h"
+#include "../include/backoff.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdatomic.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * One bump region. The header sits at the start of the allocation and the
+ * usable data follows it at the arena's base alignment.
+ */
+typedef struct arena_block {
+	struct arena_block *prev; /* Older block in the chain (or next spare) */
+	uint8_t *data;            /* Usable memory */
+	size_t capacity;          /* Usable bytes in data */
+	size_t map_size;          /* Bytes obtained from the backing provider */
+	_Atomic(size_t) offset;   /* Current allocation offset */
+	uint64_t idle_since;      /* decay_ms: when the block was cached, ms */
+	size_t purged;            /* Bytes of data released while cached */
+} arena_block_t;
+
+/*
+ * Per-thread chunk table for ARENA_F_PER_THREAD arenas, set-associative on
+ * the arena uid. A slot untouched for ARENA_TLS_IDLE of the thread's
+ * chunk allocations may be taken over by another arena.
+ */
+#define ARENA_TLS_SETS        8
+#define ARENA_TLS_WAYS        4
+#define ARENA_TLS_IDLE        1024
+#define ARENA_DEFAULT_CHUNK   (16 * 1024)
 
 typedef struct arena_allocator {
-	uint8_t *memory;        /* Base memory pointer */
-	size_t capacity;        /* Total capacity */
-	_Atomic(size_t) offset; /* Current allocation offset */
+	arena_local_t local;      /* Inline fast path state; must stay first */
+	_Atomic(arena_block_t *) current; /* Block allocations bump from */
+	arena_block_t *first;     /* First block, kept across resets */
+	arena_block_t *spare;     /* Cached blocks from reset/rewind */
+	size_t align;             /* Allocation alignment */
+	size_t base_align;        /* Alignment of block data */
+	unsigned int flags;       /* ARENA_F_* */
+	size_t next_size;         /* Size of the next block to chain */
+	size_t max_block_size;    /* Doubling stops here */
+	size_t max_capacity;      /* Cap on bytes across all blocks */
+	size_t total_capacity;    /* Bytes across all blocks, spares included */
+	pthread_mutex_t lock;     /* Chain changes (grow, rewind, reset) */
+	mempool_backing_t backing;/* Provider of block memory */
+	uint64_t uid;             /* Unique id, never reused (thread chunk key) */
+	_Atomic(uint64_t) epoch;  /* Bumped on rewind; retires thread chunks */
+	size_t thread_chunk;      /* ARENA_F_PER_THREAD chunk size */
+	unsigned int decay_ms;    /* Cached blocks idle this long are released */
+	_Atomic(uint64_t) cas_retries;   /* Offset CASes that lost a race */
+	_Atomic(uint64_t) backoff_spins; /* Pauses spun after those failures */
 } arena_allocator_t;
 
+/*
+ * A thread's private chunk in one arena. A slot is live only while both
+ * uid and epoch match, so chunks of rewound arenas are simply ignored and
+ * overwritten; slots of destroyed arenas go idle and are evicted.
+ */
+typedef struct {
+	uint64_t uid;
+	uint64_t epoch;
+	uint8_t *bump;
+	uint8_t *end;
+	uint64_t used;            /* arena_tls_tick at the last use, 0 = empty */
+} arena_tls_t;
+
+static _Thread_local arena_tls_t arena_tls[ARENA_TLS_SETS][ARENA_TLS_WAYS];
+static _Thread_local uint64_t arena_tls_tick;
+static _Atomic(uint64_t) next_uid = 1;
+
+/**
+ * Allocate a block with capacity bytes of data. Returns NULL if the block
+ * size would not fit in a size_t.
+ */
+static arena_block_t *block_create(arena_allocator_t *alloc, size_t capacity)
+{
+	size_t header = align_up(sizeof(arena_block_t), alloc->base_align);
+	if (capacity > SIZE_MAX - header - alloc->base_align)
+		return NULL;
+
+	size_t total = align_up(header + capacity, alloc->base_align);
+
+	arena_block_t *block = alloc->backing.alloc(&alloc->backing, total,
+						    alloc->base_align);
+	if (!block)
+		return NULL;
+
+	block->prev = NULL;
+	block->map_size = total;
+	block->data = (uint8_t *)block + header;
+	block->capacity = total - header;
+	block->idle_since = 0;
+	block->purged = 0;
+	atomic_store(&block->offset, 0);
+	return block;
+}
+
+static void block_destroy(arena_allocator_t *alloc, arena_block_t *block)
+{
+	alloc->backing.free(&alloc->backing, block, block->map_size);
+}
+
+/**
+ * Monotonic clock in milliseconds.
+ */
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * Release the data pages of the cached blocks cached at or before
+ * cutoff. The header page stays, so the cache list remains intact.
+ * Caller holds alloc->lock.
+ */
+static size_t purge_spares(arena_allocator_t *alloc, uint64_t cutoff)
+{
+	size_t released = 0;
+
+	for (arena_block_t *b = alloc->spare; b; b = b->prev) {
+		if (b->purged || b->idle_since > cutoff)
+			continue;
+		b->purged = backing_purge(&alloc->backing, b->data, b->capacity);
+		released += b->purged;
+	}
+
+	return released;
+}
+
+/**
+ * decay_ms arenas: release the blocks cached for longer than that.
+ * Caller holds alloc->lock.
+ */
+static void decay_spares(arena_allocator_t *alloc)
+{
+	uint64_t now;
+
+	if (!alloc->decay_ms || !alloc->spare)
+		return;
+	now = now_ms();
+	if (now >= alloc->decay_ms)
+		purge_spares(alloc, now - alloc->decay_ms);
+}
+
+/**
+ * Point the inline bump window at the current block (single-owner arenas).
+ */
+static void local_load(arena_allocator_t *alloc)
+{
+	if (!(alloc->flags & ARENA_F_SINGLE_THREAD))
+		return;
+
+	arena_block_t *block = atomic_load_explicit(&alloc->current, memory_order_relaxed);
+	alloc->local.bump = block->data + atomic_load_explicit(&block->offset,
+							       memory_order_relaxed);
+	alloc->local.end = block->data + block->capacity;
+}
+
+/**
+ * Write the inline bump position back to the current block's offset.
+ */
+static void local_sync(arena_allocator_t *alloc)
+{
+	if (!(alloc->flags & ARENA_F_SINGLE_THREAD))
+		return;
+
+	arena_block_t *block = atomic_load_explicit(&alloc->current, memory_order_relaxed);
+	atomic_store_explicit(&block->offset, (size_t)(alloc->local.bump - block->data),
+			      memory_order_relaxed);
+}
+
 arena_allocator_t *arena_create(size_t capacity)
 {
-	if (capacity == 0)
+	arena_config_t cfg = {
+		.capacity = capacity,
+		.align = MEMPOOL_ALIGN_CACHE_LINE,
+	};
+
+	return arena_create_ex(&cfg);
+}
+
+arena_allocator_t *arena_create_ex(const arena_config_t *cfg)
+{
+	if (!cfg || cfg->capacity == 0)
 		return NULL;
 
-	/* Align capacity to cache line */
-	capacity = align_size_to_cache_line(capacity);
+	size_t align = resolve_alignment(cfg->align);
+	if (!align)
+		return NULL;
+
+	/* One owner and many threads are mutually exclusive */
+	if ((cfg->flags & ARENA_F_SINGLE_THREAD) && (cfg->flags & ARENA_F_PER_THREAD))
+		return NULL;
 
 	arena_allocator_t *alloc = malloc(sizeof(arena_allocator_t));
 	if (!alloc)
 		return NULL;
 
-	/* Allocate aligned memory */
-	alloc->memory = aligned_alloc(CACHE_LINE_SIZE, capacity);
-	if (!alloc->memory) {
+	/* Base is at least cache-line aligned; capacity a multiple of that */
+	alloc->align = align;
+	alloc->base_align = align > CACHE_LINE_SIZE ? align : CACHE_LINE_SIZE;
+	alloc->flags = cfg->flags;
+	alloc->max_block_size = cfg->max_block_size;
+	alloc->max_capacity = cfg->max_capacity;
+	alloc->decay_ms = cfg->decay_ms;
+	alloc->spare = NULL;
+	alloc->backing = *backing_or_default(cfg->backing);
+
+	alloc->first = block_create(alloc, align_up(cfg->capacity, alloc->base_align));
+	if (!alloc->first) {
 		free(alloc);
 		return NULL;
 	}
 
-	alloc->capacity = capacity;
-	atomic_store(&alloc->offset, 0);
+	alloc->total_capacity = alloc->first->capacity;
+	alloc->next_size = alloc->first->capacity * 2;
+	atomic_store(&alloc->current, alloc->first);
+	pthread_mutex_init(&alloc->lock, NULL);
+
+	alloc->uid = atomic_fetch_add(&next_uid, 1);
+	atomic_store(&alloc->epoch, 0);
+	atomic_store(&alloc->cas_retries, 0);
+	atomic_store(&alloc->backoff_spins, 0);
+
+	/* A chunk never exceeds the first block, so carving one cannot fail early */
+	size_t chunk = cfg->thread_chunk ? cfg->thread_chunk : ARENA_DEFAULT_CHUNK;
+	chunk = align_up(chunk, align);
+	alloc->thread_chunk = chunk < alloc->first->capacity ? chunk
+							     : alloc->first->capacity;
+
+	alloc->local.align_mask = align - 1;
+	alloc->local.bump = NULL;
+	alloc->local.end = NULL;
+	local_load(alloc);
 
 	return alloc;
 }
 
+/**
+ * Chain a block that can hold size bytes after full, unless another thread
+ * already did. Reuses a cached block when one is large enough.
+ * Returns 0 if the caller should retry, -1 if the arena cannot grow.
+ */
+static int grow(arena_allocator_t *alloc, arena_block_t *full, size_t size)
+{
+	if (!(alloc->flags & ARENA_F_GROW))
+		return -1;
+
+	pthread_mutex_lock(&alloc->lock);
+
+	if (atomic_load(&alloc->current) != full) {
+		pthread_mutex_unlock(&alloc->lock);
+		return 0;
+	}
+
+	LATENCY_START(t0);
+
+	/* First fit from the block cache */
+	arena_block_t **link = &alloc->spare;
+	while (*link && (*link)->capacity < size)
+		link = &(*link)->prev;
+
+	arena_block_t *block = *link;
+	if (block) {
+		*link = block->prev;
+		block->purged = 0;
+	} else {
+		size_t want = alloc->next_size > size ? alloc->next_size : size;
+
+		if (alloc->max_capacity &&
+		    (want > alloc->max_capacity ||
+		     alloc->total_capacity > alloc->max_capacity - want)) {
+			pthread_mutex_unlock(&alloc->lock);
+			return -1;
+		}
+
+		block = block_create(alloc, want);
+		if (!block) {
+			pthread_mutex_unlock(&alloc->lock);
+			return -1;
+		}
+
+		alloc->total_capacity += block->capacity;
+		if (alloc->next_size <= SIZE_MAX / 2 &&
+		    (!alloc->max_block_size || alloc->next_size * 2 <= alloc->max_block_size))
+			alloc->next_size *= 2;
+	}
+
+	block->prev = full;
+	atomic_store(&block->offset, 0);
+	atomic_store(&alloc->current, block);
+	decay_spares(alloc);
+
+	pthread_mutex_unlock(&alloc->lock);
+	LATENCY_END(LAT_EV_ARENA_GROW, t0);
+	return 0;
+}
+
+/**
+ * Bump the shared offset of the current block; size is already aligned.
+ */
+static void *shared_alloc(arena_allocator_t *alloc, size_t size)
+{
+	backoff_t backoff = BACKOFF_INIT;
+
+	for (;;) {
+		arena_block_t *block = atomic_load(&alloc->current);
+
+		/* Atomically allocate space */
+		size_t old_offset = atomic_load(&block->offset);
+
+		for (;;) {
+			/* Check for overflow (size may be close to SIZE_MAX) */
+			if (size > block->capacity - old_offset)
+				break;
+
+			size_t new_offset = old_offset + size;
+
+			/* Try to claim the space */
+			if (atomic_compare_exchange_strong(&block->offset, &old_offset,
+							   new_offset))
+				return (void *)(block->data + old_offset);
+
+			/* Contention: back off, then retry from the current offset */
+			unsigned int spins = backoff_pause(&backoff);
+			atomic_fetch_add_explicit(&alloc->cas_retries, 1, memory_order_relaxed);
+			atomic_fetch_add_explicit(&alloc->backoff_spins, spins,
+						  memory_order_relaxed);
+			LATENCY_RETRY();
+			old_offset = atomic_load(&block->offset);
+		}
+
+		/* Block full: chain another one, or give up */
+		if (grow(alloc, block, size) < 0)
+			return NULL;
+	}
+}
+
+/**
+ * Find the calling thread's slot for arena uid, or the least recently used
+ * slot of its set if that one is empty or idle. Returns NULL when every
+ * way is in recent use by other arenas: evicting one would abandon its
+ * chunk, and alternating arenas would then burn a chunk per allocation.
+ */
+static arena_tls_t *tls_slot(uint64_t uid, uint64_t tick)
+{
+	arena_tls_t *set = arena_tls[uid % ARENA_TLS_SETS];
+	arena_tls_t *victim = &set[0];
+
+	for (int w = 0; w < ARENA_TLS_WAYS; w++) {
+		if (set[w].uid == uid)
+			return &set[w];
+		if (set[w].used < victim->used)
+			victim = &set[w];
+	}
+
+	if (victim->used && tick - victim->used < ARENA_TLS_IDLE)
+		return NULL;
+	return victim;
+}
+
+/**
+ * Bump inside the calling thread's private chunk, carving a new chunk from
+ * the shared block when the current one is used up or stale.
+ */
+static void *thread_alloc(arena_allocator_t *alloc, size_t size)
+{
+	/* Large requests would waste most of a chunk */
+	if (size > alloc->thread_chunk / 2)
+		return shared_alloc(alloc, size);
+
+	uint64_t tick = ++arena_tls_tick;
+	arena_tls_t *slot = tls_slot(alloc->uid, tick);
+	if (!slot)
+		return shared_alloc(alloc, size); /* Set busy with other arenas */
+
+	uint64_t epoch = atomic_load_explicit(&alloc->epoch, memory_order_relaxed);
+	slot->used = tick;
+
+	if (slot->uid == alloc->uid && slot->epoch == epoch &&
+	    (size_t)(slot->end - slot->bump) >= size) {
+		void *ptr = slot->bump;
+		slot->bump += size;
+		return ptr;
+	}
+
+	uint8_t *chunk = shared_alloc(alloc, alloc->thread_chunk);
+	if (!chunk)
+		return NULL;
+
+	slot->uid = alloc->uid;
+	slot->epoch = epoch;
+	slot->bump = chunk + size;
+	slot->end = chunk + alloc->thread_chunk;
+	return chunk;
+}
+
+void *arena_alloc_slow(arena_allocator_t *alloc, size_t size)
+{
+	if (!alloc || size == 0)
+		return NULL;
+
+	if (!(alloc->flags & ARENA_F_SINGLE_THREAD))
+		return arena_alloc(alloc, size);
+
+	size_t rounded = align_up(size, alloc->align);
+	if (rounded < size)
+		return NULL; /* Rounding wrapped past SIZE_MAX */
+	size = rounded;
+
+	/* Retire the full block's position, then chain one that fits */
+	local_sync(alloc);
+	if (grow(alloc, atomic_load_explicit(&alloc->current, memory_order_relaxed),
+		 size) < 0)
+		return NULL;
+	local_load(alloc);
+
+	void *ptr = alloc->local.bump;
+	alloc->local.bump += size;
+	return ptr;
+}
+
 void *arena_alloc(arena_allocator_t *alloc, size_t size)
 {
 	if (!alloc || size == 0)
 		return NULL;
 
-	/* Align size to cache line */
-	size = align_size_to_cache_line(size);
+	void *ptr;
+	LATENCY_START(t0);
 
-	/* Atomically allocate space */
-	size_t old_offset = atomic_load(&alloc->offset);
+	if (alloc->flags & ARENA_F_SINGLE_THREAD) {
+		ptr = arena_alloc_local(alloc, size);
+	} else {
+		/* Round size to the arena alignment so every offset stays aligned */
+		size_t rounded = align_up(size, alloc->align);
 
-	for (;;) {
-		size_t new_offset = old_offset + size;
+		if (rounded < size)
+			ptr = NULL; /* Rounding wrapped past SIZE_MAX */
+		else if (alloc->flags & ARENA_F_PER_THREAD)
+			ptr = thread_alloc(alloc, rounded);
+		else
+			ptr = shared_alloc(alloc, rounded);
+	}
 
-		/* Check for overflow */
-		if (new_offset > alloc->capacity)
-			return NULL;
+	LATENCY_END(LAT_EV_ARENA_ALLOC, t0);
+	return ptr;
+}
 
-		/* Try to claim the space */
-		if (atomic_compare_exchange_strong(&alloc->offset, &old_offset,
-						   new_offset))
-			return (void *)(alloc->memory + old_offset);
+arena_mark_t arena_mark(arena_allocator_t *alloc)
+{
+	arena_mark_t mark = { NULL, 0 };
+
+	if (!alloc)
+		return mark;
+
+	local_sync(alloc);
+
+	arena_block_t *block = atomic_load(&alloc->current);
+	mark.block = block;
+	mark.offset = atomic_load(&block->offset);
+	return mark;
+}
+
+void arena_rewind(arena_allocator_t *alloc, arena_mark_t mark)
+{
+	if (!alloc || !mark.block)
+		return;
+
+	pthread_mutex_lock(&alloc->lock);
 
-		/* Contention: retry with updated old_offset */
+	/* Move every block chained after the mark to the cache */
+	uint64_t now = alloc->decay_ms ? now_ms() : 0;
+	arena_block_t *block = atomic_load(&alloc->current);
+	while (block && block != mark.block) {
+		arena_block_t *prev = block->prev;
+
+		block->prev = alloc->spare;
+		block->idle_since = now;
+		alloc->spare = block;
+		block = prev;
+	}
+	decay_spares(alloc);
+
+	if (block) {
+		atomic_store(&block->offset, mark.offset);
+		atomic_store(&alloc->current, block);
 	}
+
+	/* Thread chunks may lie in released memory: make every slot stale */
+	atomic_fetch_add(&alloc->epoch, 1);
+	local_load(alloc);
+
+	pthread_mutex_unlock(&alloc->lock);
 }
 
 void arena_reset(arena_allocator_t *alloc)
@@ -68,9 +505,22 @@ void arena_reset(arena_allocator_t *alloc)
 	if (!alloc)
 		return;
 
-	/* Memset is not necessary since arena allocations don't guarantee zeroing,
-	   but we do it here for safety in testing. In production, remove for speed. */
-	atomic_store(&alloc->offset, 0);
+	arena_mark_t start = { alloc->first, 0 };
+	arena_rewind(alloc, start);
+}
+
+size_t arena_trim(arena_allocator_t *alloc)
+{
+	size_t released;
+
+	if (!alloc)
+		return 0;
+
+	pthread_mutex_lock(&alloc->lock);
+	released = purge_spares(alloc, UINT64_MAX);
+	pthread_mutex_unlock(&alloc->lock);
+
+	return released;
 }
 
 void arena_destroy(arena_allocator_t *alloc)
@@ -78,8 +528,21 @@ void arena_destroy(arena_allocator_t *alloc)
 	if (!alloc)
 		return;
 
-	if (alloc->memory)
-		free(alloc->memory);
+	arena_block_t *block = atomic_load(&alloc->current);
+	while (block) {
+		arena_block_t *prev = block->prev;
+		block_destroy(alloc, block);
+		block = prev;
+	}
+
+	block = alloc->spare;
+	while (block) {
+		arena_block_t *next = block->prev;
+		block_destroy(alloc, block);
+		block = next;
+	}
+
+	pthread_mutex_destroy(&alloc->lock);
 	free(alloc);
 }
 
@@ -88,8 +551,36 @@ int arena_stats(arena_allocator_t *alloc, size_t *used, size_t *capacity)
 	if (!alloc || !used || !capacity)
 		return -1;
 
-	*used = atomic_load(&alloc->offset);
-	*capacity = alloc->capacity;
+	*used = 0;
+	*capacity = 0;
+
+	pthread_mutex_lock(&alloc->lock);
+	local_sync(alloc);
+	for (arena_block_t *b = atomic_load(&alloc->current); b; b = b->prev) {
+		*used += atomic_load(&b->offset);
+		*capacity += b->capacity;
+	}
+	pthread_mutex_unlock(&alloc->lock);
+
+	return 0;
+}
+
+int arena_stats_ex(arena_allocator_t *alloc, arena_stats_ex_t *stats)
+{
+	if (!alloc || !stats)
+		return -1;
+
+	if (arena_stats(alloc, &stats->used, &stats->capacity) != 0)
+		return -1;
+
+	stats->cas_retries = atomic_load_explicit(&alloc->cas_retries, memory_order_relaxed);
+	stats->backoff_spins = atomic_load_explicit(&alloc->backoff_spins,
+						    memory_order_relaxed);
 
+	stats->purged = 0;
+	pthread_mutex_lock(&alloc->lock);
+	for (arena_block_t *b = alloc->spare; b; b = b->prev)
+		stats->purged += b->purged;
+	pthread_mutex_unlock(&alloc->lock);
 	return 0;
 }
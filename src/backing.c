@@ -0,0 +1,243 @@
+#include "../include/backing.h"
+#include "../include/align.h"
+#include "../include/topology.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Size of a transparent or default hugetlb huge page */
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+static size_t page_size(void);
+
+/**
+ * Give the whole pages of [ptr, ptr + size) back to the kernel. Private
+ * anonymous memory reads back as zeros afterwards.
+ */
+static size_t madvise_purge(const mempool_backing_t *b, void *ptr, size_t size)
+{
+	uintptr_t start = align_up((uintptr_t)ptr, page_size());
+	uintptr_t end = ((uintptr_t)ptr + size) & ~(uintptr_t)(page_size() - 1);
+
+	(void)b;
+	if (end <= start || madvise((void *)start, end - start, MADV_DONTNEED) != 0)
+		return 0;
+	return end - start;
+}
+
+/* ---- Heap provider ---- */
+
+static void *heap_alloc(const mempool_backing_t *b, size_t size, size_t align)
+{
+	(void)b;
+	/* aligned_alloc wants the size to be a multiple of the alignment */
+	return aligned_alloc(align, align_up(size, align));
+}
+
+static void heap_free(const mempool_backing_t *b, void *ptr, size_t size)
+{
+	(void)b;
+	(void)size;
+	free(ptr);
+}
+
+const mempool_backing_t backing_heap = {
+	.alloc = heap_alloc,
+	.free = heap_free,
+	.purge = madvise_purge,
+	.node = -1,
+};
+
+/* ---- mmap provider ---- */
+
+static size_t page_size(void)
+{
+	static _Atomic(size_t) page;
+	size_t p = atomic_load_explicit(&page, memory_order_relaxed);
+
+	/* Racing first callers store the same value */
+	if (!p) {
+		p = (size_t)sysconf(_SC_PAGESIZE);
+		atomic_store_explicit(&page, p, memory_order_relaxed);
+	}
+	return p;
+}
+
+static int wants_huge(const mempool_backing_t *b)
+{
+	return (b->flags & (BACKING_F_HUGETLB | BACKING_F_THP)) != 0;
+}
+
+/**
+ * Length of the mapping behind a size-byte request. Must depend only on
+ * size and flags, since free/release recompute it.
+ */
+static size_t map_len(const mempool_backing_t *b, size_t size)
+{
+	if (b->flags & BACKING_F_HUGETLB)
+		return align_up(size, HUGE_PAGE_SIZE);
+	return align_up(size, page_size());
+}
+
+/**
+ * Fault in len bytes at p so first touches do not take page faults.
+ */
+static void prefault(void *p, size_t len)
+{
+#ifdef MADV_POPULATE_WRITE
+	if (madvise(p, len, MADV_POPULATE_WRITE) == 0)
+		return;
+#endif
+	for (size_t off = 0; off < len; off += page_size())
+		((volatile uint8_t *)p)[off] = 0;
+}
+
+/**
+ * Apply node binding, huge page advice and prefaulting to a fresh mapping.
+ * Binding must come first: it only affects pages that are not faulted yet.
+ */
+static void prepare(const mempool_backing_t *b, void *p, size_t len, int advise)
+{
+	if (b->node >= 0)
+		topo_bind(p, len, (unsigned int)b->node);
+	if (advise && wants_huge(b))
+		madvise(p, len, MADV_HUGEPAGE);
+	if (b->flags & BACKING_F_POPULATE)
+		prefault(p, len);
+}
+
+/**
+ * Map len bytes aligned to align by over-mapping and trimming both ends.
+ */
+static void *map_aligned(size_t len, size_t align, int prot, int extra_flags)
+{
+	size_t span = len + (align > page_size() ? align - page_size() : 0);
+	uint8_t *raw = mmap(NULL, span, prot, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags,
+			    -1, 0);
+	if (raw == MAP_FAILED)
+		return NULL;
+
+	uint8_t *p = (uint8_t *)align_up((uintptr_t)raw, align);
+	size_t head = (size_t)(p - raw);
+	size_t tail = span - head - len;
+
+	if (head)
+		munmap(raw, head);
+	if (tail)
+		munmap(p + len, tail);
+	return p;
+}
+
+static size_t map_align(const mempool_backing_t *b, size_t align)
+{
+	if (align < page_size())
+		align = page_size();
+	if (wants_huge(b) && align < HUGE_PAGE_SIZE)
+		align = HUGE_PAGE_SIZE;
+	return align;
+}
+
+static void *mmap_alloc(const mempool_backing_t *b, size_t size, size_t align)
+{
+	size_t len = map_len(b, size);
+
+	if (b->flags & BACKING_F_HUGETLB) {
+		void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		/* Huge pages come huge-page aligned; no pool reserved means THP */
+		if (p != MAP_FAILED && ((uintptr_t)p & (align - 1)) == 0) {
+			prepare(b, p, len, 0);
+			return p;
+		}
+		if (p != MAP_FAILED)
+			munmap(p, len);
+	}
+
+	void *p = map_aligned(len, map_align(b, align), PROT_READ | PROT_WRITE, 0);
+	if (!p)
+		return NULL;
+
+	prepare(b, p, len, 1);
+	return p;
+}
+
+static void mmap_free(const mempool_backing_t *b, void *ptr, size_t size)
+{
+	if (ptr)
+		munmap(ptr, map_len(b, size));
+}
+
+static void *mmap_reserve(const mempool_backing_t *b, size_t size, size_t align)
+{
+	/* Address space only: nothing is committed or counted until commit */
+	return map_aligned(map_len(b, size), map_align(b, align), PROT_NONE,
+			   MAP_NORESERVE);
+}
+
+static int mmap_commit(const mempool_backing_t *b, void *ptr, size_t size)
+{
+	uintptr_t start = (uintptr_t)ptr & ~(uintptr_t)(page_size() - 1);
+	size_t len = align_up((uintptr_t)ptr + size, page_size()) - start;
+
+	if (mprotect((void *)start, len, PROT_READ | PROT_WRITE) != 0)
+		return -1;
+
+	/* Reserved ranges are regular pages: hugetlb requests get THP here */
+	prepare(b, (void *)start, len, 1);
+	return 0;
+}
+
+static void mmap_release(const mempool_backing_t *b, void *ptr, size_t size)
+{
+	if (ptr)
+		munmap(ptr, map_len(b, size));
+}
+
+mempool_backing_t backing_mmap(unsigned int flags)
+{
+	mempool_backing_t b = {
+		.alloc = mmap_alloc,
+		.free = mmap_free,
+		.reserve = mmap_reserve,
+		.commit = mmap_commit,
+		.release = mmap_release,
+		.purge = madvise_purge,
+		.flags = flags,
+		.node = -1,
+	};
+
+	return b;
+}
+
+mempool_backing_t backing_on_node(const mempool_backing_t *b, int node)
+{
+	mempool_backing_t out;
+
+	if (!b || b->alloc == heap_alloc)
+		out = backing_mmap(0);
+	else
+		out = *b;
+
+	out.node = node;
+	return out;
+}
+
+const mempool_backing_t *backing_or_default(const mempool_backing_t *b)
+{
+	return b ? b : &backing_heap;
+}
+
+int backing_can_reserve(const mempool_backing_t *b)
+{
+	return b && b->reserve && b->commit && b->release;
+}
+
+size_t backing_purge(const mempool_backing_t *b, void *ptr, size_t size)
+{
+	if (!b || !b->purge || !ptr || size == 0)
+		return 0;
+	return b->purge(b, ptr, size);
+}
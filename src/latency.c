@@ -0,0 +1,384 @@
+#include "../include/latency.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+static const char *const event_names[LAT_EV_COUNT] = {
+	[LAT_EV_POOL_ALLOC_FAST] = "pool_alloc_fast",
+	[LAT_EV_POOL_ALLOC_SLOW] = "pool_alloc_slow",
+	[LAT_EV_POOL_FREE_FAST] = "pool_free_fast",
+	[LAT_EV_POOL_FREE_SLOW] = "pool_free_slow",
+	[LAT_EV_POOL_REFILL] = "pool_refill",
+	[LAT_EV_POOL_FLUSH] = "pool_flush",
+	[LAT_EV_SLAB_ALLOC] = "slab_alloc",
+	[LAT_EV_SLAB_FREE] = "slab_free",
+	[LAT_EV_SLAB_CONTENDED] = "slab_contended",
+	[LAT_EV_SLAB_GROW] = "slab_grow",
+	[LAT_EV_ARENA_ALLOC] = "arena_alloc",
+	[LAT_EV_ARENA_GROW] = "arena_grow",
+};
+
+const char *latency_event_name(latency_event_t ev)
+{
+	if ((unsigned int)ev >= LAT_EV_COUNT)
+		return "unknown";
+	return event_names[ev];
+}
+
+/**
+ * Upper edge (in ticks) of a histogram bucket.
+ */
+static uint64_t bucket_upper(size_t b)
+{
+	if (b < LAT_SUB_COUNT)
+		return b;
+
+	unsigned int shift = (unsigned int)(b / LAT_SUB_COUNT) - 1;
+	uint64_t lower = (uint64_t)(LAT_SUB_COUNT + b % LAT_SUB_COUNT) << shift;
+	return lower + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * Histogram bucket of a value: exact below LAT_SUB_COUNT, then the top
+ * LAT_SUB_BITS bits below the leading one select a sub-bucket.
+ */
+static size_t bucket_of(uint64_t v)
+{
+	if (v < LAT_SUB_COUNT)
+		return (size_t)v;
+
+	unsigned int exp = 63 - (unsigned int)__builtin_clzll(v);
+	if (exp >= LAT_MAX_EXP)
+		return LAT_BUCKETS - 1;
+
+	unsigned int shift = exp - LAT_SUB_BITS;
+	return (size_t)(shift + 1) * LAT_SUB_COUNT +
+	       (size_t)((v >> shift) & (LAT_SUB_COUNT - 1));
+}
+
+void latency_hist_add(latency_hist_t *hist, uint64_t value)
+{
+	if (hist->count == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->count++;
+	hist->sum += value;
+	hist->buckets[bucket_of(value)]++;
+}
+
+void latency_hist_merge(latency_hist_t *dst, const latency_hist_t *src)
+{
+	if (src->count == 0)
+		return;
+
+	if (dst->count == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+	dst->sum += src->sum;
+	for (size_t b = 0; b < LAT_BUCKETS; b++)
+		dst->buckets[b] += src->buckets[b];
+}
+
+uint64_t latency_hist_value_at(const latency_hist_t *hist, double q)
+{
+	if (!hist || hist->count == 0)
+		return 0;
+
+	if (q < 0.0)
+		q = 0.0;
+	if (q > 1.0)
+		q = 1.0;
+
+	uint64_t rank = (uint64_t)(q * (double)hist->count + 0.5);
+	if (rank == 0)
+		rank = 1;
+
+	uint64_t seen = 0;
+	uint64_t value = hist->max;
+	for (size_t b = 0; b < LAT_BUCKETS; b++) {
+		seen += hist->buckets[b];
+		if (seen >= rank) {
+			value = bucket_upper(b);
+			break;
+		}
+	}
+
+	/* The top bucket is open-ended, and no sample exceeds the maximum */
+	return value < hist->max ? value : hist->max;
+}
+
+double latency_quantile(const latency_hist_t *hist, double q)
+{
+	return (double)latency_hist_value_at(hist, q) / latency_ticks_per_ns();
+}
+
+#ifdef MEMPOOL_INSTRUMENT
+
+/* Owner-only counter bump; other threads only read (see POOL_STAT_INC) */
+#define LAT_INC(c, n) \
+	atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (n), \
+			      memory_order_relaxed)
+
+/* One event's histogram as recorded by its owning thread */
+typedef struct {
+	_Atomic(uint64_t) count;
+	_Atomic(uint64_t) sum;
+	_Atomic(uint64_t) min;
+	_Atomic(uint64_t) max;
+	_Atomic(uint64_t) buckets[LAT_BUCKETS];
+} thread_hist_t;
+
+/* Per-thread recording state, linked into the registry while alive */
+typedef struct lat_thread {
+	struct lat_thread *next;
+	thread_hist_t hist[LAT_EV_COUNT];
+} lat_thread_t;
+
+_Thread_local unsigned int latency_retries;
+
+static _Thread_local lat_thread_t *self;
+static lat_thread_t *threads;
+static latency_hist_t retired[LAT_EV_COUNT];
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t exit_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+uint64_t latency_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static double ticks_per_ns = 1.0;
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Measure the tick rate against the monotonic clock over about 10 ms.
+ */
+static void calibrate(void)
+{
+	uint64_t ns0 = latency_clock_ns();
+	uint64_t t0 = latency_ticks();
+	uint64_t ns1;
+
+	do {
+		ns1 = latency_clock_ns();
+	} while (ns1 - ns0 < 10000000u);
+
+	uint64_t t1 = latency_ticks();
+	if (t1 > t0)
+		ticks_per_ns = (double)(t1 - t0) / (double)(ns1 - ns0);
+}
+
+double latency_ticks_per_ns(void)
+{
+	pthread_once(&calibrate_once, calibrate);
+	return ticks_per_ns;
+}
+
+static void hist_clear(thread_hist_t *h)
+{
+	atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+	atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+	atomic_store_explicit(&h->min, UINT64_MAX, memory_order_relaxed);
+	atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+	for (size_t b = 0; b < LAT_BUCKETS; b++)
+		atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+}
+
+/**
+ * Add a thread's histogram into a merged one.
+ */
+static void hist_merge(latency_hist_t *dst, thread_hist_t *src)
+{
+	uint64_t count = atomic_load_explicit(&src->count, memory_order_relaxed);
+	if (count == 0)
+		return;
+
+	uint64_t min = atomic_load_explicit(&src->min, memory_order_relaxed);
+	uint64_t max = atomic_load_explicit(&src->max, memory_order_relaxed);
+
+	if (dst->count == 0 || min < dst->min)
+		dst->min = min;
+	if (max > dst->max)
+		dst->max = max;
+	dst->count += count;
+	dst->sum += atomic_load_explicit(&src->sum, memory_order_relaxed);
+	for (size_t b = 0; b < LAT_BUCKETS; b++)
+		dst->buckets[b] += atomic_load_explicit(&src->buckets[b],
+							memory_order_relaxed);
+}
+
+/**
+ * Thread exit: fold the thread's samples into the retired totals.
+ */
+static void thread_exit(void *arg)
+{
+	lat_thread_t *t = arg;
+
+	pthread_mutex_lock(&registry_lock);
+	for (lat_thread_t **link = &threads; *link; link = &(*link)->next) {
+		if (*link == t) {
+			*link = t->next;
+			break;
+		}
+	}
+	for (int ev = 0; ev < LAT_EV_COUNT; ev++)
+		hist_merge(&retired[ev], &t->hist[ev]);
+	pthread_mutex_unlock(&registry_lock);
+
+	self = NULL;
+	free(t);
+}
+
+static void create_key(void)
+{
+	pthread_key_create(&exit_key, thread_exit);
+}
+
+/**
+ * Create and register the calling thread's histograms.
+ */
+static lat_thread_t *register_thread(void)
+{
+	pthread_once(&key_once, create_key);
+
+	lat_thread_t *t = malloc(sizeof(*t));
+	if (!t)
+		return NULL;
+	for (int ev = 0; ev < LAT_EV_COUNT; ev++)
+		hist_clear(&t->hist[ev]);
+
+	pthread_mutex_lock(&registry_lock);
+	t->next = threads;
+	threads = t;
+	pthread_mutex_unlock(&registry_lock);
+
+	pthread_setspecific(exit_key, t);
+	self = t;
+	return t;
+}
+
+void latency_record(latency_event_t ev, uint64_t ticks)
+{
+	lat_thread_t *t = self;
+
+	if ((unsigned int)ev >= LAT_EV_COUNT)
+		return;
+	if (!t && !(t = register_thread()))
+		return;
+
+	thread_hist_t *h = &t->hist[ev];
+
+	LAT_INC(h->count, 1);
+	LAT_INC(h->sum, ticks);
+	LAT_INC(h->buckets[bucket_of(ticks)], 1);
+	if (ticks < atomic_load_explicit(&h->min, memory_order_relaxed))
+		atomic_store_explicit(&h->min, ticks, memory_order_relaxed);
+	if (ticks > atomic_load_explicit(&h->max, memory_order_relaxed))
+		atomic_store_explicit(&h->max, ticks, memory_order_relaxed);
+}
+
+int latency_snapshot(latency_event_t ev, latency_hist_t *hist)
+{
+	if (!hist || (unsigned int)ev >= LAT_EV_COUNT)
+		return -1;
+
+	pthread_mutex_lock(&registry_lock);
+	*hist = retired[ev];
+	for (lat_thread_t *t = threads; t; t = t->next)
+		hist_merge(hist, &t->hist[ev]);
+	pthread_mutex_unlock(&registry_lock);
+
+	return 0;
+}
+
+void latency_reset(void)
+{
+	pthread_mutex_lock(&registry_lock);
+	memset(retired, 0, sizeof(retired));
+	for (lat_thread_t *t = threads; t; t = t->next) {
+		for (int ev = 0; ev < LAT_EV_COUNT; ev++)
+			hist_clear(&t->hist[ev]);
+	}
+	pthread_mutex_unlock(&registry_lock);
+}
+
+#else /* !MEMPOOL_INSTRUMENT */
+
+double latency_ticks_per_ns(void)
+{
+	return 1.0;
+}
+
+int latency_snapshot(latency_event_t ev, latency_hist_t *hist)
+{
+	(void)ev;
+	(void)hist;
+	return -1;
+}
+
+void latency_reset(void)
+{
+}
+
+#endif /* MEMPOOL_INSTRUMENT */
+
+int latency_summary(latency_event_t ev, latency_summary_t *out)
+{
+	if (!out)
+		return -1;
+
+	latency_hist_t *hist = malloc(sizeof(*hist));
+	if (!hist)
+		return -1;
+	if (latency_snapshot(ev, hist) != 0) {
+		free(hist);
+		return -1;
+	}
+
+	double tpn = latency_ticks_per_ns();
+
+	memset(out, 0, sizeof(*out));
+	out->count = hist->count;
+	if (hist->count) {
+		out->mean = (double)hist->sum / (double)hist->count / tpn;
+		out->min = (double)hist->min / tpn;
+		out->max = (double)hist->max / tpn;
+		out->p50 = latency_quantile(hist, 0.50);
+		out->p90 = latency_quantile(hist, 0.90);
+		out->p99 = latency_quantile(hist, 0.99);
+		out->p999 = latency_quantile(hist, 0.999);
+	}
+
+	free(hist);
+	return 0;
+}
+
+int latency_export(FILE *f)
+{
+	if (!f)
+		return -1;
+
+	for (int ev = 0; ev < LAT_EV_COUNT; ev++) {
+		latency_summary_t s;
+
+		if (latency_summary((latency_event_t)ev, &s) != 0)
+			return -1;
+		if (s.count == 0)
+			continue;
+		fprintf(f, "%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			latency_event_name((latency_event_t)ev),
+			(unsigned long long)s.count, s.mean, s.min, s.p50, s.p90,
+			s.p99, s.p999, s.max);
+	}
+
+	return 0;
+}
@@ -0,0 +1,403 @@
+#include "../include/lockfree.h"
+#include "../include/align.h"
+#include "../include/backoff.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Bounded ring after Vyukov: every cell carries a sequence number that
+ * says whose turn it is. A producer at position pos may fill the cell
+ * once its sequence is pos, and hands it over by setting pos + 1; the
+ * consumer at pos empties it and sets pos + capacity, the producer's turn
+ * one lap later. Producers and consumers only share the cells they meet
+ * in, and each side claims a position with one CAS on its own counter.
+ */
+typedef struct {
+	_Atomic(size_t) seq; /* Turn: pos free for the producer, pos + 1 full */
+	void *data;          /* Stored pointer, owned by whoever holds the turn */
+} lf_cell_t;
+
+struct lf_ring {
+	lf_cell_t *cells;                       /* Cells, right after the ring */
+	size_t mask;                            /* Capacity - 1 */
+	_Atomic(size_t) enqueue_pos CACHE_ALIGNED; /* Next position to fill */
+	_Atomic(size_t) dequeue_pos CACHE_ALIGNED; /* Next position to empty */
+};
+
+/*
+ * Nodes of the queue and the stack. A link packs a node index with a
+ * version tag that every write of the link increments, as the slab free
+ * list head does, so a CAS against a link that changed and changed back
+ * in between fails.
+ */
+#define LF_NIL UINT32_MAX
+
+#define LINK_INDEX(l) ((uint32_t)(l))
+#define LINK_TAG(l)   ((uint32_t)((l) >> 32))
+
+static inline uint64_t link_pack(uint32_t idx, uint32_t tag)
+{
+	return ((uint64_t)tag << 32) | idx;
+}
+
+typedef struct {
+	_Atomic(uint64_t) next CACHE_ALIGNED; /* Tagged index of the next node */
+	_Atomic(void *) value;                /* Stored pointer */
+} lf_node_t;
+
+struct lf_queue {
+	lf_node_t *nodes;                 /* capacity + 1 nodes, right after the queue */
+	_Atomic(uint64_t) head CACHE_ALIGNED; /* Dummy node before the oldest entry */
+	_Atomic(uint64_t) tail CACHE_ALIGNED; /* Last node, or one behind it */
+	_Atomic(uint64_t) free CACHE_ALIGNED; /* Free node stack */
+};
+
+struct lf_stack {
+	lf_node_t *nodes;                /* capacity nodes, right after the stack */
+	_Atomic(uint64_t) top CACHE_ALIGNED;  /* Top node */
+	_Atomic(uint64_t) free CACHE_ALIGNED; /* Free node stack */
+};
+
+/**
+ * Allocate size bytes on whole, aligned cache lines of the running CPU.
+ */
+static void *alloc_lines(size_t size)
+{
+	return cache_aligned_alloc(size);
+}
+
+/**
+ * Point a node the caller owns at idx.
+ */
+static inline void link_set(lf_node_t *node, uint32_t idx)
+{
+	uint64_t old = atomic_load_explicit(&node->next, memory_order_relaxed);
+
+	atomic_store_explicit(&node->next, link_pack(idx, LINK_TAG(old) + 1),
+			      memory_order_relaxed);
+}
+
+/**
+ * Chain nodes [first, first + n) into a list and return its tagged head.
+ */
+static uint64_t chain_nodes(lf_node_t *nodes, uint32_t first, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		uint32_t next = i + 1 < n ? first + (uint32_t)i + 1 : LF_NIL;
+
+		atomic_init(&nodes[first + i].next, link_pack(next, 0));
+		atomic_init(&nodes[first + i].value, NULL);
+	}
+	return link_pack(n ? first : LF_NIL, 0);
+}
+
+/**
+ * Push node idx, which the caller owns, onto a Treiber stack of nodes.
+ */
+static void node_push(_Atomic(uint64_t) *head, lf_node_t *nodes, uint32_t idx)
+{
+	uint64_t top = atomic_load_explicit(head, memory_order_relaxed);
+	backoff_t backoff = BACKOFF_INIT;
+
+	for (;;) {
+		link_set(&nodes[idx], LINK_INDEX(top));
+		if (atomic_compare_exchange_weak_explicit(head, &top,
+							  link_pack(idx, LINK_TAG(top) + 1),
+							  memory_order_release,
+							  memory_order_relaxed))
+			return;
+		backoff_pause(&backoff);
+	}
+}
+
+/**
+ * Pop a node off a Treiber stack of nodes.
+ *
+ * @return Index of the node, now owned by the caller, or LF_NIL if empty
+ */
+static uint32_t node_pop(_Atomic(uint64_t) *head, lf_node_t *nodes)
+{
+	uint64_t top = atomic_load_explicit(head, memory_order_acquire);
+	backoff_t backoff = BACKOFF_INIT;
+
+	for (;;) {
+		uint32_t idx = LINK_INDEX(top);
+		if (idx == LF_NIL)
+			return LF_NIL;
+
+		/* May be stale if idx was popped meanwhile; the tag rejects it */
+		uint64_t next = atomic_load_explicit(&nodes[idx].next, memory_order_relaxed);
+		if (atomic_compare_exchange_weak_explicit(head, &top,
+							  link_pack(LINK_INDEX(next),
+								    LINK_TAG(top) + 1),
+							  memory_order_acquire,
+							  memory_order_acquire))
+			return idx;
+		backoff_pause(&backoff);
+	}
+}
+
+lf_ring_t *lf_ring_create(size_t capacity)
+{
+	if (capacity == 0 || capacity > SIZE_MAX / 2 / sizeof(lf_cell_t))
+		return NULL;
+
+	/* Two cells at least, or a full ring reads as empty */
+	size_t n = 2;
+	while (n < capacity)
+		n <<= 1;
+
+	lf_ring_t *ring = alloc_lines(sizeof(lf_ring_t) + n * sizeof(lf_cell_t));
+	if (!ring)
+		return NULL;
+
+	ring->cells = (lf_cell_t *)(ring + 1);
+	ring->mask = n - 1;
+	for (size_t i = 0; i < n; i++) {
+		atomic_init(&ring->cells[i].seq, i);
+		ring->cells[i].data = NULL;
+	}
+	atomic_init(&ring->enqueue_pos, 0);
+	atomic_init(&ring->dequeue_pos, 0);
+	return ring;
+}
+
+int lf_ring_push(lf_ring_t *ring, void *ptr)
+{
+	if (!ring || !ptr)
+		return -1;
+
+	size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+	backoff_t backoff = BACKOFF_INIT;
+	lf_cell_t *cell;
+
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos,
+								  pos + 1,
+								  memory_order_relaxed,
+								  memory_order_relaxed))
+				break;
+			backoff_pause(&backoff);
+		} else if (diff < 0) {
+			return -1; /* Full: the cell still holds last lap's entry */
+		} else {
+			pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+		}
+	}
+
+	cell->data = ptr;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	return 0;
+}
+
+void *lf_ring_pop(lf_ring_t *ring)
+{
+	if (!ring)
+		return NULL;
+
+	size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+	backoff_t backoff = BACKOFF_INIT;
+	lf_cell_t *cell;
+
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos,
+								  pos + 1,
+								  memory_order_relaxed,
+								  memory_order_relaxed))
+				break;
+			backoff_pause(&backoff);
+		} else if (diff < 0) {
+			return NULL; /* Empty: the producer has not filled the cell */
+		} else {
+			pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+		}
+	}
+
+	void *ptr = cell->data;
+	atomic_store_explicit(&cell->seq, pos + ring->mask + 1, memory_order_release);
+	return ptr;
+}
+
+void lf_ring_destroy(lf_ring_t *ring)
+{
+	free(ring);
+}
+
+lf_queue_t *lf_queue_create(size_t capacity)
+{
+	if (capacity == 0 || capacity >= LF_NIL - 1 ||
+	    capacity > (SIZE_MAX - sizeof(lf_queue_t)) / sizeof(lf_node_t) - 1)
+		return NULL;
+
+	lf_queue_t *queue = alloc_lines(sizeof(lf_queue_t) +
+					(capacity + 1) * sizeof(lf_node_t));
+	if (!queue)
+		return NULL;
+
+	/* Node 0 starts as the dummy; the rest are free */
+	queue->nodes = (lf_node_t *)(queue + 1);
+	chain_nodes(queue->nodes, 0, 1);
+	atomic_init(&queue->head, link_pack(0, 0));
+	atomic_init(&queue->tail, link_pack(0, 0));
+	atomic_init(&queue->free, chain_nodes(queue->nodes, 1, capacity));
+	return queue;
+}
+
+int lf_queue_push(lf_queue_t *queue, void *ptr)
+{
+	if (!queue || !ptr)
+		return -1;
+
+	uint32_t idx = node_pop(&queue->free, queue->nodes);
+	if (idx == LF_NIL)
+		return -1;
+
+	lf_node_t *node = &queue->nodes[idx];
+	atomic_store_explicit(&node->value, ptr, memory_order_relaxed);
+	link_set(node, LF_NIL);
+
+	backoff_t backoff = BACKOFF_INIT;
+	uint64_t tail;
+
+	for (;;) {
+		tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+		lf_node_t *last = &queue->nodes[LINK_INDEX(tail)];
+		uint64_t next = atomic_load_explicit(&last->next, memory_order_acquire);
+
+		if (tail != atomic_load_explicit(&queue->tail, memory_order_acquire))
+			continue;
+
+		if (LINK_INDEX(next) == LF_NIL) {
+			/* Link the node after the last one; this publishes it */
+			if (atomic_compare_exchange_weak_explicit(&last->next, &next,
+								  link_pack(idx, LINK_TAG(next) + 1),
+								  memory_order_release,
+								  memory_order_relaxed))
+				break;
+			backoff_pause(&backoff);
+		} else {
+			/* Tail lags behind a finished push: help it along */
+			atomic_compare_exchange_strong_explicit(&queue->tail, &tail,
+								link_pack(LINK_INDEX(next),
+									  LINK_TAG(tail) + 1),
+								memory_order_release,
+								memory_order_relaxed);
+		}
+	}
+
+	/* Swing the tail; if this loses, someone already helped */
+	atomic_compare_exchange_strong_explicit(&queue->tail, &tail,
+						link_pack(idx, LINK_TAG(tail) + 1),
+						memory_order_release, memory_order_relaxed);
+	return 0;
+}
+
+void *lf_queue_pop(lf_queue_t *queue)
+{
+	if (!queue)
+		return NULL;
+
+	backoff_t backoff = BACKOFF_INIT;
+
+	for (;;) {
+		uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+		uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+		uint64_t next = atomic_load_explicit(&queue->nodes[LINK_INDEX(head)].next,
+						     memory_order_acquire);
+
+		if (head != atomic_load_explicit(&queue->head, memory_order_acquire))
+			continue;
+
+		if (LINK_INDEX(head) == LINK_INDEX(tail)) {
+			if (LINK_INDEX(next) == LF_NIL)
+				return NULL; /* Empty: only the dummy left */
+			atomic_compare_exchange_strong_explicit(&queue->tail, &tail,
+								link_pack(LINK_INDEX(next),
+									  LINK_TAG(tail) + 1),
+								memory_order_release,
+								memory_order_relaxed);
+			continue;
+		}
+		if (LINK_INDEX(next) == LF_NIL)
+			continue; /* Stale read of a recycled head */
+
+		/* Read before the CAS: the node becomes the dummy and may be reused */
+		void *ptr = atomic_load_explicit(&queue->nodes[LINK_INDEX(next)].value,
+						 memory_order_relaxed);
+		if (atomic_compare_exchange_weak_explicit(&queue->head, &head,
+							  link_pack(LINK_INDEX(next),
+								    LINK_TAG(head) + 1),
+							  memory_order_acquire,
+							  memory_order_relaxed)) {
+			/* The old dummy is ours now */
+			node_push(&queue->free, queue->nodes, LINK_INDEX(head));
+			return ptr;
+		}
+		backoff_pause(&backoff);
+	}
+}
+
+void lf_queue_destroy(lf_queue_t *queue)
+{
+	free(queue);
+}
+
+lf_stack_t *lf_stack_create(size_t capacity)
+{
+	if (capacity == 0 || capacity >= LF_NIL ||
+	    capacity > (SIZE_MAX - sizeof(lf_stack_t)) / sizeof(lf_node_t))
+		return NULL;
+
+	lf_stack_t *stack = alloc_lines(sizeof(lf_stack_t) + capacity * sizeof(lf_node_t));
+	if (!stack)
+		return NULL;
+
+	stack->nodes = (lf_node_t *)(stack + 1);
+	atomic_init(&stack->top, link_pack(LF_NIL, 0));
+	atomic_init(&stack->free, chain_nodes(stack->nodes, 0, capacity));
+	return stack;
+}
+
+int lf_stack_push(lf_stack_t *stack, void *ptr)
+{
+	if (!stack || !ptr)
+		return -1;
+
+	uint32_t idx = node_pop(&stack->free, stack->nodes);
+	if (idx == LF_NIL)
+		return -1;
+
+	atomic_store_explicit(&stack->nodes[idx].value, ptr, memory_order_relaxed);
+	node_push(&stack->top, stack->nodes, idx);
+	return 0;
+}
+
+void *lf_stack_pop(lf_stack_t *stack)
+{
+	if (!stack)
+		return NULL;
+
+	uint32_t idx = node_pop(&stack->top, stack->nodes);
+	if (idx == LF_NIL)
+		return NULL;
+
+	void *ptr = atomic_load_explicit(&stack->nodes[idx].value, memory_order_relaxed);
+	node_push(&stack->free, stack->nodes, idx);
+	return ptr;
+}
+
+void lf_stack_destroy(lf_stack_t *stack)
+{
+	free(stack);
+}
@@ -0,0 +1,95 @@
+#include "../include/pagemap.h"
+#include <stdlib.h>
+
+_Atomic(pagemap_node_t *) pagemap_root[PAGEMAP_FANOUT];
+
+/**
+ * Get the entry of granule key, creating the interior nodes on the way.
+ * Racing creators settle with a CAS; the loser frees its copy.
+ */
+static pagemap_entry_t *entry_at(uintptr_t key)
+{
+	_Atomic(pagemap_node_t *) *root = &pagemap_root[key >> (2 * PAGEMAP_LEVEL_BITS)];
+	pagemap_node_t *node = atomic_load_explicit(root, memory_order_acquire);
+
+	if (!node) {
+		pagemap_node_t *fresh = calloc(1, sizeof(*fresh));
+		if (!fresh)
+			return NULL;
+		if (atomic_compare_exchange_strong_explicit(root, &node, fresh,
+							    memory_order_acq_rel,
+							    memory_order_acquire))
+			node = fresh;
+		else
+			free(fresh);
+	}
+
+	_Atomic(pagemap_leaf_t *) *slot =
+		&node->leaves[(key >> PAGEMAP_LEVEL_BITS) & (PAGEMAP_FANOUT - 1)];
+	pagemap_leaf_t *leaf = atomic_load_explicit(slot, memory_order_acquire);
+
+	if (!leaf) {
+		pagemap_leaf_t *fresh = calloc(1, sizeof(*fresh));
+		if (!fresh)
+			return NULL;
+		if (atomic_compare_exchange_strong_explicit(slot, &leaf, fresh,
+							    memory_order_acq_rel,
+							    memory_order_acquire))
+			leaf = fresh;
+		else
+			free(fresh);
+	}
+
+	return &leaf->entries[key & (PAGEMAP_FANOUT - 1)];
+}
+
+int pagemap_register(const void *base, size_t size, struct slab_allocator *slab,
+		     void *owner, uint32_t chunk)
+{
+	uintptr_t start = (uintptr_t)base;
+
+	if (!slab || size == 0 || ((start | size) & (PAGEMAP_GRANULE - 1)))
+		return -1;
+	if (start + size < start || (start + size - 1) >> PAGEMAP_ADDR_BITS)
+		return -1;
+
+	uintptr_t first = start >> PAGEMAP_SHIFT;
+	uintptr_t end = first + (size >> PAGEMAP_SHIFT);
+
+	for (uintptr_t key = first; key < end; key++) {
+		pagemap_entry_t *e = entry_at(key);
+		struct slab_allocator *none = NULL;
+
+		/*
+		 * Claim the granule, then fill in the payload. Nobody looks up an
+		 * address of the range before the slab hands out its blocks,
+		 * which happens after this returns.
+		 */
+		if (!e || !atomic_compare_exchange_strong_explicit(&e->slab, &none, slab,
+								   memory_order_acq_rel,
+								   memory_order_relaxed)) {
+			pagemap_unregister(base, (key - first) << PAGEMAP_SHIFT, slab);
+			return -1;
+		}
+		atomic_store_explicit(&e->owner, owner, memory_order_relaxed);
+		atomic_store_explicit(&e->chunk, chunk, memory_order_relaxed);
+	}
+
+	return 0;
+}
+
+void pagemap_unregister(const void *base, size_t size, struct slab_allocator *slab)
+{
+	uintptr_t key = (uintptr_t)base >> PAGEMAP_SHIFT;
+	uintptr_t end = ((uintptr_t)base + size + PAGEMAP_GRANULE - 1) >> PAGEMAP_SHIFT;
+
+	for (; key < end; key++) {
+		const pagemap_entry_t *e = pagemap_lookup((const void *)(key << PAGEMAP_SHIFT));
+		struct slab_allocator *expected = slab;
+
+		if (e)
+			atomic_compare_exchange_strong_explicit(
+				&((pagemap_entry_t *)e)->slab, &expected, NULL,
+				memory_order_release, memory_order_relaxed);
+	}
+}
@@ -2,97 +2,913 @@
 #include "../include/slab.h"
 #include "../include/pool_internal.h"
 #include "../include/align.h"
+#include "../include/pagemap.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdatomic.h>
 #include <assert.h>
 #include <pthread.h>
+#include <time.h>
 
-/* Thread-local storage key */
-static pthread_key_t tls_key;
-static _Atomic(int) tls_initialized = 0;
+/* POOL_F_REMOTE_FREE: default blocks per span */
+#define POOL_DEFAULT_SPAN_BLOCKS 64
+
+/* POOL_F_ADAPTIVE tuning */
+#define POOL_ADAPT_GROW_EVENTS 2    /* Refills/flushes within a tick that grow the magazine */
+#define POOL_ADAPT_MAX_FACTOR  16   /* Default ceiling as a multiple of blocks_per_thread */
+
+/*
+ * Pool registry. Every live pool owns an ID that indexes each thread's slot
+ * table, and a generation that is never reused, so a slot left behind by a
+ * destroyed pool can never be mistaken for a cache of a newer pool that
+ * recycled the same ID. The lock only guards pool creation/destruction and
+ * cache creation/teardown; the alloc/free hot path never takes it.
+ */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static mempool_t *registry[MEMPOOL_MAX_POOLS];
+static uint64_t next_gen = 1;
+
+/* Thread-exit hook: the key only exists to get a destructor callback */
+static pthread_key_t exit_key;
+static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+
+/* fork() handlers, installed with the first pool */
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Decay thread. Every decay_ms it runs slab_decay on the node slabs of
+ * each pool created with decay_ms, so a page goes back to the OS once it
+ * has stayed free for one to two intervals. One thread serves all pools:
+ * it starts with the first such pool and exits once none is left. The
+ * madvise passes run without registry_lock: the pool being decayed is
+ * marked decaying, and pool_destroy waits on decay_idle for the mark to
+ * clear before it frees the slabs.
+ */
+static pthread_cond_t decay_cond;
+static pthread_cond_t decay_idle = PTHREAD_COND_INITIALIZER;
+static pthread_once_t decay_once = PTHREAD_ONCE_INIT;
+static int decay_running; /* registry lock */
+
+/* Per-thread slot table, indexed by pool ID */
+_Thread_local pool_tls_slot_t pool_tls_slots[MEMPOOL_MAX_POOLS];
 
 /**
- * Initialize thread-local storage.
+ * Node slab the calling thread should use.
  */
-static void init_tls(void)
+static inline unsigned int thread_node(mempool_t *pool)
 {
-	if (atomic_exchange(&tls_initialized, 1))
-		return;
-	pthread_key_create(&tls_key, free);
+	if (pool->num_nodes == 1)
+		return 0;
+	return topo_current_node() % pool->num_nodes;
 }
 
 /**
- * Get or create thread-local cache.
+ * Return one block to the slab it came from. node is the freeing thread's
+ * node, which is checked first and used to count remote frees.
  */
-static thread_local_cache_t *get_thread_local_cache(size_t blocks_per_thread)
+static int return_block(mempool_t *pool, unsigned int node, void *ptr)
 {
-	thread_local_cache_t *cache = pthread_getspecific(tls_key);
-	if (cache)
-		return cache;
+	if (pool->num_nodes == 1)
+		return slab_free(pool->global_slab, ptr);
 
-	/* Create new cache */
-	cache = malloc(sizeof(thread_local_cache_t));
-	if (!cache)
+	for (unsigned int i = 0; i < pool->num_nodes; i++) {
+		unsigned int n = (node + i) % pool->num_nodes;
+
+		if (!slab_owns(pool->node_slabs[n], ptr))
+			continue;
+		if (n != node)
+			atomic_fetch_add_explicit(&pool->remote_frees, 1,
+						  memory_order_relaxed);
+		return slab_free(pool->node_slabs[n], ptr);
+	}
+
+	return -1;
+}
+
+/**
+ * Return a batch of blocks. Blocks of the local node go back in one batch;
+ * the rest are routed one by one to their own node slab.
+ */
+static int return_batch(mempool_t *pool, unsigned int node, void **ptrs, size_t n)
+{
+	if (pool->num_nodes == 1)
+		return slab_free_batch(pool->global_slab, ptrs, n);
+
+	slab_allocator_t *local = pool->node_slabs[node];
+	size_t nlocal = 0;
+	int ret = 0;
+
+	/* Partition local blocks to the front */
+	for (size_t i = 0; i < n; i++) {
+		if (slab_owns(local, ptrs[i])) {
+			void *tmp = ptrs[nlocal];
+			ptrs[nlocal++] = ptrs[i];
+			ptrs[i] = tmp;
+		}
+	}
+
+	for (size_t i = nlocal; i < n; i++) {
+		if (return_block(pool, node, ptrs[i]) != 0)
+			ret = -1;
+	}
+
+	if (nlocal && slab_free_batch(local, ptrs, nlocal) != 0)
+		ret = -1;
+	return ret;
+}
+
+/**
+ * Blocks moved per refill or flush. Adaptive magazines move half of
+ * their current capacity with POOL_F_BATCH; others use the pool setting.
+ */
+static inline size_t cache_batch(const mempool_t *pool, const thread_local_cache_t *cache)
+{
+	if (!(pool->flags & POOL_F_ADAPTIVE))
+		return pool->batch;
+	if (!(pool->flags & POOL_F_BATCH) || cache->mag.size < 2)
+		return 1;
+	return cache->mag.size / 2;
+}
+
+/**
+ * Refill an empty magazine from the thread's node, stealing from the other
+ * nodes in order only when the local slab is exhausted.
+ */
+static size_t numa_refill(mempool_t *pool, thread_local_cache_t *cache)
+{
+	unsigned int node = thread_node(pool);
+
+	cache->node = node;
+	for (unsigned int i = 0; i < pool->num_nodes; i++) {
+		unsigned int n = (node + i) % pool->num_nodes;
+		size_t got = slab_alloc_batch(pool->node_slabs[n], cache->mag.blocks,
+					      cache_batch(pool, cache));
+
+		if (got == 0)
+			continue;
+		atomic_fetch_add_explicit(i ? &pool->remote_blocks : &pool->local_blocks,
+					  got, memory_order_relaxed);
+		return got;
+	}
+
+	return 0;
+}
+
+/**
+ * Map a block of a POOL_F_REMOTE_FREE pool to its span header.
+ * Returns NULL if ptr is not a block boundary inside one of the pool's spans.
+ */
+static pool_span_t *span_of(mempool_t *pool, void *ptr)
+{
+	uintptr_t p = (uintptr_t)ptr;
+	uintptr_t base = p & ~(uintptr_t)(pool->span_bytes - 1);
+
+	if (!slab_owns(pool->global_slab, (void *)base))
+		return NULL;
+	if (p < base + pool->span_header)
 		return NULL;
 
-	cache->local_cache = malloc(blocks_per_thread * sizeof(void *));
-	if (!cache->local_cache) {
-		free(cache);
+	size_t offset = p - base - pool->span_header;
+	if (offset % pool->block_size || offset / pool->block_size >= pool->span_blocks)
 		return NULL;
+
+	pool_span_t *span = (pool_span_t *)base;
+	return span->pool == pool ? span : NULL;
+}
+
+/**
+ * Push a block freed by another thread onto its owner's remote-free list.
+ * Lock-free multi-producer push; only the owner ever takes from the list,
+ * and it takes the whole list at once, so there is no ABA window.
+ */
+static void remote_push(thread_local_cache_t *owner, void *ptr)
+{
+	pool_free_node_t *node = ptr;
+	void *head = atomic_load_explicit(&owner->remote_head, memory_order_relaxed);
+
+	do {
+		node->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&owner->remote_head, &head, node,
+							memory_order_release,
+							memory_order_relaxed));
+}
+
+/**
+ * Refill an empty magazine of a POOL_F_REMOTE_FREE pool: first from the
+ * owner's private free list, then from a batch drain of the remote-free
+ * list, then by carving the newest span, and finally from a new span.
+ */
+static size_t span_refill(mempool_t *pool, thread_local_cache_t *cache)
+{
+	size_t want = cache_batch(pool, cache);
+	size_t got = 0;
+
+	if (!cache->local_free)
+		cache->local_free = atomic_exchange_explicit(&cache->remote_head, NULL,
+							     memory_order_acquire);
+
+	while (got < want && cache->local_free) {
+		pool_free_node_t *node = cache->local_free;
+
+		cache->local_free = node->next;
+		cache->mag.blocks[got++] = node;
+	}
+
+	while (got < want) {
+		if (cache->carve == cache->carve_end) {
+			pool_span_t *span = slab_alloc(pool->global_slab);
+			if (!span)
+				break;
+
+			span->owner = cache;
+			span->pool = pool;
+			cache->carve = (uint8_t *)span + pool->span_header;
+			cache->carve_end = cache->carve + pool->span_blocks * pool->block_size;
+		}
+
+		cache->mag.blocks[got++] = cache->carve;
+		cache->carve += pool->block_size;
+	}
+
+	return got;
+}
+
+/**
+ * Record the magazine occupancy after a push in the high-water mark.
+ */
+static inline void note_high_water(pool_magazine_t *mag)
+{
+	if (mag->count > atomic_load_explicit(&mag->high_water, memory_order_relaxed))
+		atomic_store_explicit(&mag->high_water, mag->count, memory_order_relaxed);
+}
+
+/**
+ * Double an adaptive magazine, up to the per-thread ceiling and within
+ * what is left of the pool's cache_limit.
+ */
+static void adapt_grow(mempool_t *pool, thread_local_cache_t *cache)
+{
+	size_t size = cache->mag.size;
+	size_t want = 2 * size < pool->max_blocks_per_thread ? 2 * size
+							      : pool->max_blocks_per_thread;
+	size_t extra = want > size ? want - size : 0;
+
+	if (extra == 0)
+		return;
+
+	/* Reserve the extra capacity against the pool-wide bound */
+	size_t cur = atomic_load_explicit(&pool->cache_capacity, memory_order_relaxed);
+	do {
+		if (pool->cache_limit) {
+			if (cur >= pool->cache_limit)
+				return;
+			if (extra > pool->cache_limit - cur)
+				extra = pool->cache_limit - cur;
+		}
+	} while (!atomic_compare_exchange_weak_explicit(&pool->cache_capacity, &cur, cur + extra,
+							memory_order_relaxed,
+							memory_order_relaxed));
+
+	if (size + extra > cache->blocks_cap) {
+		void **blocks = realloc(cache->mag.blocks, (size + extra) * sizeof(void *));
+		if (!blocks) {
+			atomic_fetch_sub_explicit(&pool->cache_capacity, extra,
+						  memory_order_relaxed);
+			return;
+		}
+		cache->mag.blocks = blocks;
+		cache->blocks_cap = size + extra;
+	}
+
+	cache->mag.size = size + extra;
+	POOL_STAT_INC(cache->grows);
+}
+
+/**
+ * End of an adaptive tick: hand back blocks that sat in the magazine for
+ * the whole interval, halve the capacity of a magazine that needed no
+ * refill or flush and ends up at most half full, and start the next
+ * interval. The oldest blocks sit at the bottom of the magazine, so those
+ * go first.
+ */
+static inline size_t cache_hits(thread_local_cache_t *cache)
+{
+	return atomic_load_explicit(&cache->mag.alloc_hits, memory_order_relaxed) +
+	       atomic_load_explicit(&cache->mag.free_hits, memory_order_relaxed);
+}
+
+static void adapt_tick(mempool_t *pool, thread_local_cache_t *cache)
+{
+	pool_magazine_t *mag = &cache->mag;
+	size_t n = mag->low_water - mag->low_water / 4;
+	size_t size = mag->size;
+
+	if (cache->slow_events == 0 && size > pool->blocks_per_thread) {
+		size = size / 2 > pool->blocks_per_thread ? size / 2 : pool->blocks_per_thread;
+		if (mag->count - n > size)
+			size = mag->size; /* Still in use: keep the capacity */
+	}
+
+	if (n > 0) {
+		return_batch(pool, cache->node, mag->blocks, n);
+		memmove(mag->blocks, mag->blocks + n, (mag->count - n) * sizeof(void *));
+		mag->count -= n;
+		POOL_STAT_ADD(cache->idle_returned, n);
+	}
+
+	if (size < mag->size) {
+		atomic_fetch_sub_explicit(&pool->cache_capacity, mag->size - size,
+					  memory_order_relaxed);
+		mag->size = size;
+		POOL_STAT_INC(cache->shrinks);
+	}
+
+	mag->low_water = mag->count;
+	cache->slow_events = 0;
+	cache->tick_hits = cache_hits(cache);
+}
+
+/**
+ * Account a refill or flush of an adaptive magazine: the second one within
+ * a tick grows the magazine. Threads that mostly miss (producers) see few
+ * fast-path free hits, so the tick is also checked here.
+ */
+static void adapt_slow_event(mempool_t *pool, thread_local_cache_t *cache)
+{
+	if (cache_hits(cache) - cache->tick_hits >= POOL_ADAPT_INTERVAL)
+		adapt_tick(pool, cache);
+	if (++cache->slow_events >= POOL_ADAPT_GROW_EVENTS) {
+		cache->slow_events = 0;
+		adapt_grow(pool, cache);
+	}
+}
+
+void pool_adapt_tick(mempool_t *pool)
+{
+	adapt_tick(pool, (thread_local_cache_t *)pool_tls_slots[pool->head.id].magazine);
+}
+
+/**
+ * Hand the retired blocks of an exiting thread to the pool; the next
+ * epoch advance past their grace period frees them. Should the bag copy
+ * fail, the blocks stay allocated until pool_destroy. Caller holds
+ * registry_lock.
+ */
+static void ebr_orphan(mempool_t *pool, thread_local_cache_t *cache)
+{
+	atomic_store_explicit(&cache->ebr_active, 0, memory_order_release);
+	cache->ebr_nest = 0;
+
+	for (size_t i = 0; i < POOL_EBR_BAGS; i++) {
+		pool_ebr_bag_t *bag = &cache->ebr_bags[i];
+		pool_ebr_bag_t *orphan;
+
+		if (bag->count == 0 || !(orphan = malloc(sizeof(*orphan))))
+			continue;
+		*orphan = *bag;
+		orphan->next = pool->ebr_orphans;
+		pool->ebr_orphans = orphan;
+		bag->ptrs = NULL;
+		bag->count = 0;
+		bag->cap = 0;
+	}
+}
+
+/**
+ * Return all cached blocks to the pool's slab and release the cache.
+ * Blocks of POOL_F_REMOTE_FREE pools live in spans and go away with the
+ * slab. Caller holds registry_lock.
+ */
+static void release_cache(mempool_t *pool, thread_local_cache_t *cache)
+{
+	size_t count = cache->mag.count;
+	pool_stats_ex_t *r = &pool->retired;
+
+	/* Keep the exiting thread's counters in the pool totals */
+	r->alloc_hits += atomic_load(&cache->mag.alloc_hits);
+	r->free_hits += atomic_load(&cache->mag.free_hits);
+	r->misses += atomic_load(&cache->misses);
+	r->refills += atomic_load(&cache->refills);
+	r->flushes += atomic_load(&cache->flushes);
+	r->remote_frees += atomic_load(&cache->remote_frees);
+	r->grows += atomic_load(&cache->grows);
+	r->shrinks += atomic_load(&cache->shrinks);
+	r->idle_returned += atomic_load(&cache->idle_returned);
+	r->ebr_retired += atomic_load(&cache->ebr_retired);
+	r->ebr_reclaimed += atomic_load(&cache->ebr_reclaimed);
+	if (atomic_load(&cache->mag.high_water) > r->high_water)
+		r->high_water = atomic_load(&cache->mag.high_water);
+	if (pool->flags & POOL_F_ADAPTIVE)
+		atomic_fetch_sub(&pool->cache_capacity, cache->mag.size);
+
+	if (pool->flags & POOL_F_REMOTE_FREE)
+		count = 0;
+
+	for (size_t i = 0; i < count; i++)
+		return_block(pool, cache->node, cache->mag.blocks[i]);
+
+	ebr_orphan(pool, cache);
+	for (size_t i = 0; i < POOL_EBR_BAGS; i++)
+		free(cache->ebr_bags[i].ptrs);
+	free(cache->mag.blocks);
+	free(cache);
+}
+
+/**
+ * Thread-exit destructor: flush every cache this thread holds for a pool
+ * that is still alive. Caches of POOL_F_REMOTE_FREE pools own spans that
+ * other threads may still free into, so they are parked instead.
+ */
+static void thread_exit(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&registry_lock);
+	for (size_t id = 0; id < MEMPOOL_MAX_POOLS; id++) {
+		pool_tls_slot_t *slot = &pool_tls_slots[id];
+		thread_local_cache_t *cache = (thread_local_cache_t *)slot->magazine;
+		mempool_t *pool = registry[id];
+
+		if (slot->gen && pool && pool->head.gen == slot->gen &&
+		    (pool->flags & POOL_F_REMOTE_FREE)) {
+			ebr_orphan(pool, cache);
+			cache->parked = 1;
+		} else if (slot->gen && pool && pool->head.gen == slot->gen) {
+			thread_local_cache_t **link = &pool->caches;
+
+			while (*link && *link != cache)
+				link = &(*link)->next;
+			if (*link)
+				*link = cache->next;
+			release_cache(pool, cache);
+		}
+
+		slot->magazine = NULL;
+		slot->gen = 0;
+	}
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/**
+ * Create the thread-exit key.
+ */
+static void init_exit_key(void)
+{
+	pthread_key_create(&exit_key, thread_exit);
+}
+
+/**
+ * Create this thread's cache for pool and install it in the slot table.
+ */
+static thread_local_cache_t *create_thread_local_cache(mempool_t *pool)
+{
+	pthread_once(&exit_once, init_exit_key);
+	if (!pthread_getspecific(exit_key))
+		pthread_setspecific(exit_key, pool_tls_slots);
+
+	/* Adopt a cache parked by an exited thread, spans and all */
+	thread_local_cache_t *cache = NULL;
+	if (pool->flags & POOL_F_REMOTE_FREE) {
+		pthread_mutex_lock(&registry_lock);
+		for (cache = pool->caches; cache && !cache->parked; cache = cache->next)
+			;
+		if (cache)
+			cache->parked = 0;
+		pthread_mutex_unlock(&registry_lock);
 	}
 
-	cache->cache_size = blocks_per_thread;
-	atomic_store(&cache->cache_count, 0);
+	if (!cache) {
+		/* Aligned so the remote-free head gets its own cache line */
+		cache = cache_aligned_alloc(sizeof(thread_local_cache_t));
+		if (!cache)
+			return NULL;
 
-	pthread_setspecific(tls_key, cache);
+		cache->mag.blocks = malloc(pool->blocks_per_thread * sizeof(void *));
+		if (!cache->mag.blocks) {
+			free(cache);
+			return NULL;
+		}
+
+		cache->blocks_cap = pool->blocks_per_thread;
+		cache->mag.size = pool->blocks_per_thread;
+		cache->mag.count = 0;
+		cache->mag.low_water = 0;
+		cache->slow_events = 0;
+		cache->tick_hits = 0;
+		atomic_store(&cache->mag.alloc_hits, 0);
+		atomic_store(&cache->mag.free_hits, 0);
+		atomic_store(&cache->mag.high_water, 0);
+		atomic_store(&cache->misses, 0);
+		atomic_store(&cache->refills, 0);
+		atomic_store(&cache->flushes, 0);
+		atomic_store(&cache->remote_frees, 0);
+		atomic_store(&cache->grows, 0);
+		atomic_store(&cache->shrinks, 0);
+		atomic_store(&cache->idle_returned, 0);
+		atomic_store(&cache->ebr_retired, 0);
+		atomic_store(&cache->ebr_reclaimed, 0);
+		atomic_store(&cache->ebr_active, 0);
+		cache->ebr_nest = 0;
+		cache->ebr_since = 0;
+		memset(cache->ebr_bags, 0, sizeof(cache->ebr_bags));
+		if (pool->flags & POOL_F_ADAPTIVE)
+			atomic_fetch_add(&pool->cache_capacity, cache->mag.size);
+		cache->pool = pool;
+		cache->node = thread_node(pool);
+		cache->parked = 0;
+		cache->local_free = NULL;
+		cache->carve = NULL;
+		cache->carve_end = NULL;
+		atomic_store(&cache->remote_head, NULL);
+
+		pthread_mutex_lock(&registry_lock);
+		cache->next = pool->caches;
+		pool->caches = cache;
+		pthread_mutex_unlock(&registry_lock);
+	}
+
+	pool_tls_slots[pool->head.id].magazine = &cache->mag;
+	pool_tls_slots[pool->head.id].gen = pool->head.gen;
 	return cache;
 }
 
+/**
+ * Get or create this thread's cache for pool.
+ * O(1): one slot table index and a generation compare.
+ */
+static inline thread_local_cache_t *get_thread_local_cache(mempool_t *pool)
+{
+	pool_tls_slot_t *slot = &pool_tls_slots[pool->head.id];
+
+	if (slot->gen == pool->head.gen)
+		return (thread_local_cache_t *)slot->magazine;
+
+	return create_thread_local_cache(pool);
+}
+
 mempool_t *pool_create(size_t block_size, size_t blocks_per_thread,
 		       size_t total_blocks)
 {
-	if (block_size == 0 || blocks_per_thread == 0 || total_blocks == 0)
+	pool_config_t cfg = {
+		.block_size = block_size,
+		.blocks_per_thread = blocks_per_thread,
+		.total_blocks = total_blocks,
+		.align = MEMPOOL_ALIGN_CACHE_LINE,
+	};
+
+	return pool_create_ex(&cfg);
+}
+
+/**
+ * Monotonic clock in milliseconds.
+ */
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void init_decay_cond(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&decay_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void *decay_main(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&registry_lock);
+	for (;;) {
+		uint64_t now = now_ms();
+		uint64_t next = UINT64_MAX;
+
+		for (size_t id = 0; id < MEMPOOL_MAX_POOLS; id++) {
+			mempool_t *pool = registry[id];
+
+			if (!pool || !pool->decay_ms)
+				continue;
+			if (pool->decay_next <= now) {
+				pool->decay_next = now + pool->decay_ms;
+				pool->decaying = 1;
+				pthread_mutex_unlock(&registry_lock);
+
+				for (unsigned int n = 0; n < pool->num_nodes; n++)
+					slab_decay(pool->node_slabs[n]);
+
+				pthread_mutex_lock(&registry_lock);
+				pool->decaying = 0;
+				pthread_cond_broadcast(&decay_idle);
+				if (registry[id] != pool)
+					continue; /* pool_destroy is waiting for it */
+			}
+			if (pool->decay_next < next)
+				next = pool->decay_next;
+		}
+		if (next == UINT64_MAX)
+			break;
+
+		struct timespec ts = { .tv_sec = (time_t)(next / 1000),
+				       .tv_nsec = (long)(next % 1000) * 1000000 };
+		pthread_cond_timedwait(&decay_cond, &registry_lock, &ts);
+	}
+	decay_running = 0;
+	pthread_mutex_unlock(&registry_lock);
+
+	return NULL;
+}
+
+/**
+ * Start the decay thread, or wake it to pick up a new pool. Without the
+ * thread, pool_trim still works. Caller holds registry_lock.
+ */
+static void decay_start(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	if (decay_running) {
+		pthread_cond_signal(&decay_cond);
+		return;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, decay_main, NULL) == 0)
+		decay_running = 1;
+	pthread_attr_destroy(&attr);
+}
+
+/**
+ * Before fork(): take every pool lock so the child never inherits one held
+ * by a thread that does not exist there. Registry first, then each slab's
+ * grow lock: a decay pass in progress holds a grow lock without the
+ * registry, and finishes before it asks for the registry again.
+ */
+static void fork_prepare(void)
+{
+	pthread_mutex_lock(&registry_lock);
+	for (size_t id = 0; id < MEMPOOL_MAX_POOLS; id++) {
+		mempool_t *pool = registry[id];
+
+		for (unsigned int n = 0; pool && n < pool->num_nodes; n++)
+			slab_fork_lock(pool->node_slabs[n]);
+	}
+}
+
+/**
+ * After fork(), in parent and child: drop the locks fork_prepare took.
+ * In the child the caches of threads that were not forked stay listed
+ * but unused; their blocks are lost to the child only.
+ */
+static void fork_release(void)
+{
+	for (size_t id = 0; id < MEMPOOL_MAX_POOLS; id++) {
+		mempool_t *pool = registry[id];
+
+		for (unsigned int n = 0; pool && n < pool->num_nodes; n++)
+			slab_fork_unlock(pool->node_slabs[n]);
+	}
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/**
+ * After fork(), in the child: the decay thread was not forked, and the
+ * condition variables may still count it or a pool_destroy as a waiter.
+ * Drop its decaying mark and start a fresh one.
+ */
+static void fork_child(void)
+{
+	pthread_cond_init(&decay_idle, NULL);
+	for (size_t id = 0; id < MEMPOOL_MAX_POOLS; id++) {
+		if (registry[id])
+			registry[id]->decaying = 0;
+	}
+
+	if (decay_running) {
+		init_decay_cond();
+		decay_running = 0;
+		decay_start();
+	}
+	fork_release();
+}
+
+static void init_fork_handlers(void)
+{
+	pthread_atfork(fork_prepare, fork_release, fork_child);
+}
+
+mempool_t *pool_create_ex(const pool_config_t *cfg)
+{
+	if (!cfg || cfg->block_size == 0 || cfg->blocks_per_thread == 0)
+		return NULL;
+	if (cfg->total_blocks == 0 && !(cfg->slab_flags & SLAB_F_GROW))
+		return NULL;
+	if ((cfg->flags & POOL_F_NUMA) && (cfg->flags & POOL_F_REMOTE_FREE))
+		return NULL;
+	if ((cfg->flags & POOL_F_ADAPTIVE) && (cfg->flags & POOL_F_REMOTE_FREE))
+		return NULL;
+	/* Remote-free lists are threaded through the blocks themselves */
+	if ((cfg->ctor || cfg->dtor) && (cfg->flags & POOL_F_REMOTE_FREE))
 		return NULL;
 
-	init_tls();
+	size_t block_size = cfg->block_size;
+	size_t blocks_per_thread = cfg->blocks_per_thread;
+	size_t total_blocks = cfg->total_blocks;
 
-	mempool_t *pool = malloc(sizeof(mempool_t));
+	/* Shared counters sit on lines of their own, sized for the running CPU */
+	mempool_t *pool = cache_aligned_alloc(sizeof(mempool_t));
 	if (!pool)
 		return NULL;
+	memset(pool, 0, sizeof(*pool));
 
-	/* Create global slab allocator */
-	pool->global_slab = slab_create(block_size, total_blocks);
-	if (!pool->global_slab) {
-		free(pool);
-		return NULL;
+	/*
+	 * Remote-free pools carve blocks out of spans. A span is a power of two
+	 * aligned to its own size, so a block finds its header with one mask.
+	 */
+	if (cfg->flags & POOL_F_REMOTE_FREE) {
+		size_t align = resolve_alignment(cfg->align);
+		if (!align) {
+			free(pool);
+			return NULL;
+		}
+
+		size_t want = cfg->span_blocks ? cfg->span_blocks : POOL_DEFAULT_SPAN_BLOCKS;
+		block_size = align_up(block_size, align);
+		pool->span_header = align_up(sizeof(pool_span_t), align);
+		pool->span_bytes = 1;
+		while (pool->span_bytes < pool->span_header + want * block_size)
+			pool->span_bytes <<= 1;
+		pool->span_blocks = (pool->span_bytes - pool->span_header) / block_size;
+	}
+
+	/* Create the global slab, or one per node split evenly */
+	unsigned int nodes = 1;
+	if (cfg->flags & POOL_F_NUMA) {
+		nodes = cfg->numa_nodes ? cfg->numa_nodes : topo_node_count();
+		if (nodes > TOPO_MAX_NODES)
+			nodes = TOPO_MAX_NODES;
 	}
 
+	for (unsigned int node = 0; node < nodes; node++) {
+		mempool_backing_t backing;
+		slab_config_t slab_cfg = {
+			.block_size = block_size,
+			.num_blocks = (total_blocks + nodes - 1) / nodes,
+			.align = cfg->align,
+			.flags = cfg->slab_flags,
+			.chunk_blocks = cfg->chunk_blocks,
+			.max_blocks = (cfg->max_blocks + nodes - 1) / nodes,
+			.backing = cfg->backing,
+			.ctor = cfg->ctor,
+			.dtor = cfg->dtor,
+			.obj_arg = cfg->obj_arg,
+		};
+
+		if (cfg->flags & POOL_F_REGISTER) {
+			slab_cfg.flags |= SLAB_F_REGISTER;
+			slab_cfg.owner = pool;
+		}
+		if (cfg->flags & POOL_F_PREFETCH)
+			slab_cfg.flags |= SLAB_F_PREFETCH;
+
+		if (cfg->flags & POOL_F_NUMA) {
+			backing = backing_on_node(cfg->backing, (int)node);
+			slab_cfg.backing = &backing;
+		}
+
+		/* The slab deals in spans; block counts round up to whole spans */
+		if (cfg->flags & POOL_F_REMOTE_FREE) {
+			size_t per = pool->span_blocks;
+
+			slab_cfg.block_size = pool->span_bytes;
+			slab_cfg.align = pool->span_bytes;
+			slab_cfg.num_blocks = (total_blocks + per - 1) / per;
+			slab_cfg.chunk_blocks = (cfg->chunk_blocks + per - 1) / per;
+			slab_cfg.max_blocks = (cfg->max_blocks + per - 1) / per;
+		}
+
+		pool->node_slabs[node] = slab_create_ex(&slab_cfg);
+		if (!pool->node_slabs[node]) {
+			for (unsigned int i = 0; i < node; i++)
+				slab_destroy(pool->node_slabs[i]);
+			free(pool);
+			return NULL;
+		}
+	}
+	pool->num_nodes = nodes;
+	pool->global_slab = pool->node_slabs[0];
+
 	pool->block_size = block_size;
 	pool->blocks_per_thread = blocks_per_thread;
+	pool->flags = cfg->flags;
+	pool->batch = (cfg->flags & POOL_F_BATCH) ? blocks_per_thread / 2 : 1;
+	if (pool->batch == 0)
+		pool->batch = 1;
+	pool->max_blocks_per_thread = cfg->max_blocks_per_thread
+		? cfg->max_blocks_per_thread : POOL_ADAPT_MAX_FACTOR * blocks_per_thread;
+	if (pool->max_blocks_per_thread < blocks_per_thread)
+		pool->max_blocks_per_thread = blocks_per_thread;
+	pool->cache_limit = cfg->cache_limit;
+	pool->caches = NULL;
+	/* Remote-free pools must look up the span owner on every free */
+	pool->head.free_fast = !(cfg->flags & POOL_F_REMOTE_FREE);
+	pool->head.adaptive = !!(cfg->flags & POOL_F_ADAPTIVE);
+	pool->head.prefetch = !!(cfg->flags & POOL_F_PREFETCH);
+	pool->decay_ms = cfg->decay_ms;
+	if (pool->decay_ms) {
+		pthread_once(&decay_once, init_decay_cond);
+		pool->decay_next = now_ms() + pool->decay_ms;
+	}
+
+	/* Claim a free pool ID */
+	pthread_once(&fork_once, init_fork_handlers);
+	pthread_mutex_lock(&registry_lock);
+	size_t id = 0;
+	while (id < MEMPOOL_MAX_POOLS && registry[id])
+		id++;
+	if (id == MEMPOOL_MAX_POOLS) {
+		pthread_mutex_unlock(&registry_lock);
+		for (unsigned int i = 0; i < pool->num_nodes; i++)
+			slab_destroy(pool->node_slabs[i]);
+		free(pool);
+		return NULL;
+	}
+	pool->head.id = id;
+	pool->head.gen = next_gen++;
+	registry[id] = pool;
+	if (pool->decay_ms)
+		decay_start();
+	pthread_mutex_unlock(&registry_lock);
+
 	atomic_store(&pool->initialized, 1);
 
 	return pool;
 }
 
-void *pool_alloc(mempool_t *pool)
+void *pool_alloc_slow(mempool_t *pool)
 {
 	if (!pool || !atomic_load(&pool->initialized))
 		return NULL;
 
 	/* Get or create thread-local cache */
-	thread_local_cache_t *cache = get_thread_local_cache(pool->blocks_per_thread);
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
 	if (!cache)
 		return NULL;
 
-	/* Try to allocate from thread-local cache */
-	size_t cache_count = atomic_load(&cache->cache_count);
-	if (cache_count > 0) {
-		size_t new_count = cache_count - 1;
-		if (atomic_compare_exchange_strong(&cache->cache_count, &cache_count,
-						   new_count)) {
-			return cache->local_cache[new_count];
-		}
+	/* A freshly created or adopted cache may already hold blocks */
+	if (cache->mag.count > 0) {
+		POOL_STAT_INC(cache->mag.alloc_hits);
+		if (cache->mag.count - 1 < cache->mag.low_water)
+			cache->mag.low_water = cache->mag.count - 1;
+		return cache->mag.blocks[--cache->mag.count];
+	}
+
+	POOL_STAT_INC(cache->misses);
+	LATENCY_START(t0);
+
+	/* Repeated misses grow the magazine, and with it the refill batch */
+	if (pool->flags & POOL_F_ADAPTIVE)
+		adapt_slow_event(pool, cache);
+
+	/* Cache miss: drain remote frees or carve from owned spans */
+	if (pool->flags & POOL_F_REMOTE_FREE) {
+		size_t got = span_refill(pool, cache);
+		if (got == 0)
+			return NULL;
+		POOL_STAT_INC(cache->refills);
+		LATENCY_END(LAT_EV_POOL_REFILL, t0);
+		cache->mag.count = got - 1;
+		return cache->mag.blocks[got - 1];
+	}
+
+	/* Cache miss: refill from the local node first */
+	if (pool->num_nodes > 1) {
+		size_t got = numa_refill(pool, cache);
+		if (got == 0)
+			return NULL;
+		POOL_STAT_INC(cache->refills);
+		LATENCY_END(LAT_EV_POOL_REFILL, t0);
+		cache->mag.count = got - 1;
+		return cache->mag.blocks[got - 1];
+	}
+
+	/* Cache miss: refill half a magazine in one reservation */
+	if (cache_batch(pool, cache) > 1) {
+		size_t got = slab_alloc_batch(pool->global_slab, cache->mag.blocks,
+					      cache_batch(pool, cache));
+		if (got == 0)
+			return NULL;
+		POOL_STAT_INC(cache->refills);
+		LATENCY_END(LAT_EV_POOL_REFILL, t0);
+		cache->mag.count = got - 1;
+		return cache->mag.blocks[got - 1];
 	}
 
 	/* Cache miss: allocate from global slab */
@@ -103,28 +919,442 @@ void *pool_alloc(mempool_t *pool)
 	return ptr;
 }
 
-int pool_free(mempool_t *pool, void *ptr)
+void *pool_alloc(mempool_t *pool)
+{
+	if (!pool)
+		return NULL;
+
+	return pool_alloc_fast(pool);
+}
+
+int pool_free_slow(mempool_t *pool, void *ptr)
 {
 	if (!pool || !ptr || !atomic_load(&pool->initialized))
 		return -1;
 
+	/* Remote-free pools: a block goes back to the cache that owns its span */
+	if (pool->flags & POOL_F_REMOTE_FREE) {
+		pool_span_t *span = span_of(pool, ptr);
+		if (!span)
+			return -1;
+
+		thread_local_cache_t *cache = get_thread_local_cache(pool);
+		if (span->owner != cache) {
+			remote_push(span->owner, ptr);
+			if (cache)
+				POOL_STAT_INC(cache->remote_frees);
+			return 0;
+		}
+
+		POOL_STAT_INC(cache->mag.free_hits);
+		if (cache->mag.count < cache->mag.size) {
+			cache->mag.blocks[cache->mag.count++] = ptr;
+			note_high_water(&cache->mag);
+			return 0;
+		}
+
+		/* Magazine full: keep the block on the private list */
+		pool_free_node_t *node = ptr;
+		node->next = cache->local_free;
+		cache->local_free = node;
+		return 0;
+	}
+
 	/* Get thread-local cache */
-	thread_local_cache_t *cache = get_thread_local_cache(pool->blocks_per_thread);
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
 	if (!cache)
-		return slab_free(pool->global_slab, ptr);
+		return return_block(pool, thread_node(pool), ptr);
 
 	/* Try to add to thread-local cache */
-	size_t cache_count = atomic_load(&cache->cache_count);
-	if (cache_count < pool->blocks_per_thread) {
-		if (atomic_compare_exchange_strong(&cache->cache_count, &cache_count,
-						   cache_count + 1)) {
-			cache->local_cache[cache_count] = ptr;
+	if (cache->mag.count < cache->mag.size) {
+		POOL_STAT_INC(cache->mag.free_hits);
+		cache->mag.blocks[cache->mag.count++] = ptr;
+		note_high_water(&cache->mag);
+		return 0;
+	}
+
+	/* Repeated overflows grow the magazine; the free may then fit */
+	if (pool->flags & POOL_F_ADAPTIVE) {
+		adapt_slow_event(pool, cache);
+		if (cache->mag.count < cache->mag.size) {
+			POOL_STAT_INC(cache->mag.free_hits);
+			cache->mag.blocks[cache->mag.count++] = ptr;
+			note_high_water(&cache->mag);
 			return 0;
 		}
 	}
 
+	POOL_STAT_INC(cache->flushes);
+	LATENCY_START(t0);
+
+	/*
+	 * Cache full: flush the oldest blocks at the bottom of the magazine in
+	 * one reservation and slide the recently freed, cache-hot ones down,
+	 * so the next allocations still get those.
+	 */
+	size_t batch = cache_batch(pool, cache);
+	if (batch > 1) {
+		size_t keep = cache->mag.count - batch;
+		return_batch(pool, cache->node, cache->mag.blocks, batch);
+		memmove(cache->mag.blocks, cache->mag.blocks + batch, keep * sizeof(void *));
+		cache->mag.blocks[keep] = ptr;
+		cache->mag.count = keep + 1;
+		if (cache->mag.count < cache->mag.low_water)
+			cache->mag.low_water = cache->mag.count;
+		LATENCY_END(LAT_EV_POOL_FLUSH, t0);
+		return 0;
+	}
+
 	/* Cache full: free to global slab */
-	return slab_free(pool->global_slab, ptr);
+	int ret = return_block(pool, cache->node, ptr);
+	LATENCY_END(LAT_EV_POOL_FLUSH, t0);
+	return ret;
+}
+
+int pool_free(mempool_t *pool, void *ptr)
+{
+	if (!pool || !ptr)
+		return -1;
+
+	return pool_free_fast(pool, ptr);
+}
+
+int mempool_free_any(void *ptr)
+{
+	const pagemap_entry_t *e = pagemap_lookup(ptr);
+
+	if (!e)
+		return -1;
+
+	mempool_t *pool = atomic_load_explicit(&e->owner, memory_order_relaxed);
+	if (pool)
+		return pool_free_fast(pool, ptr);
+	return slab_free(atomic_load_explicit(&e->slab, memory_order_relaxed), ptr);
+}
+
+int pool_free_n(mempool_t *pool, void **ptrs, size_t n)
+{
+	if (!pool || !ptrs || !atomic_load(&pool->initialized))
+		return -1;
+
+	int ret = 0;
+
+	/* Remote-free pools route every block by its span owner */
+	if (pool->flags & POOL_F_REMOTE_FREE) {
+		for (size_t i = 0; i < n; i++) {
+			if (pool_free_slow(pool, ptrs[i]) != 0)
+				ret = -1;
+		}
+		return ret;
+	}
+
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
+	size_t take = 0;
+	unsigned int node = thread_node(pool);
+
+	if (cache) {
+		size_t room = cache->mag.size - cache->mag.count;
+
+		take = n < room ? n : room;
+		memcpy(&cache->mag.blocks[cache->mag.count], ptrs, take * sizeof(void *));
+		cache->mag.count += take;
+		POOL_STAT_ADD(cache->mag.free_hits, take);
+		note_high_water(&cache->mag);
+		node = cache->node;
+	}
+
+	if (take == n)
+		return 0;
+
+	if (cache)
+		POOL_STAT_INC(cache->flushes);
+
+	/* Overflow: one reservation on a single slab, routed per block on NUMA */
+	if (pool->num_nodes == 1)
+		return slab_free_batch(pool->global_slab, ptrs + take, n - take);
+
+	for (size_t i = take; i < n; i++) {
+		if (return_block(pool, node, ptrs[i]) != 0)
+			ret = -1;
+	}
+	return ret;
+}
+
+int pool_alloc_n(mempool_t *pool, void **out, size_t n)
+{
+	if (!pool || !out || !atomic_load(&pool->initialized))
+		return -1;
+
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
+	if (!cache)
+		return -1;
+
+	/* Take what the magazine has, newest blocks first */
+	size_t take = n < cache->mag.count ? n : cache->mag.count;
+	cache->mag.count -= take;
+	memcpy(out, &cache->mag.blocks[cache->mag.count], take * sizeof(void *));
+	POOL_STAT_ADD(cache->mag.alloc_hits, take);
+	if (cache->mag.count < cache->mag.low_water)
+		cache->mag.low_water = cache->mag.count;
+
+	if (take == n)
+		return 0;
+
+	POOL_STAT_INC(cache->misses);
+	POOL_STAT_INC(cache->refills);
+
+	/* Single global slab: the rest in as few reservations as possible */
+	if (!(pool->flags & POOL_F_REMOTE_FREE) && pool->num_nodes == 1) {
+		if (slab_alloc_n(pool->global_slab, out + take, n - take) == 0)
+			return 0;
+
+		/* The taken blocks came from the magazine, so they fit back */
+		memcpy(&cache->mag.blocks[cache->mag.count], out, take * sizeof(void *));
+		cache->mag.count += take;
+		return -1;
+	}
+
+	/* Spans or node slabs: refill the (now empty) magazine and copy out */
+	while (take < n) {
+		size_t got = (pool->flags & POOL_F_REMOTE_FREE) ? span_refill(pool, cache)
+								: numa_refill(pool, cache);
+		if (got == 0) {
+			pool_free_n(pool, out, take);
+			return -1;
+		}
+
+		size_t copy = n - take < got ? n - take : got;
+		memcpy(out + take, &cache->mag.blocks[got - copy], copy * sizeof(void *));
+		cache->mag.count = got - copy;
+		take += copy;
+	}
+
+	return 0;
+}
+
+int pool_alloc_prefetch_n(mempool_t *pool, void **out, size_t n)
+{
+	if (pool_alloc_n(pool, out, n) != 0)
+		return -1;
+
+	size_t lines = (pool->block_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+	if (lines > POOL_PREFETCH_LINES)
+		lines = POOL_PREFETCH_LINES;
+
+	for (size_t i = 0; i < n; i++) {
+		for (size_t l = 0; l < lines; l++)
+			PREFETCH_WRITE((uint8_t *)out[i] + l * CACHE_LINE_SIZE);
+	}
+
+	return 0;
+}
+
+/*
+ * Epoch-based reclamation. A thread inside pool_enter publishes the epoch
+ * it saw in its cache; the epoch advances only when every published epoch
+ * equals the current one, so two advances after a retire outlast every
+ * critical section that could still see the block. Publishing is a
+ * thread-local store and a fence, with no shared write; the scan over the
+ * caches runs under registry_lock, once per POOL_EBR_BATCH retires.
+ */
+
+/**
+ * Free the blocks of one of this thread's bags through its cache.
+ */
+static void ebr_free_bag(mempool_t *pool, thread_local_cache_t *cache,
+			 pool_ebr_bag_t *bag)
+{
+	pool_free_n(pool, bag->ptrs, bag->count);
+	POOL_STAT_ADD(cache->ebr_reclaimed, bag->count);
+	bag->count = 0;
+}
+
+/**
+ * Free this thread's bags that are two epochs older than epoch.
+ */
+static void ebr_collect(mempool_t *pool, thread_local_cache_t *cache, uint64_t epoch)
+{
+	for (size_t i = 0; i < POOL_EBR_BAGS; i++) {
+		pool_ebr_bag_t *bag = &cache->ebr_bags[i];
+
+		if (bag->count && bag->epoch + 2 <= epoch)
+			ebr_free_bag(pool, cache, bag);
+	}
+}
+
+/**
+ * Advance the epoch if no thread is inside a critical section of an older
+ * one, and free the orphaned bags that became safe. Without wait, gives
+ * up if the registry lock is busy.
+ *
+ * @return The current epoch
+ */
+static uint64_t ebr_advance(mempool_t *pool, thread_local_cache_t *cache, int wait)
+{
+	pool_ebr_bag_t *done = NULL;
+	thread_local_cache_t *c;
+	uint64_t epoch;
+
+	if (wait)
+		pthread_mutex_lock(&registry_lock);
+	else if (pthread_mutex_trylock(&registry_lock) != 0)
+		return atomic_load(&pool->epoch);
+
+	/* Pairs with the fence in pool_enter */
+	atomic_thread_fence(memory_order_seq_cst);
+	epoch = atomic_load(&pool->epoch);
+	for (c = pool->caches; c; c = c->next) {
+		uint64_t active = atomic_load_explicit(&c->ebr_active, memory_order_acquire);
+
+		if ((active & 1) && (active >> 1) != epoch)
+			break;
+	}
+	if (!c)
+		atomic_store(&pool->epoch, ++epoch);
+
+	for (pool_ebr_bag_t **link = &pool->ebr_orphans; *link;) {
+		pool_ebr_bag_t *bag = *link;
+
+		if (bag->epoch + 2 <= epoch) {
+			*link = bag->next;
+			bag->next = done;
+			done = bag;
+		} else {
+			link = &bag->next;
+		}
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	/* Outside the lock: the frees may refill or create this thread's cache */
+	while (done) {
+		pool_ebr_bag_t *bag = done;
+
+		done = bag->next;
+		ebr_free_bag(pool, cache, bag);
+		free(bag->ptrs);
+		free(bag);
+	}
+
+	return epoch;
+}
+
+int pool_enter(mempool_t *pool)
+{
+	if (!pool || !atomic_load(&pool->initialized))
+		return -1;
+
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
+	if (!cache)
+		return -1;
+
+	if (cache->ebr_nest++ == 0) {
+		uint64_t epoch = atomic_load(&pool->epoch);
+
+		atomic_store_explicit(&cache->ebr_active, (epoch << 1) | 1,
+				      memory_order_relaxed);
+		/* Publish before the first load of shared data */
+		atomic_thread_fence(memory_order_seq_cst);
+	}
+	return 0;
+}
+
+void pool_exit(mempool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pool_tls_slot_t *slot = &pool_tls_slots[pool->head.id];
+	if (slot->gen != pool->head.gen)
+		return;
+
+	thread_local_cache_t *cache = (thread_local_cache_t *)slot->magazine;
+	if (cache->ebr_nest && --cache->ebr_nest == 0)
+		atomic_store_explicit(&cache->ebr_active, 0, memory_order_release);
+}
+
+int pool_retire(mempool_t *pool, void *ptr)
+{
+	if (!pool || !ptr || !atomic_load(&pool->initialized))
+		return -1;
+
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
+	if (!cache)
+		return -1;
+
+	uint64_t epoch = atomic_load(&pool->epoch);
+	pool_ebr_bag_t *bag = &cache->ebr_bags[epoch % POOL_EBR_BAGS];
+
+	/* The bag last held epoch - 3 or older, long past its grace period */
+	if (bag->epoch != epoch) {
+		if (bag->count)
+			ebr_free_bag(pool, cache, bag);
+		bag->epoch = epoch;
+	}
+
+	if (bag->count == bag->cap) {
+		size_t cap = bag->cap ? 2 * bag->cap : POOL_EBR_BATCH;
+		void **ptrs = realloc(bag->ptrs, cap * sizeof(void *));
+
+		if (!ptrs)
+			return -1;
+		bag->ptrs = ptrs;
+		bag->cap = cap;
+	}
+
+	bag->ptrs[bag->count++] = ptr;
+	POOL_STAT_INC(cache->ebr_retired);
+
+	if (++cache->ebr_since >= POOL_EBR_BATCH) {
+		cache->ebr_since = 0;
+		ebr_collect(pool, cache, ebr_advance(pool, cache, 0));
+	}
+	return 0;
+}
+
+size_t pool_reclaim(mempool_t *pool)
+{
+	if (!pool || !atomic_load(&pool->initialized))
+		return 0;
+
+	thread_local_cache_t *cache = get_thread_local_cache(pool);
+	if (!cache)
+		return 0;
+
+	/* Two advances cover the blocks retired in the current epoch */
+	ebr_advance(pool, cache, 1);
+	ebr_collect(pool, cache, ebr_advance(pool, cache, 1));
+	cache->ebr_since = 0;
+
+	size_t pending = 0;
+	for (size_t i = 0; i < POOL_EBR_BAGS; i++)
+		pending += cache->ebr_bags[i].count;
+	return pending;
+}
+
+size_t pool_trim(mempool_t *pool)
+{
+	size_t released = 0;
+
+	if (!pool || !atomic_load(&pool->initialized))
+		return 0;
+
+	/* Cached blocks would pin their pages; spans stay with their cache */
+	pool_tls_slot_t *slot = &pool_tls_slots[pool->head.id];
+	if (slot->gen == pool->head.gen && !(pool->flags & POOL_F_REMOTE_FREE)) {
+		thread_local_cache_t *cache = (thread_local_cache_t *)slot->magazine;
+
+		if (cache->mag.count) {
+			return_batch(pool, cache->node, cache->mag.blocks, cache->mag.count);
+			POOL_STAT_INC(cache->flushes);
+			cache->mag.count = 0;
+			cache->mag.low_water = 0;
+		}
+	}
+
+	for (unsigned int n = 0; n < pool->num_nodes; n++)
+		released += slab_trim(pool->node_slabs[n]);
+
+	return released;
 }
 
 void pool_destroy(mempool_t *pool)
@@ -132,8 +1362,32 @@ void pool_destroy(mempool_t *pool)
 	if (!pool)
 		return;
 
-	if (pool->global_slab)
-		slab_destroy(pool->global_slab);
+	atomic_store(&pool->initialized, 0);
+
+	/* Unregister, then return every thread's cached blocks to the slab */
+	pthread_mutex_lock(&registry_lock);
+	registry[pool->head.id] = NULL;
+	while (pool->decaying)
+		pthread_cond_wait(&decay_idle, &registry_lock);
+	while (pool->caches) {
+		thread_local_cache_t *cache = pool->caches;
+
+		pool->caches = cache->next;
+		release_cache(pool, cache);
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	/* Retired blocks still waiting go away with the slabs */
+	while (pool->ebr_orphans) {
+		pool_ebr_bag_t *bag = pool->ebr_orphans;
+
+		pool->ebr_orphans = bag->next;
+		free(bag->ptrs);
+		free(bag);
+	}
+
+	for (unsigned int i = 0; i < pool->num_nodes; i++)
+		slab_destroy(pool->node_slabs[i]);
 
 	free(pool);
 }
@@ -143,5 +1397,100 @@ int pool_stats(mempool_t *pool, size_t *allocated, size_t *free_count)
 	if (!pool || !allocated || !free_count)
 		return -1;
 
-	return slab_stats(pool->global_slab, allocated, free_count);
+	*allocated = 0;
+	*free_count = 0;
+	for (unsigned int i = 0; i < pool->num_nodes; i++) {
+		size_t used, free_blocks;
+
+		if (slab_stats(pool->node_slabs[i], &used, &free_blocks) != 0)
+			return -1;
+		*allocated += used;
+		*free_count += free_blocks;
+	}
+
+	if (pool->flags & POOL_F_REMOTE_FREE) {
+		*allocated *= pool->span_blocks;
+		*free_count *= pool->span_blocks;
+	}
+
+	return 0;
+}
+
+int pool_stats_ex(mempool_t *pool, pool_stats_ex_t *stats)
+{
+	if (!pool || !stats)
+		return -1;
+
+	if (pool_stats(pool, &stats->allocated, &stats->free) != 0)
+		return -1;
+
+	/* Contention on the shared free list(s) behind the thread caches */
+	stats->slab_cas_retries = 0;
+	stats->slab_backoff_spins = 0;
+	stats->purged = 0;
+	for (unsigned int i = 0; i < pool->num_nodes; i++) {
+		slab_stats_ex_t s;
+
+		if (slab_stats_ex(pool->node_slabs[i], &s) != 0)
+			return -1;
+		stats->slab_cas_retries += s.cas_retries;
+		stats->slab_backoff_spins += s.backoff_spins;
+		stats->purged += s.purged;
+	}
+
+	pthread_mutex_lock(&registry_lock);
+	const pool_stats_ex_t *r = &pool->retired;
+
+	stats->threads = 0;
+	stats->alloc_hits = r->alloc_hits;
+	stats->free_hits = r->free_hits;
+	stats->misses = r->misses;
+	stats->refills = r->refills;
+	stats->flushes = r->flushes;
+	stats->remote_frees = r->remote_frees;
+	stats->high_water = r->high_water;
+	stats->grows = r->grows;
+	stats->shrinks = r->shrinks;
+	stats->idle_returned = r->idle_returned;
+	stats->ebr_retired = r->ebr_retired;
+	stats->ebr_reclaimed = r->ebr_reclaimed;
+	stats->epoch = atomic_load(&pool->epoch);
+	stats->cache_capacity = atomic_load_explicit(&pool->cache_capacity, memory_order_relaxed);
+
+	for (thread_local_cache_t *c = pool->caches; c; c = c->next) {
+		size_t hw = atomic_load_explicit(&c->mag.high_water, memory_order_relaxed);
+
+		stats->threads++;
+		stats->alloc_hits += atomic_load_explicit(&c->mag.alloc_hits, memory_order_relaxed);
+		stats->free_hits += atomic_load_explicit(&c->mag.free_hits, memory_order_relaxed);
+		stats->misses += atomic_load_explicit(&c->misses, memory_order_relaxed);
+		stats->refills += atomic_load_explicit(&c->refills, memory_order_relaxed);
+		stats->flushes += atomic_load_explicit(&c->flushes, memory_order_relaxed);
+		stats->remote_frees += atomic_load_explicit(&c->remote_frees,
+							    memory_order_relaxed);
+		stats->grows += atomic_load_explicit(&c->grows, memory_order_relaxed);
+		stats->shrinks += atomic_load_explicit(&c->shrinks, memory_order_relaxed);
+		stats->idle_returned += atomic_load_explicit(&c->idle_returned,
+							     memory_order_relaxed);
+		stats->ebr_retired += atomic_load_explicit(&c->ebr_retired, memory_order_relaxed);
+		stats->ebr_reclaimed += atomic_load_explicit(&c->ebr_reclaimed,
+							     memory_order_relaxed);
+		if (hw > stats->high_water)
+			stats->high_water = hw;
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	return 0;
+}
+
+int pool_numa_stats(mempool_t *pool, pool_numa_stats_t *stats)
+{
+	if (!pool || !stats)
+		return -1;
+
+	stats->num_nodes = pool->num_nodes;
+	stats->local_blocks = atomic_load(&pool->local_blocks);
+	stats->remote_blocks = atomic_load(&pool->remote_blocks);
+	stats->remote_frees = atomic_load(&pool->remote_frees);
+	return 0;
 }
@@ -0,0 +1,263 @@
+#include "../include/sizeclass.h"
+#include "../include/mempool.h"
+#include "../include/pool_internal.h"
+#include "../include/pagemap.h"
+#include "../include/align.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <dlfcn.h>
+#include <stdatomic.h>
+
+/*
+ * LD_PRELOAD malloc replacement on top of the size-class pools:
+ *
+ *   LD_PRELOAD=$PWD/build/libmempool_preload.so ./app
+ *
+ * Requests up to SC_MAX_SIZE come from the class pools, whose slabs grow
+ * on demand and are entered in the page map, so free() finds the owning
+ * pool from the pointer alone. Everything else goes to glibc through its
+ * __libc_* entry points: larger requests (glibc's mmap threshold is
+ * lowered to SC_MAX_SIZE, so they are mmap'd directly), memory allocated
+ * before the pools exist, and every allocation the library itself makes
+ * (caches, slab chunk tables, page-map nodes), which a per-thread busy
+ * flag routes to glibc instead of recursing. A pointer the page map does
+ * not know is glibc's.
+ *
+ * Pools take their locks across fork() (pthread_atfork), and thread exit
+ * returns a thread's cached blocks, so fork-heavy and thread-churning
+ * programs are safe. Built with -ftls-model=initial-exec so that no TLS
+ * access needs malloc, and with hidden visibility so that only the
+ * malloc family is exported.
+ */
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* Class slab budget; each class grows by this much at a time */
+#define PRELOAD_CLASS_BYTES (256 * 1024)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+/* Start-up state */
+enum { PRELOAD_OFF, PRELOAD_STARTING, PRELOAD_READY, PRELOAD_FAILED };
+
+static sizeclass_allocator_t *sc;
+static _Atomic(int) state = PRELOAD_OFF;
+
+/* Inside the allocator (or glibc called back into us): use glibc */
+static _Thread_local unsigned int busy;
+
+/**
+ * Create the class pools on first use. Calls that arrive while another
+ * thread is still creating them are served by glibc.
+ */
+static int ready(void)
+{
+	int s = atomic_load_explicit(&state, memory_order_acquire);
+
+	if (s == PRELOAD_OFF &&
+	    atomic_compare_exchange_strong(&state, &s, PRELOAD_STARTING)) {
+		sc_config_t cfg = {
+			.bytes_per_class = PRELOAD_CLASS_BYTES,
+			/* Magazines size themselves to each thread's working set */
+			.pool_flags = POOL_F_ADAPTIVE,
+			/* Free lists in the blocks: no per-block metadata */
+			.slab_flags = SLAB_F_GROW | SLAB_F_FAST,
+		};
+
+		busy++;
+		mallopt(M_MMAP_THRESHOLD, SC_MAX_SIZE);
+		sc = sc_create(&cfg);
+		busy--;
+
+		s = sc ? PRELOAD_READY : PRELOAD_FAILED;
+		atomic_store_explicit(&state, s, memory_order_release);
+	}
+
+	return s == PRELOAD_READY;
+}
+
+/**
+ * Owning class pool of ptr, or NULL if glibc allocated it.
+ */
+static inline mempool_t *owner_of(const void *ptr)
+{
+	const pagemap_entry_t *e = pagemap_lookup(ptr);
+
+	return e ? atomic_load_explicit(&e->owner, memory_order_relaxed) : NULL;
+}
+
+/**
+ * Allocate size bytes from the class pools (size <= SC_MAX_SIZE).
+ * An exhausted class falls back to malloc, which lands in glibc.
+ */
+static inline void *class_alloc(size_t size)
+{
+	busy++;
+	void *p = sc_alloc(sc, size);
+	busy--;
+	return p;
+}
+
+EXPORT void *malloc(size_t size)
+{
+	if (busy || size > SC_MAX_SIZE || !ready())
+		return __libc_malloc(size);
+
+	void *p = class_alloc(size);
+	if (!p)
+		errno = ENOMEM;
+	return p;
+}
+
+EXPORT void free(void *ptr)
+{
+	mempool_t *pool;
+
+	if (!ptr)
+		return;
+	if (!(pool = owner_of(ptr))) {
+		__libc_free(ptr);
+		return;
+	}
+
+	busy++;
+	pool_free_fast(pool, ptr);
+	busy--;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+	size_t total;
+
+	if (__builtin_mul_overflow(nmemb, size, &total)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (busy || total > SC_MAX_SIZE || !ready())
+		return __libc_calloc(nmemb, size);
+
+	/* Recycled blocks hold old data */
+	void *p = class_alloc(total);
+	if (p)
+		memset(p, 0, total);
+	else
+		errno = ENOMEM;
+	return p;
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+	if (!ptr)
+		return malloc(size);
+
+	mempool_t *pool = owner_of(ptr);
+	if (!pool)
+		return __libc_realloc(ptr, size);
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+
+	/* Still fits the class: keep the block */
+	if (size <= pool->block_size)
+		return ptr;
+
+	void *p = malloc(size);
+	if (p) {
+		memcpy(p, ptr, pool->block_size);
+		free(ptr);
+	}
+	return p;
+}
+
+/**
+ * Aligned allocation. Class blocks lie at multiples of the class size
+ * from a granule-aligned chunk base, so a class whose size is a multiple
+ * of align serves it; larger alignments go to glibc.
+ */
+static void *alloc_aligned(size_t align, size_t size)
+{
+	if (align <= MEMPOOL_ALIGN_NATURAL)
+		return malloc(size);
+	if (busy || align > PAGEMAP_GRANULE || size > SC_MAX_SIZE || !ready())
+		return __libc_memalign(align, size);
+
+	size_t want = align_up(size ? size : 1, align);
+	while (want <= SC_MAX_SIZE) {
+		size_t class_size = sc_class_size(want);
+
+		if (class_size % align == 0) {
+			void *p = class_alloc(class_size);
+
+			if (p && ((uintptr_t)p & (align - 1)) == 0)
+				return p;
+			free(p); /* Class exhausted: glibc fallback, unaligned */
+			break;
+		}
+		want = align_up(class_size + 1, align);
+	}
+
+	return __libc_memalign(align, size);
+}
+
+EXPORT int posix_memalign(void **out, size_t align, size_t size)
+{
+	if (align < sizeof(void *) || (align & (align - 1)) != 0)
+		return EINVAL;
+
+	void *p = alloc_aligned(align, size);
+	if (!p)
+		return ENOMEM;
+	*out = p;
+	return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+	if (align == 0 || (align & (align - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return alloc_aligned(align, size);
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+	return aligned_alloc(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+	return alloc_aligned(resolve_alignment(MEMPOOL_ALIGN_PAGE), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+	size_t page = resolve_alignment(MEMPOOL_ALIGN_PAGE);
+
+	return alloc_aligned(page, align_up(size ? size : 1, page));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+	static size_t (*libc_usable_size)(void *);
+	mempool_t *pool;
+
+	if (!ptr)
+		return 0;
+	if ((pool = owner_of(ptr)))
+		return pool->block_size;
+
+	if (!libc_usable_size) {
+		busy++;
+		*(void **)&libc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+		busy--;
+	}
+	return libc_usable_size ? libc_usable_size(ptr) : 0;
+}
@@ -0,0 +1,180 @@
+#include "../include/sizeclass.h"
+#include "../include/mempool.h"
+#include "../include/pool_internal.h"
+#include "../include/pagemap.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define SC_DEFAULT_CLASS_BYTES (1024 * 1024)
+#define SC_DEFAULT_CACHE_BYTES (16 * 1024)
+#define SC_MIN_CACHE_BLOCKS    2
+#define SC_MAX_CACHE_BLOCKS    512
+
+typedef struct sizeclass_allocator {
+	mempool_t *pools[SC_NUM_CLASSES]; /* One pool per class in use */
+	size_t num_classes;               /* Classes in use (up to max_size) */
+	size_t max_size;                  /* Largest size served from pools */
+} sizeclass_allocator_t;
+
+/*
+ * Class sizes and the size-to-class table. The table is indexed by 16-byte
+ * granule, so mapping a size to its class is one shift and one load with
+ * no comparisons against class boundaries.
+ */
+static size_t class_sizes[SC_NUM_CLASSES];
+static uint8_t size_to_class[(SC_MAX_SIZE >> 4) + 1];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Build the class size and lookup tables.
+ */
+static void init_tables(void)
+{
+	size_t n = 0;
+
+	/* 16-byte steps for small objects */
+	for (size_t sz = 16; sz <= 128; sz += 16)
+		class_sizes[n++] = sz;
+
+	/* Four classes per power of two above that */
+	for (size_t base = 128; base < SC_MAX_SIZE; base *= 2)
+		for (size_t k = 1; k <= 4; k++)
+			class_sizes[n++] = base + k * (base / 4);
+
+	size_t c = 0;
+	for (size_t g = 0; g <= (SC_MAX_SIZE >> 4); g++) {
+		while (class_sizes[c] < (g << 4))
+			c++;
+		size_to_class[g] = (uint8_t)c;
+	}
+}
+
+static inline size_t class_of(size_t size)
+{
+	return size_to_class[(size + 15) >> 4];
+}
+
+size_t sc_class_size(size_t size)
+{
+	if (size > SC_MAX_SIZE)
+		return 0;
+
+	pthread_once(&tables_once, init_tables);
+	return class_sizes[class_of(size)];
+}
+
+sizeclass_allocator_t *sc_create(const sc_config_t *cfg)
+{
+	sc_config_t def = { 0 };
+	if (!cfg) {
+		def.pool_flags = POOL_F_BATCH;
+		cfg = &def;
+	}
+
+	size_t max_size = cfg->max_size ? cfg->max_size : SC_MAX_SIZE;
+	size_t class_bytes = cfg->bytes_per_class ? cfg->bytes_per_class
+						  : SC_DEFAULT_CLASS_BYTES;
+	size_t cache_bytes = cfg->cache_bytes ? cfg->cache_bytes
+					      : SC_DEFAULT_CACHE_BYTES;
+
+	if (max_size > SC_MAX_SIZE)
+		max_size = SC_MAX_SIZE;
+
+	pthread_once(&tables_once, init_tables);
+
+	sizeclass_allocator_t *sc = calloc(1, sizeof(sizeclass_allocator_t));
+	if (!sc)
+		return NULL;
+
+	sc->max_size = max_size;
+	sc->num_classes = class_of(max_size) + 1;
+
+	for (size_t c = 0; c < sc->num_classes; c++) {
+		size_t class_size = class_sizes[c];
+		size_t cache_blocks = cache_bytes / class_size;
+
+		if (cache_blocks < SC_MIN_CACHE_BLOCKS)
+			cache_blocks = SC_MIN_CACHE_BLOCKS;
+		if (cache_blocks > SC_MAX_CACHE_BLOCKS)
+			cache_blocks = SC_MAX_CACHE_BLOCKS;
+
+		size_t total_blocks = class_bytes / class_size;
+		if (total_blocks < cache_blocks)
+			total_blocks = cache_blocks;
+
+		pool_config_t pcfg = {
+			.block_size = class_size,
+			.blocks_per_thread = cache_blocks,
+			.total_blocks = total_blocks,
+			/* sc_free finds the class through the page map */
+			.flags = cfg->pool_flags | POOL_F_REGISTER,
+			.slab_flags = cfg->slab_flags,
+			.decay_ms = cfg->decay_ms,
+		};
+
+		sc->pools[c] = pool_create_ex(&pcfg);
+		if (!sc->pools[c]) {
+			sc_destroy(sc);
+			return NULL;
+		}
+	}
+
+	return sc;
+}
+
+void *sc_alloc(sizeclass_allocator_t *sc, size_t size)
+{
+	if (!sc)
+		return NULL;
+
+	if (size > sc->max_size)
+		return malloc(size);
+
+	void *ptr = pool_alloc_fast(sc->pools[class_of(size)]);
+	if (!ptr)
+		return malloc(size); /* Class exhausted */
+
+	return ptr;
+}
+
+int sc_free(sizeclass_allocator_t *sc, void *ptr)
+{
+	if (!sc)
+		return -1;
+	if (!ptr)
+		return 0;
+
+	const pagemap_entry_t *e = pagemap_lookup(ptr);
+	mempool_t *pool = e ? atomic_load_explicit(&e->owner, memory_order_relaxed) : NULL;
+	if (pool)
+		return pool_free_fast(pool, ptr);
+
+	/* Not from any class: it came from the malloc fallback */
+	free(ptr);
+	return 0;
+}
+
+size_t sc_trim(sizeclass_allocator_t *sc)
+{
+	size_t released = 0;
+
+	if (!sc)
+		return 0;
+
+	for (size_t c = 0; c < SC_NUM_CLASSES; c++)
+		released += pool_trim(sc->pools[c]);
+
+	return released;
+}
+
+void sc_destroy(sizeclass_allocator_t *sc)
+{
+	if (!sc)
+		return;
+
+	for (size_t c = 0; c < SC_NUM_CLASSES; c++)
+		pool_destroy(sc->pools[c]);
+
+	free(sc);
+}
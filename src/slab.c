@@ -1,9 +1,13 @@
 #include "../include/slab.h"
 #include "../include/align.h"
+#include "../include/latency.h"
+#include "../include/backoff.h"
+#include "../include/pagemap.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdatomic.h>
+#include <pthread.h>
 
 /* Sentinel values for allocation tracking */
 #define FREE_MARKER 0xDEADBEEFDEADBEEFUL
@@ -14,100 +18,1050 @@ typedef struct {
 	_Atomic(unsigned long) magic;
 	_Atomic(int) free;
 	size_t block_index;  /* To verify pointer ownership */
+	_Atomic(uint32_t) gen; /* Handle generation, advanced on every free (never 0) */
+	unsigned char constructed; /* ctor has run; written by the claiming thread */
 } block_metadata_t;
 
+/* End-of-list marker for free-list links */
+#define SLAB_NIL UINT32_MAX
+
+/* Growable slabs: chunk table size when no hard cap is given */
+#define SLAB_MAX_CHUNKS 4096
+
+/* Growable slabs: default blocks per chunk when none can be derived */
+#define SLAB_DEFAULT_CHUNK_BLOCKS 256
+
+/* Trimmed slabs: blocks moved from the set-aside list per refill */
+#define SLAB_PURGE_REFILL 256
+
+/*
+ * Per-thread statistics. Every thread that touches a slab owns one record
+ * of it and bumps the counters with a relaxed load and store, like
+ * POOL_STAT_ADD: a plain add on a line no other thread writes. slab_stats
+ * sums the records. Records stay until slab_destroy; the record of an
+ * exited thread keeps its counts and is adopted by the next thread that
+ * needs one, so thread churn does not grow the list.
+ */
+#define SLAB_STAT_ADD(c, n)                                                   \
+	atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (n), \
+			      memory_order_relaxed)
+
+/* Record owner while an adopting thread installs itself */
+#define SLAB_OWNER_CLAIMING UINT64_MAX
+
+/* Per-thread record table: set-associative on the slab uid */
+#define SLAB_TLS_SETS 16
+#define SLAB_TLS_WAYS 4
+
+/* A thread's identity; serial changes when the thread exits */
+typedef struct slab_thread {
+	_Atomic(uint64_t) serial;  /* Serial of the live thread, 0 while unused */
+	struct slab_thread *next;  /* Next unused identity (thread_lock) */
+} slab_thread_t;
+
+/* One thread's counters for one slab, on cache lines of their own */
+typedef struct slab_tstat {
+	_Atomic(long) used CACHE_ALIGNED; /* Blocks allocated minus freed by the owner */
+	_Atomic(uint64_t) retries;        /* Failed free-list CASes */
+	_Atomic(uint64_t) spins;          /* Backoff pauses after those failures */
+	_Atomic(uint64_t) owner;          /* Owner's serial; stale once the owner exits */
+	_Atomic(slab_thread_t *) thread;  /* Owner's identity */
+	struct slab_tstat *next;          /* Next record of the slab */
+} slab_tstat_t;
+
+/*
+ * The free list is a Treiber stack of block indices. The head packs the top
+ * index with a version tag that every successful push or pop increments, so
+ * a CAS against a head that was popped and pushed back in between (ABA)
+ * fails instead of installing a stale link.
+ */
+#define HEAD_INDEX(h) ((uint32_t)(h))
+#define HEAD_TAG(h)   ((uint32_t)((h) >> 32))
+
+static inline uint64_t head_pack(uint32_t idx, uint32_t tag)
+{
+	return ((uint64_t)tag << 32) | idx;
+}
+
+/*
+ * A contiguous run of blocks. A fixed slab has exactly one chunk; a
+ * growable slab adds chunks on demand. Block index idx lives in chunk
+ * idx >> chunk_shift at offset idx & chunk_mask.
+ */
+typedef struct {
+	uint8_t *memory;            /* First block of this chunk (base plus its color) */
+	uint8_t *base;              /* Memory obtained from the backing provider */
+	block_metadata_t *metadata; /* Per-block metadata, NULL in fast mode */
+	_Atomic(uint32_t) *next;    /* Free-list links, NULL in fast mode (links live in blocks) */
+	_Atomic(uint64_t) *bitmap;  /* Fast mode + SLAB_F_VALIDATE: 1 bit per allocated block */
+	size_t num_blocks;          /* Blocks in this chunk */
+	size_t map_size;            /* Bytes obtained from the backing provider */
+} slab_chunk_t;
+
 typedef struct slab_allocator {
-	void *memory;              /* Base of allocated memory (cache-line aligned data blocks) */
-	block_metadata_t *metadata;/* Metadata array (parallel to memory) */
-	size_t block_size;         /* Size of each block (cache-line aligned) */
-	size_t num_blocks;         /* Total number of blocks */
-	_Atomic(size_t) free_count;/* Number of free blocks */
-	_Atomic(int) *free_list;   /* Free list: indices of free blocks */
-	_Atomic(size_t) free_idx;  /* Current index in free list */
+	slab_chunk_t *chunks;      /* Chunk table (max_chunks entries) */
+	_Atomic(size_t) num_chunks;/* Chunks published so far */
+	size_t max_chunks;         /* Capacity of the chunk table */
+	unsigned int chunk_shift;  /* log2 of the index span of one chunk */
+	size_t chunk_mask;         /* Index span of one chunk minus one */
+	size_t chunk_blocks;       /* Blocks per full chunk */
+	size_t max_blocks;         /* Hard cap on blocks across all chunks */
+	unsigned int flags;        /* SLAB_F_* */
+	_Atomic(unsigned int) trim_seq; /* Trim sequence, odd while a trim holds the free list */
+	size_t block_size;         /* Size of each block (multiple of the alignment) */
+	size_t base_align;         /* Alignment of chunk memory */
+	size_t color_step;         /* SLAB_F_COLOR: distance between chunk colors */
+	size_t colors;             /* SLAB_F_COLOR: number of chunk colors (1 = no coloring) */
+	size_t spread_group;       /* SLAB_F_SPREAD: index distance of free-list neighbours */
+	_Atomic(size_t) num_blocks;/* Total number of blocks */
+	uint64_t uid;              /* Unique id, never reused (per-thread record key) */
+	_Atomic(slab_tstat_t *) tstats; /* Per-thread counters, summed by slab_stats */
+	slab_tstat_t spill;        /* Counters of threads without a record (atomic adds) */
+	pthread_mutex_t grow_lock; /* Serializes chunk creation (slow path only) */
+	mempool_backing_t backing; /* Provider of chunk memory */
+	uint8_t *reserved;         /* Reserve-then-commit: whole chunk range, or NULL */
+	size_t reserved_size;      /* Bytes reserved */
+	size_t chunk_bytes;        /* Stride between chunks in the reserved range */
+	void (*ctor)(void *, void *); /* Object constructor, or NULL */
+	void (*dtor)(void *, void *); /* Object destructor, or NULL */
+	void *obj_arg;             /* Argument to ctor and dtor */
+	void *owner;               /* SLAB_F_REGISTER: owner entered in the page map */
+	unsigned int index_bits;   /* Handle bits taken by the block index */
+	uint32_t gen_mask;         /* Handle generation mask after the shift (0 = no handles) */
+	uint32_t *purged;          /* Free blocks on released pages, off the free list (grow_lock) */
+	_Atomic(size_t) purged_count; /* Blocks in purged */
+	uint64_t *decay_map;       /* slab_decay: blocks free at the previous pass (grow_lock) */
+	size_t decay_words;        /* Words in decay_map */
+	_Atomic(uint64_t) free_head CACHE_ALIGNED; /* Versioned free-list head */
 } slab_allocator_t;
 
-slab_allocator_t *slab_create(size_t block_size, size_t num_blocks)
+/* SLAB_F_COLOR: rotates over all slabs, so chunks of different slabs differ too */
+static _Atomic(unsigned int) next_color;
+
+static _Atomic(uint64_t) next_uid = 1;
+
+/* Thread identities; unused ones are recycled, never freed */
+static _Atomic(uint64_t) next_serial = 1;
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static slab_thread_t *free_threads;
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+typedef struct {
+	uint64_t uid;
+	slab_tstat_t *stat;
+} slab_tls_t;
+
+/* The last slab's record, then the table; entries of other uids never match */
+static _Thread_local slab_tls_t tls_last;
+static _Thread_local slab_tls_t tls_stats[SLAB_TLS_SETS][SLAB_TLS_WAYS];
+static _Thread_local unsigned int tls_victim;
+static _Thread_local slab_thread_t *tls_thread;
+static _Thread_local uint64_t tls_serial;
+
+/**
+ * Thread exit: give up the identity, which retires the thread's records
+ * for adoption. The release store publishes their final counts.
+ */
+static void thread_exit(void *arg)
 {
-	if (block_size == 0 || num_blocks == 0)
+	slab_thread_t *t = arg;
+
+	atomic_store_explicit(&t->serial, 0, memory_order_release);
+	tls_thread = NULL;
+	tls_last.uid = 0;
+	memset(tls_stats, 0, sizeof(tls_stats));
+
+	pthread_mutex_lock(&thread_lock);
+	t->next = free_threads;
+	free_threads = t;
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void fork_prepare(void)
+{
+	pthread_mutex_lock(&thread_lock);
+}
+
+static void fork_release(void)
+{
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void init_thread_key(void)
+{
+	pthread_key_create(&thread_key, thread_exit);
+	pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+/**
+ * Get the calling thread's identity, taking one on first use.
+ */
+static slab_thread_t *my_thread(void)
+{
+	slab_thread_t *t = tls_thread;
+
+	if (t)
+		return t;
+
+	pthread_once(&thread_once, init_thread_key);
+	pthread_mutex_lock(&thread_lock);
+	t = free_threads;
+	if (t)
+		free_threads = t->next;
+	pthread_mutex_unlock(&thread_lock);
+
+	if (!t && !(t = calloc(1, sizeof(*t))))
 		return NULL;
 
-	/* Align block size to cache line */
-	size_t aligned_block_size = align_size_to_cache_line(block_size);
+	tls_serial = atomic_fetch_add_explicit(&next_serial, 1, memory_order_relaxed);
+	atomic_store_explicit(&t->serial, tls_serial, memory_order_relaxed);
+	tls_thread = t;
+	pthread_setspecific(thread_key, t);
+	return t;
+}
 
-	/* Allocate slab allocator structure */
-	slab_allocator_t *alloc = malloc(sizeof(slab_allocator_t));
-	if (!alloc)
+/**
+ * Find the calling thread's record in the slab: its own (the table may
+ * have evicted it), else one of an exited thread, else a new one.
+ */
+static slab_tstat_t *find_stat(slab_allocator_t *alloc)
+{
+	slab_thread_t *me = my_thread();
+	slab_tstat_t *head = atomic_load_explicit(&alloc->tstats, memory_order_acquire);
+	slab_tstat_t *s;
+
+	if (!me)
 		return NULL;
 
-	/* Allocate metadata array */
-	alloc->metadata = malloc(num_blocks * sizeof(block_metadata_t));
-	if (!alloc->metadata) {
-		free(alloc);
+	for (s = head; s; s = s->next) {
+		if (atomic_load_explicit(&s->owner, memory_order_relaxed) == tls_serial)
+			return s;
+	}
+
+	/*
+	 * Adopt a record whose owner has exited. The owner moves to CLAIMING
+	 * first, so nobody judges the record by a half-installed owner.
+	 */
+	for (s = head; s; s = s->next) {
+		uint64_t owner = atomic_load_explicit(&s->owner, memory_order_acquire);
+		slab_thread_t *t = atomic_load_explicit(&s->thread, memory_order_relaxed);
+
+		if (owner == SLAB_OWNER_CLAIMING ||
+		    atomic_load_explicit(&t->serial, memory_order_acquire) == owner)
+			continue;
+		if (atomic_compare_exchange_strong_explicit(&s->owner, &owner,
+							    SLAB_OWNER_CLAIMING,
+							    memory_order_acquire,
+							    memory_order_relaxed)) {
+			atomic_store_explicit(&s->thread, me, memory_order_relaxed);
+			atomic_store_explicit(&s->owner, tls_serial, memory_order_release);
+			return s;
+		}
+	}
+
+	s = cache_aligned_alloc(sizeof(*s));
+	if (!s)
 		return NULL;
+	memset(s, 0, sizeof(*s));
+	atomic_store_explicit(&s->owner, tls_serial, memory_order_relaxed);
+	atomic_store_explicit(&s->thread, me, memory_order_relaxed);
+
+	/* Records are never unlinked, so a plain push cannot suffer ABA */
+	s->next = head;
+	while (!atomic_compare_exchange_weak_explicit(&alloc->tstats, &s->next, s,
+						      memory_order_release,
+						      memory_order_relaxed))
+		;
+	return s;
+}
+
+/**
+ * Look the calling thread's record up in its table, filling the table
+ * from the slab's list on a miss. NULL if no record could be had.
+ */
+static slab_tstat_t *lookup_stat(slab_allocator_t *alloc)
+{
+	slab_tls_t *set = tls_stats[alloc->uid % SLAB_TLS_SETS];
+	slab_tls_t *slot = NULL;
+
+	for (int w = 0; w < SLAB_TLS_WAYS; w++) {
+		if (set[w].uid == alloc->uid) {
+			tls_last = set[w];
+			return set[w].stat;
+		}
+		if (!slot && !set[w].uid)
+			slot = &set[w];
 	}
 
-	/* Allocate free list */
-	alloc->free_list = malloc(num_blocks * sizeof(_Atomic(int)));
-	if (!alloc->free_list) {
-		free(alloc->metadata);
-		free(alloc);
+	slab_tstat_t *stat = find_stat(alloc);
+	if (!stat)
 		return NULL;
+
+	/* Evicting only forgets the pointer: the record stays ours */
+	if (!slot)
+		slot = &set[tls_victim++ % SLAB_TLS_WAYS];
+	slot->uid = alloc->uid;
+	slot->stat = stat;
+	tls_last = *slot;
+	return stat;
+}
+
+/**
+ * Get the calling thread's record of the slab.
+ */
+static inline slab_tstat_t *my_stat(slab_allocator_t *alloc)
+{
+	if (tls_last.uid == alloc->uid)
+		return tls_last.stat;
+	return lookup_stat(alloc);
+}
+
+/**
+ * Account n blocks allocated (negative: freed) on this thread's record.
+ * Only the owner writes it, so no locked instruction is needed; threads
+ * without a record (out of memory) fall back to atomic adds on the spill.
+ */
+static inline void stat_add(slab_allocator_t *alloc, long n)
+{
+	slab_tstat_t *stat = my_stat(alloc);
+
+	if (stat)
+		SLAB_STAT_ADD(stat->used, n);
+	else
+		atomic_fetch_add_explicit(&alloc->spill.used, n, memory_order_relaxed);
+}
+
+/**
+ * A free-list CAS lost a race: back off and count the retry.
+ */
+static void contended(slab_allocator_t *alloc, backoff_t *b)
+{
+	slab_tstat_t *stat = my_stat(alloc);
+	unsigned int spins = backoff_pause(b);
+
+	if (stat) {
+		SLAB_STAT_ADD(stat->retries, 1);
+		SLAB_STAT_ADD(stat->spins, spins);
+	} else {
+		atomic_fetch_add_explicit(&alloc->spill.retries, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&alloc->spill.spins, spins, memory_order_relaxed);
 	}
+	LATENCY_RETRY();
+}
+
+static inline slab_chunk_t *chunk_of(slab_allocator_t *alloc, size_t idx)
+{
+	return &alloc->chunks[idx >> alloc->chunk_shift];
+}
+
+/**
+ * Generation following gen, skipping 0 so that no handle is ever NULL.
+ */
+static inline uint32_t next_gen(slab_allocator_t *alloc, uint32_t gen)
+{
+	gen = (gen + 1) & alloc->gen_mask;
+	return gen ? gen : 1;
+}
+
+static inline void *block_ptr(slab_allocator_t *alloc, size_t idx)
+{
+	return chunk_of(alloc, idx)->memory +
+	       (idx & alloc->chunk_mask) * alloc->block_size;
+}
+
+/**
+ * Free-list link of block idx. In fast mode the link is threaded through the
+ * first word of the free block itself, so popping touches only the block.
+ */
+static inline _Atomic(uint32_t) *block_link(slab_allocator_t *alloc, size_t idx)
+{
+	if (alloc->flags & SLAB_F_FAST)
+		return (_Atomic(uint32_t) *)block_ptr(alloc, idx);
+	return &chunk_of(alloc, idx)->next[idx & alloc->chunk_mask];
+}
+
+/**
+ * Smallest shift such that (1 << shift) >= n.
+ */
+static unsigned int ceil_log2(size_t n)
+{
+	unsigned int shift = 0;
+
+	while (((size_t)1 << shift) < n)
+		shift++;
+	return shift;
+}
+
+static void free_chunk(slab_allocator_t *alloc, slab_chunk_t *chunk)
+{
+	if (chunk->memory && (alloc->flags & SLAB_F_REGISTER))
+		pagemap_unregister(chunk->base, chunk->map_size, alloc);
+	/* Chunks inside a reservation are returned with the whole range */
+	if (chunk->base && !alloc->reserved)
+		alloc->backing.free(&alloc->backing, chunk->base, chunk->map_size);
+	free(chunk->metadata);
+	free(chunk->next);
+	free(chunk->bitmap);
+}
+
+static void push_chain(slab_allocator_t *alloc, uint32_t first, uint32_t last);
 
-	/* Allocate memory for all blocks (cache-line aligned) */
-	size_t total_size = aligned_block_size * num_blocks;
-	alloc->memory = aligned_alloc(CACHE_LINE_SIZE, total_size);
-	if (!alloc->memory) {
-		free(alloc->free_list);
-		free(alloc->metadata);
+/**
+ * Offset of the first block of a new chunk. Blocks of equal size sit at
+ * the same offsets within each page of every chunk, so their hot fields
+ * compete for the same cache sets; SLAB_F_COLOR starts each chunk a
+ * different number of lines in, as in Bonwick's slab coloring.
+ */
+static size_t chunk_color(slab_allocator_t *alloc)
+{
+	if (alloc->colors < 2)
+		return 0;
+	return atomic_fetch_add_explicit(&next_color, 1, memory_order_relaxed) %
+	       alloc->colors * alloc->color_step;
+}
+
+/**
+ * Allocate and initialize chunk c, then push its blocks onto the free list.
+ * Caller holds grow_lock (or is slab_create_ex, before the slab is shared).
+ */
+static int add_chunk(slab_allocator_t *alloc, size_t c)
+{
+	slab_chunk_t *chunk = &alloc->chunks[c];
+	size_t first_idx = c << alloc->chunk_shift;
+	size_t n = alloc->chunk_blocks;
+
+	if (first_idx + n > alloc->max_blocks)
+		n = alloc->max_blocks - first_idx;
+	if (n == 0)
+		return -1;
+
+	memset(chunk, 0, sizeof(*chunk));
+	chunk->num_blocks = n;
+
+	if (alloc->flags & SLAB_F_FAST) {
+		/* State bitmap only when validation was asked for */
+		if (alloc->flags & SLAB_F_VALIDATE) {
+			chunk->bitmap = calloc((n + 63) / 64, sizeof(_Atomic(uint64_t)));
+			if (!chunk->bitmap)
+				goto fail;
+		}
+	} else {
+		chunk->metadata = malloc(n * sizeof(block_metadata_t));
+		chunk->next = malloc(n * sizeof(_Atomic(uint32_t)));
+		if (!chunk->metadata || !chunk->next)
+			goto fail;
+	}
+
+	/* Chunk memory; the base is at least cache-line aligned */
+	size_t span = (alloc->colors - 1) * alloc->color_step;
+	size_t total_size = align_up(alloc->block_size * n + span, alloc->base_align);
+	if (alloc->reserved) {
+		uint8_t *memory = alloc->reserved + c * alloc->chunk_bytes;
+
+		if (alloc->backing.commit(&alloc->backing, memory, total_size) != 0)
+			goto fail;
+		chunk->base = memory;
+	} else {
+		chunk->base = alloc->backing.alloc(&alloc->backing, total_size,
+						   alloc->base_align);
+		if (!chunk->base)
+			goto fail;
+	}
+	chunk->map_size = total_size;
+	chunk->memory = chunk->base + chunk_color(alloc);
+
+	if ((alloc->flags & SLAB_F_REGISTER) &&
+	    pagemap_register(chunk->base, total_size, alloc, alloc->owner,
+			     (uint32_t)c) != 0)
+		goto fail;
+
+	/* Publish the chunk before any of its indices can be popped */
+	atomic_store_explicit(&alloc->num_chunks, c + 1, memory_order_release);
+
+	/*
+	 * Chain the blocks: in address order, or with SLAB_F_SPREAD every
+	 * spread_group-th block first, so that blocks popped one after the
+	 * other (typically by different threads) never share a line or page.
+	 */
+	size_t group = alloc->spread_group < n ? alloc->spread_group : 1;
+	uint32_t last = SLAB_NIL;
+	for (size_t j = 0; j < group; j++) {
+		for (size_t i = j; i < n; i += group) {
+			if (last != SLAB_NIL)
+				atomic_store_explicit(block_link(alloc, last),
+						      (uint32_t)(first_idx + i),
+						      memory_order_relaxed);
+			last = (uint32_t)(first_idx + i);
+		}
+	}
+
+	for (size_t i = 0; chunk->metadata && i < n; i++) {
+		atomic_store(&chunk->metadata[i].magic, FREE_MARKER);
+		atomic_store(&chunk->metadata[i].free, 1);
+		chunk->metadata[i].block_index = first_idx + i;
+		atomic_store_explicit(&chunk->metadata[i].gen, 1, memory_order_relaxed);
+		chunk->metadata[i].constructed = 0;
+	}
+
+	atomic_fetch_add(&alloc->num_blocks, n);
+	push_chain(alloc, (uint32_t)first_idx, last);
+	return (int)n;
+
+fail:
+	free_chunk(alloc, chunk);
+	memset(chunk, 0, sizeof(*chunk));
+	return -1;
+}
+
+slab_allocator_t *slab_create(size_t block_size, size_t num_blocks)
+{
+	slab_config_t cfg = {
+		.block_size = block_size,
+		.num_blocks = num_blocks,
+		.align = MEMPOOL_ALIGN_CACHE_LINE,
+	};
+
+	return slab_create_ex(&cfg);
+}
+
+slab_allocator_t *slab_create_ex(const slab_config_t *cfg)
+{
+	if (!cfg || cfg->block_size == 0)
+		return NULL;
+
+	int grow = (cfg->flags & SLAB_F_GROW) != 0;
+	size_t num_blocks = cfg->num_blocks;
+
+	/* A fixed slab needs blocks up front; a growable one may start empty */
+	if (!grow && num_blocks == 0)
+		return NULL;
+
+	/* Fast mode links free blocks through their first word */
+	if ((cfg->ctor || cfg->dtor) && (cfg->flags & SLAB_F_FAST))
+		return NULL;
+
+	size_t align = resolve_alignment(cfg->align);
+	if (!align)
+		return NULL;
+
+	/* Lay out the index space: chunk size, chunk count and hard cap */
+	size_t chunk_blocks, max_chunks, max_blocks;
+	unsigned int shift;
+
+	if (grow) {
+		chunk_blocks = cfg->chunk_blocks ? cfg->chunk_blocks
+			     : num_blocks ? num_blocks : SLAB_DEFAULT_CHUNK_BLOCKS;
+		shift = ceil_log2(chunk_blocks);
+		chunk_blocks = (size_t)1 << shift;
+
+		if (cfg->max_blocks) {
+			max_blocks = cfg->max_blocks;
+			max_chunks = (max_blocks + chunk_blocks - 1) >> shift;
+		} else {
+			max_chunks = SLAB_MAX_CHUNKS;
+			if (shift < 32 && max_chunks > (SLAB_NIL >> shift))
+				max_chunks = SLAB_NIL >> shift;
+			max_blocks = max_chunks << shift;
+		}
+		if (num_blocks > max_blocks)
+			return NULL;
+	} else {
+		chunk_blocks = num_blocks;
+		shift = ceil_log2(num_blocks);
+		max_chunks = 1;
+		max_blocks = num_blocks;
+	}
+
+	/* Every index, including the last chunk's span, must stay below NIL */
+	if (shift >= 32 || max_chunks > (SLAB_NIL >> shift))
+		return NULL;
+
+	/* Padded to the running CPU's line, so the counters and free head stay apart */
+	slab_allocator_t *alloc = cache_aligned_alloc(sizeof(slab_allocator_t));
+	if (!alloc)
+		return NULL;
+
+	alloc->chunks = calloc(max_chunks, sizeof(slab_chunk_t));
+	if (!alloc->chunks) {
 		free(alloc);
 		return NULL;
 	}
 
-	alloc->block_size = aligned_block_size;
-	alloc->num_blocks = num_blocks;
-	atomic_store(&alloc->free_count, num_blocks);
-	atomic_store(&alloc->free_idx, num_blocks);
+	alloc->purged = NULL;
+	atomic_store(&alloc->purged_count, 0);
+	alloc->decay_map = NULL;
+	alloc->decay_words = 0;
+	atomic_store(&alloc->trim_seq, 0);
+	alloc->max_chunks = max_chunks;
+	alloc->chunk_shift = shift;
+	alloc->chunk_mask = ((size_t)1 << shift) - 1;
+	alloc->chunk_blocks = chunk_blocks;
+	alloc->max_blocks = max_blocks;
+	alloc->flags = cfg->flags;
+	/* Round block size to the requested alignment only */
+	alloc->block_size = align_up(cfg->block_size, align);
+	alloc->base_align = align > CACHE_LINE_SIZE ? align : CACHE_LINE_SIZE;
+	/* Registered chunks own whole granules of the page map */
+	if ((cfg->flags & SLAB_F_REGISTER) && alloc->base_align < PAGEMAP_GRANULE)
+		alloc->base_align = PAGEMAP_GRANULE;
+
+	/* Colors: line steps across one block, or one page for larger blocks */
+	alloc->color_step = align > CACHE_LINE_SIZE ? align : CACHE_LINE_SIZE;
+	alloc->colors = 1;
+	if (cfg->flags & SLAB_F_COLOR) {
+		size_t page = resolve_alignment(MEMPOOL_ALIGN_PAGE);
+		size_t span = align_up(alloc->block_size, alloc->color_step);
+
+		alloc->colors = (span < page ? span : page) / alloc->color_step;
+		if (alloc->colors == 0)
+			alloc->colors = 1;
+	}
+
+	/*
+	 * Spread: list neighbours i and i + group leave (group - 1) blocks
+	 * between them. Blocks that are whole multiples of the distance, at
+	 * bases aligned to it, cannot share a line or page anyway.
+	 */
+	alloc->spread_group = 1;
+	if (cfg->flags & SLAB_F_SPREAD) {
+		size_t dist = resolve_alignment(cfg->spread ? cfg->spread
+							    : MEMPOOL_ALIGN_CACHE_LINE);
+		size_t bs = alloc->block_size;
+
+		if (!dist) {
+			free(alloc->chunks);
+			free(alloc);
+			return NULL;
+		}
+		if (bs % dist || alloc->base_align % dist ||
+		    (alloc->colors > 1 && alloc->color_step % dist))
+			alloc->spread_group = (dist + bs - 1) / bs + 1;
+	}
+
+	atomic_store(&alloc->num_chunks, 0);
+	atomic_store(&alloc->num_blocks, 0);
+	alloc->uid = atomic_fetch_add(&next_uid, 1);
+	atomic_store(&alloc->tstats, NULL);
+	atomic_store(&alloc->spill.used, 0);
+	atomic_store(&alloc->spill.retries, 0);
+	atomic_store(&alloc->spill.spins, 0);
+	atomic_store(&alloc->free_head, head_pack(SLAB_NIL, 0));
+	pthread_mutex_init(&alloc->grow_lock, NULL);
+
+	alloc->backing = *backing_or_default(cfg->backing);
+	alloc->reserved = NULL;
+	alloc->reserved_size = 0;
+	alloc->chunk_bytes = align_up(alloc->block_size * chunk_blocks +
+				      (alloc->colors - 1) * alloc->color_step,
+				      alloc->base_align);
+	/* A stride off the page grid would cancel out the colors of a reservation */
+	if (alloc->colors > 1)
+		alloc->chunk_bytes = align_up(alloc->chunk_bytes,
+					      resolve_alignment(MEMPOOL_ALIGN_PAGE));
+	alloc->ctor = cfg->ctor;
+	alloc->dtor = cfg->dtor;
+	alloc->obj_arg = cfg->obj_arg;
+	alloc->owner = cfg->owner;
+
+	/* Handles pack the index below the generation */
+	alloc->index_bits = shift + ceil_log2(max_chunks);
+	alloc->gen_mask = (alloc->flags & SLAB_F_FAST) || alloc->index_bits >= 32
+		? 0 : UINT32_MAX >> alloc->index_bits;
 
-	/* Initialize metadata for all blocks */
-	for (size_t i = 0; i < num_blocks; i++) {
-		atomic_store(&alloc->free_list[i], i);
-		atomic_store(&alloc->metadata[i].magic, FREE_MARKER);
-		atomic_store(&alloc->metadata[i].free, 1);
-		alloc->metadata[i].block_index = i;
+	/* A capped growable slab reserves its whole range and commits per chunk */
+	if (grow && cfg->max_blocks && backing_can_reserve(&alloc->backing)) {
+		alloc->reserved_size = alloc->chunk_bytes * max_chunks;
+		alloc->reserved = alloc->backing.reserve(&alloc->backing,
+							 alloc->reserved_size,
+							 alloc->base_align);
+		if (!alloc->reserved) {
+			slab_destroy(alloc);
+			return NULL;
+		}
+	}
+
+	/* Create the initial chunks; each one's chain ends at the old head */
+	size_t initial_chunks = (num_blocks + chunk_blocks - 1) >> shift;
+	for (size_t c = 0; c < initial_chunks; c++) {
+		if (add_chunk(alloc, c) < 0) {
+			slab_destroy(alloc);
+			return NULL;
+		}
 	}
 
 	return alloc;
 }
 
+/**
+ * Block index of ptr within chunk c, or -1 if ptr is not a block boundary
+ * of that chunk.
+ */
+static inline long block_in_chunk(slab_allocator_t *alloc, size_t c, uintptr_t p)
+{
+	slab_chunk_t *chunk = &alloc->chunks[c];
+	uintptr_t base = (uintptr_t)chunk->memory;
+
+	if (p < base)
+		return -1;
+
+	uintptr_t offset = p - base;
+	if (offset >= chunk->num_blocks * alloc->block_size)
+		return -1;
+	if (offset % alloc->block_size != 0)
+		return -1; /* Not properly aligned to block boundary */
+
+	return (long)((c << alloc->chunk_shift) + offset / alloc->block_size);
+}
+
+/**
+ * Map ptr to its chunk and block index.
+ * Returns the block index, or -1 if ptr is not a block boundary of alloc.
+ */
+static long locate_block(slab_allocator_t *alloc, void *ptr)
+{
+	uintptr_t p = (uintptr_t)ptr;
+
+	/* Registered slabs name the chunk in the page map */
+	if (alloc->flags & SLAB_F_REGISTER) {
+		const pagemap_entry_t *e = pagemap_lookup(ptr);
+
+		if (!e || atomic_load_explicit(&e->slab, memory_order_relaxed) != alloc)
+			return -1;
+		return block_in_chunk(alloc, atomic_load_explicit(&e->chunk,
+								  memory_order_relaxed), p);
+	}
+
+	size_t num_chunks = atomic_load_explicit(&alloc->num_chunks,
+						 memory_order_acquire);
+
+	/* A fixed slab has one chunk; growable slabs scan their few chunks */
+	for (size_t c = 0; c < num_chunks; c++) {
+		uintptr_t base = (uintptr_t)alloc->chunks[c].memory;
+
+		if (p >= base && p - base < alloc->chunks[c].num_blocks * alloc->block_size)
+			return block_in_chunk(alloc, c, p);
+	}
+
+	return -1; /* Out of bounds */
+}
+
+/**
+ * Mark a block taken off the free list as allocated and return its address.
+ * The block is constructed the first time it is handed out.
+ */
+static inline void *claim_block(slab_allocator_t *alloc, size_t block_idx)
+{
+	slab_chunk_t *chunk = chunk_of(alloc, block_idx);
+	size_t i = block_idx & alloc->chunk_mask;
+
+	if (chunk->metadata) {
+		block_metadata_t *meta = &chunk->metadata[i];
+
+		atomic_store(&meta->magic, ALLOCATED_MARKER);
+		atomic_store(&meta->free, 0);
+		if (alloc->ctor && !meta->constructed)
+			alloc->ctor(chunk->memory + i * alloc->block_size, alloc->obj_arg);
+		meta->constructed = 1;
+	} else if (chunk->bitmap) {
+		atomic_fetch_or_explicit(&chunk->bitmap[i / 64], 1ULL << (i % 64),
+					 memory_order_relaxed);
+	}
+	return chunk->memory + i * alloc->block_size;
+}
+
+/**
+ * Validate ptr as a live block of alloc and mark it free.
+ * Returns the block index, or -1 if ptr is invalid or already freed.
+ */
+static long release_block(slab_allocator_t *alloc, void *ptr)
+{
+	if (!ptr)
+		return -1;
+
+	long block_idx = locate_block(alloc, ptr);
+	if (block_idx < 0)
+		return -1;
+
+	slab_chunk_t *chunk = chunk_of(alloc, block_idx);
+	size_t i = block_idx & alloc->chunk_mask;
+
+	if (!chunk->metadata) {
+		/* Fast mode: optional bitmap check, otherwise trust the caller */
+		if (chunk->bitmap) {
+			uint64_t bit = 1ULL << (i % 64);
+			uint64_t old = atomic_fetch_and_explicit(&chunk->bitmap[i / 64],
+								 ~bit,
+								 memory_order_relaxed);
+			if (!(old & bit))
+				return -1; /* Double free or never allocated */
+		}
+		return block_idx;
+	}
+
+	block_metadata_t *meta = &chunk->metadata[i];
+	if (atomic_load(&meta->magic) != ALLOCATED_MARKER)
+		return -1;
+
+	/* Exchange so two racing frees of the same block can't both win */
+	if (atomic_exchange(&meta->free, 1))
+		return -1;
+	atomic_store(&meta->magic, FREE_MARKER);
+
+	/* Outstanding handles of this block go stale */
+	if (alloc->gen_mask)
+		atomic_store_explicit(&meta->gen,
+				      next_gen(alloc, atomic_load_explicit(&meta->gen,
+									   memory_order_relaxed)),
+				      memory_order_release);
+
+	return block_idx;
+}
+
+/**
+ * Check that idx names a block in a published chunk.
+ */
+static inline int valid_index(slab_allocator_t *alloc, uint32_t idx)
+{
+	size_t c = idx >> alloc->chunk_shift;
+
+	return c < atomic_load_explicit(&alloc->num_chunks, memory_order_acquire) &&
+	       (idx & alloc->chunk_mask) < alloc->chunks[c].num_blocks;
+}
+
+/**
+ * Pop up to n blocks off the free list with one CAS.
+ * Stores block indices (as integers cast to pointers, so callers can
+ * convert them in place) in out and returns how many were taken.
+ */
+static size_t pop_blocks(slab_allocator_t *alloc, void **out, size_t n)
+{
+	uint64_t head = atomic_load_explicit(&alloc->free_head,
+					     memory_order_acquire);
+	backoff_t backoff = BACKOFF_INIT;
+	size_t taken;
+
+	for (;;) {
+		uint32_t idx = HEAD_INDEX(head);
+		if (idx == SLAB_NIL)
+			return 0; /* No free blocks */
+
+		/*
+		 * Walk n links. If the list changes underneath us the links may
+		 * be stale, but the walk is bounded by n and the version check
+		 * in the CAS rejects the result.
+		 */
+		taken = 0;
+		for (;;) {
+			out[taken++] = (void *)(uintptr_t)idx;
+			uint32_t next = atomic_load_explicit(block_link(alloc, idx),
+							     memory_order_relaxed);
+			idx = next;
+			if (taken == n || idx == SLAB_NIL)
+				break;
+			/* Fast mode: a block popped under us may hold user data */
+			if ((alloc->flags & SLAB_F_FAST) && !valid_index(alloc, idx))
+				break;
+		}
+
+		if (idx != SLAB_NIL && (alloc->flags & SLAB_F_FAST) &&
+		    !valid_index(alloc, idx)) {
+			contended(alloc, &backoff);
+			head = atomic_load_explicit(&alloc->free_head,
+						    memory_order_acquire);
+			continue;
+		}
+
+		uint64_t new_head = head_pack(idx, HEAD_TAG(head) + 1);
+		if (atomic_compare_exchange_weak_explicit(&alloc->free_head, &head,
+							  new_head,
+							  memory_order_acquire,
+							  memory_order_acquire)) {
+			/* Warm the block the next pop will take and read */
+			if ((alloc->flags & SLAB_F_PREFETCH) && idx != SLAB_NIL)
+				PREFETCH_WRITE(block_ptr(alloc, idx));
+			return taken;
+		}
+		contended(alloc, &backoff);
+		/* The failed CAS loaded a head that is stale by now */
+		head = atomic_load_explicit(&alloc->free_head, memory_order_acquire);
+	}
+}
+
+/**
+ * Push a pre-linked chain first..last onto the free list with one CAS.
+ */
+static void push_chain(slab_allocator_t *alloc, uint32_t first, uint32_t last)
+{
+	uint64_t head = atomic_load_explicit(&alloc->free_head,
+					     memory_order_relaxed);
+	backoff_t backoff = BACKOFF_INIT;
+
+	for (;;) {
+		atomic_store_explicit(block_link(alloc, last), HEAD_INDEX(head),
+				      memory_order_relaxed);
+		if (atomic_compare_exchange_weak_explicit(&alloc->free_head, &head,
+							  head_pack(first, HEAD_TAG(head) + 1),
+							  memory_order_release,
+							  memory_order_relaxed))
+			return;
+		contended(alloc, &backoff);
+		head = atomic_load_explicit(&alloc->free_head, memory_order_relaxed);
+	}
+}
+
+/**
+ * Slow path once the free list is empty: bring back blocks set aside by a
+ * trim, or add a chunk if the slab is growable and below its cap. seq is
+ * the trim sequence read before the free list was found empty; a trim
+ * since then may have held the blocks. Returns 0 if blocks may now be
+ * available.
+ */
+static int grow(slab_allocator_t *alloc, unsigned int seq)
+{
+	/* Unless trimming took the list or set blocks aside, it is really empty */
+	if (!(alloc->flags & SLAB_F_GROW) &&
+	    atomic_load_explicit(&alloc->purged_count, memory_order_relaxed) == 0 &&
+	    atomic_load_explicit(&alloc->trim_seq, memory_order_acquire) == seq &&
+	    !(seq & 1))
+		return -1;
+
+	LATENCY_START(t0);
+	pthread_mutex_lock(&alloc->grow_lock);
+
+	/* Another thread may have grown the slab or freed while we waited */
+	uint64_t head = atomic_load_explicit(&alloc->free_head,
+					     memory_order_acquire);
+	if (HEAD_INDEX(head) != SLAB_NIL) {
+		pthread_mutex_unlock(&alloc->grow_lock);
+		return 0;
+	}
+
+	/* Blocks on released pages come back before new memory is added */
+	size_t aside = atomic_load_explicit(&alloc->purged_count, memory_order_relaxed);
+	if (aside) {
+		size_t n = aside < SLAB_PURGE_REFILL ? aside : SLAB_PURGE_REFILL;
+		uint32_t *run = alloc->purged + aside - n;
+
+		for (size_t i = 0; i + 1 < n; i++)
+			atomic_store_explicit(block_link(alloc, run[i]), run[i + 1],
+					      memory_order_relaxed);
+		atomic_store_explicit(&alloc->purged_count, aside - n, memory_order_relaxed);
+		push_chain(alloc, run[0], run[n - 1]);
+		pthread_mutex_unlock(&alloc->grow_lock);
+		return 0;
+	}
+
+	if (!(alloc->flags & SLAB_F_GROW)) {
+		pthread_mutex_unlock(&alloc->grow_lock);
+		return -1;
+	}
+
+	size_t c = atomic_load_explicit(&alloc->num_chunks, memory_order_relaxed);
+	int n = c < alloc->max_chunks ? add_chunk(alloc, c) : -1;
+
+	pthread_mutex_unlock(&alloc->grow_lock);
+	if (n > 0)
+		LATENCY_END(LAT_EV_SLAB_GROW, t0);
+	return n > 0 ? 0 : -1;
+}
+
 void *slab_alloc(slab_allocator_t *alloc)
 {
 	if (!alloc)
 		return NULL;
 
-	/* Try to pop a free block from the free list */
-	size_t old_idx = atomic_load(&alloc->free_idx);
-	if (old_idx == 0)
-		return NULL; /* No free blocks */
+	void *slot;
+	LATENCY_START_CONTENDED(t0);
+	unsigned int seq = atomic_load_explicit(&alloc->trim_seq, memory_order_acquire);
+	while (!pop_blocks(alloc, &slot, 1)) {
+		if (grow(alloc, seq) < 0)
+			return NULL; /* Exhausted */
+		seq = atomic_load_explicit(&alloc->trim_seq, memory_order_acquire);
+	}
 
-	size_t new_idx = old_idx - 1;
-	if (!atomic_compare_exchange_strong(&alloc->free_idx, &old_idx, new_idx))
-		return slab_alloc(alloc); /* Retry on contention */
+	void *ptr = claim_block(alloc, (uintptr_t)slot);
+	stat_add(alloc, 1);
 
-	/* Get the block index from the free list */
-	int block_idx = atomic_load(&alloc->free_list[new_idx]);
-	if (block_idx < 0 || (size_t)block_idx >= alloc->num_blocks)
-		return NULL;
+	LATENCY_END_CONTENDED(LAT_EV_SLAB_ALLOC, LAT_EV_SLAB_CONTENDED, t0);
+	return ptr;
+}
 
-	/* Get the block pointer and update metadata */
-	void *ptr = (uint8_t *)alloc->memory + block_idx * alloc->block_size;
-	block_metadata_t *meta = &alloc->metadata[block_idx];
+size_t slab_alloc_batch(slab_allocator_t *alloc, void **out, size_t n)
+{
+	if (!alloc || !out || n == 0)
+		return 0;
 
-	atomic_store(&meta->magic, ALLOCATED_MARKER);
-	atomic_store(&meta->free, 0);
-	atomic_fetch_sub(&alloc->free_count, 1);
+	size_t taken;
+	unsigned int seq = atomic_load_explicit(&alloc->trim_seq, memory_order_acquire);
+	while (!(taken = pop_blocks(alloc, out, n))) {
+		if (grow(alloc, seq) < 0)
+			return 0; /* Exhausted */
+		seq = atomic_load_explicit(&alloc->trim_seq, memory_order_acquire);
+	}
 
-	return ptr;
+	for (size_t i = 0; i < taken; i++)
+		out[i] = claim_block(alloc, (uintptr_t)out[i]);
+
+	stat_add(alloc, (long)taken);
+	return taken;
+}
+
+int slab_alloc_n(slab_allocator_t *alloc, void **out, size_t n)
+{
+	if (!alloc || !out)
+		return -1;
+
+	size_t got = 0;
+	while (got < n) {
+		size_t taken = slab_alloc_batch(alloc, out + got, n - got);
+		if (taken == 0)
+			break;
+		got += taken;
+	}
+
+	if (got < n) {
+		slab_free_batch(alloc, out, got);
+		return -1;
+	}
+	return 0;
+}
+
+int slab_free_batch(slab_allocator_t *alloc, void **ptrs, size_t n)
+{
+	if (!alloc || !ptrs)
+		return -1;
+
+	int ret = 0;
+	uint32_t first = SLAB_NIL;
+	uint32_t last = SLAB_NIL;
+	size_t count = 0;
+
+	/* Validate and link the blocks into a private chain */
+	for (size_t i = 0; i < n; i++) {
+		long block_idx = release_block(alloc, ptrs[i]);
+		if (block_idx < 0) {
+			ret = -1;
+			continue;
+		}
+
+		if (last == SLAB_NIL)
+			first = (uint32_t)block_idx;
+		else
+			atomic_store_explicit(block_link(alloc, last),
+					      (uint32_t)block_idx,
+					      memory_order_relaxed);
+		last = (uint32_t)block_idx;
+		count++;
+	}
+
+	/* Publish the whole chain with a single CAS */
+	if (count) {
+		push_chain(alloc, first, last);
+		stat_add(alloc, -(long)count);
+	}
+
+	return ret;
 }
 
 int slab_free(slab_allocator_t *alloc, void *ptr)
@@ -115,60 +1069,363 @@ int slab_free(slab_allocator_t *alloc, void *ptr)
 	if (!alloc || !ptr)
 		return -1;
 
-	/* Find which block this is based on memory address */
-	if (ptr < alloc->memory)
-		return -1;
+	LATENCY_START_CONTENDED(t0);
+	long block_idx = release_block(alloc, ptr);
+	if (block_idx < 0)
+		return -1; /* Invalid pointer or double free */
 
-	uintptr_t offset = (uintptr_t)ptr - (uintptr_t)alloc->memory;
-	if (offset % alloc->block_size != 0)
-		return -1; /* Not properly aligned to block boundary */
+	push_chain(alloc, (uint32_t)block_idx, (uint32_t)block_idx);
+	stat_add(alloc, -1);
+	LATENCY_END_CONTENDED(LAT_EV_SLAB_FREE, LAT_EV_SLAB_CONTENDED, t0);
+	return 0;
+}
 
-	size_t block_idx = offset / alloc->block_size;
-	if (block_idx >= alloc->num_blocks)
-		return -1; /* Out of bounds */
+/**
+ * Split a handle into its block index and generation.
+ * Returns the block's metadata, or NULL if the index is out of range.
+ */
+static inline block_metadata_t *handle_meta(slab_allocator_t *alloc,
+					    slab_handle_t handle,
+					    uint32_t *idx, uint32_t *gen)
+{
+	if (!alloc || !alloc->gen_mask)
+		return NULL;
 
-	block_metadata_t *meta = &alloc->metadata[block_idx];
+	*idx = handle & (uint32_t)(((uint64_t)1 << alloc->index_bits) - 1);
+	*gen = handle >> alloc->index_bits;
+	if (!valid_index(alloc, *idx))
+		return NULL;
+	return &chunk_of(alloc, *idx)->metadata[*idx & alloc->chunk_mask];
+}
 
-	/* Verify magic number */
-	unsigned long magic = atomic_load(&meta->magic);
-	if (magic != ALLOCATED_MARKER)
-		return -1; /* Invalid allocation */
+slab_handle_t slab_alloc_handle(slab_allocator_t *alloc)
+{
+	if (!alloc || !alloc->gen_mask)
+		return SLAB_HANDLE_NULL;
+
+	void *slot;
+	unsigned int seq = atomic_load_explicit(&alloc->trim_seq, memory_order_acquire);
+	while (!pop_blocks(alloc, &slot, 1)) {
+		if (grow(alloc, seq) < 0)
+			return SLAB_HANDLE_NULL; /* Exhausted */
+		seq = atomic_load_explicit(&alloc->trim_seq, memory_order_acquire);
+	}
 
-	/* Check if already freed */
-	if (atomic_load(&meta->free))
-		return -1; /* Double free */
+	uint32_t idx = (uint32_t)(uintptr_t)slot;
+	block_metadata_t *meta = &chunk_of(alloc, idx)->metadata[idx & alloc->chunk_mask];
+
+	claim_block(alloc, idx);
+	stat_add(alloc, 1);
+	return atomic_load_explicit(&meta->gen, memory_order_relaxed) << alloc->index_bits |
+	       idx;
+}
 
-	/* Mark as free and restore free marker */
-	atomic_store(&meta->free, 1);
+void *slab_deref(slab_allocator_t *alloc, slab_handle_t handle)
+{
+	uint32_t idx, gen;
+	block_metadata_t *meta = handle_meta(alloc, handle, &idx, &gen);
+
+	if (!meta || atomic_load_explicit(&meta->gen, memory_order_acquire) != gen)
+		return NULL;
+	return block_ptr(alloc, idx);
+}
+
+int slab_free_handle(slab_allocator_t *alloc, slab_handle_t handle)
+{
+	uint32_t idx, gen;
+	block_metadata_t *meta = handle_meta(alloc, handle, &idx, &gen);
+
+	if (!meta || gen == 0)
+		return -1;
+
+	/* Only one free through this generation can advance it */
+	if (!atomic_compare_exchange_strong_explicit(&meta->gen, &gen,
+						     next_gen(alloc, gen),
+						     memory_order_acq_rel,
+						     memory_order_relaxed))
+		return -1; /* Stale handle or double free */
+
+	/* Lost to a concurrent slab_free of the same block */
+	if (atomic_exchange(&meta->free, 1))
+		return -1;
 	atomic_store(&meta->magic, FREE_MARKER);
 
-	/* Add back to free list */
-	size_t old_idx = atomic_load(&alloc->free_idx);
-	size_t new_idx = old_idx + 1;
+	push_chain(alloc, idx, idx);
+	stat_add(alloc, -1);
+	return 0;
+}
 
-	if (new_idx > alloc->num_blocks)
-		return -1; /* Free list overflow */
+int slab_region(slab_allocator_t *alloc, void **base, size_t *size)
+{
+	if (!alloc || !base || !size)
+		return -1;
 
-	atomic_store(&alloc->free_list[old_idx], block_idx);
+	/* Only a fixed slab is a single contiguous region */
+	if (alloc->max_chunks != 1)
+		return -1;
 
-	if (!atomic_compare_exchange_strong(&alloc->free_idx, &old_idx, new_idx))
-		return slab_free(alloc, ptr); /* Retry on contention */
+	*base = alloc->chunks[0].memory;
+	*size = alloc->chunks[0].num_blocks * alloc->block_size;
 
-	atomic_fetch_add(&alloc->free_count, 1);
 	return 0;
 }
 
+int slab_owns(slab_allocator_t *alloc, void *ptr)
+{
+	return alloc && ptr && locate_block(alloc, ptr) >= 0;
+}
+
+/*
+ * Trimming. Under grow_lock the trim swaps the free list for an empty one,
+ * so it owns every free block. It marks them in a bitmap together with
+ * the blocks set aside by earlier trims, releases the pages that hold
+ * free blocks only, sets aside every free block that overlaps a released
+ * page and pushes the rest back in address order. trim_seq is odd
+ * meanwhile, which makes allocations that find the list empty wait on
+ * grow_lock instead of failing (see grow).
+ */
+#define BIT_TEST(map, i) (((map)[(i) / 64] >> ((i) % 64)) & 1)
+#define BIT_SET(map, i)  ((map)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+
+/* Page states of the chunk being trimmed */
+enum { PAGE_KEEP, PAGE_RELEASE, PAGE_RELEASED };
+
+typedef struct {
+	uint64_t *free;       /* Free blocks: the detached list plus those set aside */
+	uint64_t *aside;      /* Blocks set aside by earlier trims (pages released already) */
+	const uint64_t *prev; /* slab_decay: blocks free at the previous pass, else NULL */
+	unsigned char *pages; /* PAGE_* of each whole page of the current chunk */
+	size_t page;          /* Page size */
+	uint32_t *purged;     /* New set-aside list */
+	size_t npurged;       /* Entries in purged */
+	uint32_t first, last; /* Chain going back on the free list */
+	size_t released;      /* Bytes released */
+} trim_state_t;
+
+/**
+ * Whether block idx is free and its contents may be dropped.
+ */
+static inline int block_purgeable(slab_allocator_t *alloc, const trim_state_t *st,
+				  size_t idx)
+{
+	if (!BIT_TEST(st->free, idx) || (st->prev && !BIT_TEST(st->prev, idx)))
+		return 0;
+
+	/* Constructed objects keep their state while free */
+	if (!alloc->ctor)
+		return 1;
+	return !chunk_of(alloc, idx)->metadata[idx & alloc->chunk_mask].constructed;
+}
+
+static void trim_chunk(slab_allocator_t *alloc, size_t c, trim_state_t *st)
+{
+	slab_chunk_t *chunk = &alloc->chunks[c];
+	size_t base = c << alloc->chunk_shift;
+	size_t bs = alloc->block_size;
+	size_t page = st->page;
+	uintptr_t mem = (uintptr_t)chunk->memory;
+	uintptr_t lo = align_up((uintptr_t)chunk->base, page);
+	uintptr_t hi = ((uintptr_t)chunk->base + chunk->map_size) & ~(uintptr_t)(page - 1);
+	size_t npages = hi > lo ? (hi - lo) / page : 0;
+
+	/*
+	 * A page goes if all its blocks may; if they were all set aside, it is
+	 * gone already. Pages of color padding only were never touched.
+	 */
+	for (size_t k = 0; k < npages; k++) {
+		uintptr_t p = lo + k * page;
+		size_t b0 = p > mem ? (p - mem) / bs : 0;
+		size_t b1 = p + page > mem ? (p + page - 1 - mem) / bs : 0;
+		int state = PAGE_RELEASED;
+
+		if (p + page <= mem)
+			b0 = chunk->num_blocks;
+		if (b1 >= chunk->num_blocks)
+			b1 = chunk->num_blocks - 1;
+		for (size_t i = b0; i <= b1 && b0 < chunk->num_blocks; i++) {
+			if (!block_purgeable(alloc, st, base + i)) {
+				state = PAGE_KEEP;
+				break;
+			}
+			if (!BIT_TEST(st->aside, base + i))
+				state = PAGE_RELEASE;
+		}
+		st->pages[k] = (unsigned char)state;
+	}
+
+	for (size_t k = 0; k < npages;) {
+		size_t end = k;
+
+		if (st->pages[k] != PAGE_RELEASE) {
+			k++;
+			continue;
+		}
+		while (end < npages && st->pages[end] == PAGE_RELEASE)
+			end++;
+
+		size_t got = backing_purge(&alloc->backing, (void *)(lo + k * page),
+					   (end - k) * page);
+		if (!got)
+			memset(&st->pages[k], PAGE_KEEP, end - k);
+		st->released += got;
+		k = end;
+	}
+
+	/* Blocks touching a released page stay off the free list */
+	for (size_t i = 0; i < chunk->num_blocks; i++) {
+		size_t idx = base + i;
+		uintptr_t b = mem + i * bs;
+		uintptr_t s = b > lo ? b : lo;
+		uintptr_t e = b + bs < hi ? b + bs : hi;
+		int aside = 0;
+
+		if (!BIT_TEST(st->free, idx))
+			continue;
+		for (size_t k = s < e ? (s - lo) / page : 1, kend = s < e ? (e - 1 - lo) / page : 0;
+		     k <= kend && !aside; k++)
+			aside = st->pages[k] != PAGE_KEEP;
+
+		if (aside) {
+			st->purged[st->npurged++] = (uint32_t)idx;
+			continue;
+		}
+		if (st->last == SLAB_NIL)
+			st->first = (uint32_t)idx;
+		else
+			atomic_store_explicit(block_link(alloc, st->last), (uint32_t)idx,
+					      memory_order_relaxed);
+		st->last = (uint32_t)idx;
+	}
+}
+
+static size_t trim(slab_allocator_t *alloc, int decay)
+{
+	if (!alloc || !alloc->backing.purge)
+		return 0;
+
+	trim_state_t st = { .page = resolve_alignment(MEMPOOL_ALIGN_PAGE),
+			    .first = SLAB_NIL, .last = SLAB_NIL };
+
+	pthread_mutex_lock(&alloc->grow_lock);
+
+	size_t num_chunks = atomic_load_explicit(&alloc->num_chunks, memory_order_relaxed);
+	size_t words = ((num_chunks << alloc->chunk_shift) + 63) / 64;
+	size_t aside = atomic_load_explicit(&alloc->purged_count, memory_order_relaxed);
+
+	st.free = calloc(words, sizeof(uint64_t));
+	st.aside = calloc(words, sizeof(uint64_t));
+	st.pages = malloc(alloc->chunk_bytes / st.page + 1);
+	st.purged = malloc(atomic_load(&alloc->num_blocks) * sizeof(uint32_t) + 1);
+	if (decay && alloc->decay_words < words) {
+		uint64_t *map = realloc(alloc->decay_map, words * sizeof(uint64_t));
+
+		if (map) {
+			memset(map + alloc->decay_words, 0,
+			       (words - alloc->decay_words) * sizeof(uint64_t));
+			alloc->decay_map = map;
+			alloc->decay_words = words;
+		}
+	}
+	if (!st.free || !st.aside || !st.pages || !st.purged ||
+	    (decay && alloc->decay_words < words)) {
+		pthread_mutex_unlock(&alloc->grow_lock);
+		free(st.free);
+		free(st.aside);
+		free(st.pages);
+		free(st.purged);
+		return 0;
+	}
+	st.prev = decay ? alloc->decay_map : NULL;
+
+	/* Take the free list; the tag bump fails every CAS against the old head */
+	atomic_fetch_add(&alloc->trim_seq, 1);
+	uint64_t head = atomic_load_explicit(&alloc->free_head, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&alloc->free_head, &head,
+						      head_pack(SLAB_NIL, HEAD_TAG(head) + 1),
+						      memory_order_acq_rel,
+						      memory_order_relaxed))
+		;
+	for (uint32_t idx = HEAD_INDEX(head); idx != SLAB_NIL;
+	     idx = atomic_load_explicit(block_link(alloc, idx), memory_order_relaxed))
+		BIT_SET(st.free, idx);
+	for (size_t i = 0; i < aside; i++) {
+		BIT_SET(st.free, alloc->purged[i]);
+		BIT_SET(st.aside, alloc->purged[i]);
+	}
+
+	for (size_t c = 0; c < num_chunks; c++)
+		trim_chunk(alloc, c, &st);
+
+	if (decay)
+		memcpy(alloc->decay_map, st.free, words * sizeof(uint64_t));
+
+	free(alloc->purged);
+	alloc->purged = st.purged;
+	atomic_store_explicit(&alloc->purged_count, st.npurged, memory_order_relaxed);
+	if (st.first != SLAB_NIL)
+		push_chain(alloc, st.first, st.last);
+	atomic_fetch_add(&alloc->trim_seq, 1);
+
+	pthread_mutex_unlock(&alloc->grow_lock);
+	free(st.free);
+	free(st.aside);
+	free(st.pages);
+	return st.released;
+}
+
+size_t slab_trim(slab_allocator_t *alloc)
+{
+	return trim(alloc, 0);
+}
+
+size_t slab_decay(slab_allocator_t *alloc)
+{
+	return trim(alloc, 1);
+}
+
+void slab_fork_lock(slab_allocator_t *alloc)
+{
+	if (alloc)
+		pthread_mutex_lock(&alloc->grow_lock);
+}
+
+void slab_fork_unlock(slab_allocator_t *alloc)
+{
+	if (alloc)
+		pthread_mutex_unlock(&alloc->grow_lock);
+}
+
 void slab_destroy(slab_allocator_t *alloc)
 {
 	if (!alloc)
 		return;
 
-	if (alloc->memory)
-		free(alloc->memory);
-	if (alloc->metadata)
-		free(alloc->metadata);
-	if (alloc->free_list)
-		free(alloc->free_list);
+	size_t num_chunks = atomic_load(&alloc->num_chunks);
+	for (size_t c = 0; c < num_chunks; c++) {
+		slab_chunk_t *chunk = &alloc->chunks[c];
+
+		/* Tear down every block that was ever constructed */
+		for (size_t i = 0; alloc->dtor && i < chunk->num_blocks; i++) {
+			if (chunk->metadata[i].constructed)
+				alloc->dtor(chunk->memory + i * alloc->block_size,
+					    alloc->obj_arg);
+		}
+		free_chunk(alloc, chunk);
+	}
+
+	if (alloc->reserved)
+		alloc->backing.release(&alloc->backing, alloc->reserved,
+				       alloc->reserved_size);
+
+	for (slab_tstat_t *s = atomic_load(&alloc->tstats), *next; s; s = next) {
+		next = s->next;
+		free(s);
+	}
+
+	pthread_mutex_destroy(&alloc->grow_lock);
+	free(alloc->purged);
+	free(alloc->decay_map);
+	free(alloc->chunks);
 	free(alloc);
 }
 
@@ -177,8 +1434,40 @@ int slab_stats(slab_allocator_t *alloc, size_t *used_blocks, size_t *free_blocks
 	if (!alloc || !used_blocks || !free_blocks)
 		return -1;
 
-	*free_blocks = atomic_load(&alloc->free_count);
-	*used_blocks = alloc->num_blocks - *free_blocks;
+	long used = atomic_load_explicit(&alloc->spill.used, memory_order_relaxed);
+	for (slab_tstat_t *s = atomic_load_explicit(&alloc->tstats, memory_order_acquire);
+	     s; s = s->next)
+		used += atomic_load_explicit(&s->used, memory_order_relaxed);
+
+	/* Records are read one by one, so clamp a torn sum to the valid range */
+	size_t num_blocks = atomic_load(&alloc->num_blocks);
+	if (used < 0)
+		used = 0;
+	if ((size_t)used > num_blocks)
+		used = (long)num_blocks;
+
+	*used_blocks = (size_t)used;
+	*free_blocks = num_blocks - (size_t)used;
+
+	return 0;
+}
+
+int slab_stats_ex(slab_allocator_t *alloc, slab_stats_ex_t *stats)
+{
+	if (!alloc || !stats)
+		return -1;
+
+	if (slab_stats(alloc, &stats->used, &stats->free) != 0)
+		return -1;
+
+	stats->cas_retries = atomic_load_explicit(&alloc->spill.retries, memory_order_relaxed);
+	stats->backoff_spins = atomic_load_explicit(&alloc->spill.spins, memory_order_relaxed);
+	stats->purged = atomic_load_explicit(&alloc->purged_count, memory_order_relaxed);
+	for (slab_tstat_t *s = atomic_load_explicit(&alloc->tstats, memory_order_acquire);
+	     s; s = s->next) {
+		stats->cas_retries += atomic_load_explicit(&s->retries, memory_order_relaxed);
+		stats->backoff_spins += atomic_load_explicit(&s->spins, memory_order_relaxed);
+	}
 
 	return 0;
 }
@@ -0,0 +1,114 @@
+#include "../include/topology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* mbind policy from <linux/mempolicy.h>, which libc does not wrap */
+#define TOPO_MPOL_BIND 2
+
+static unsigned int node_count = 1;
+static uint8_t cpu_node[TOPO_MAX_CPUS];
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Parse a sysfs list such as "0-3,8-11" and call fn for each entry.
+ * Returns the largest entry seen, or -1 if the file could not be read.
+ */
+static long parse_list(const char *path, void (*fn)(long, void *), void *arg)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	long max = -1;
+	long lo, hi;
+	int c;
+
+	while (fscanf(f, "%ld", &lo) == 1) {
+		hi = lo;
+		c = fgetc(f);
+		if (c == '-') {
+			if (fscanf(f, "%ld", &hi) != 1)
+				break;
+			c = fgetc(f);
+		}
+
+		for (long i = lo; i <= hi; i++) {
+			if (fn)
+				fn(i, arg);
+		}
+		if (hi > max)
+			max = hi;
+		if (c != ',')
+			break;
+	}
+
+	fclose(f);
+	return max;
+}
+
+static void set_cpu_node(long cpu, void *arg)
+{
+	if (cpu >= 0 && cpu < TOPO_MAX_CPUS)
+		cpu_node[cpu] = (uint8_t)(uintptr_t)arg;
+}
+
+/**
+ * Read the node count and the CPU-to-node table from sysfs.
+ */
+static void init_topology(void)
+{
+	long max = parse_list("/sys/devices/system/node/online", NULL, NULL);
+	if (max < 0)
+		return;
+
+	node_count = max + 1 < TOPO_MAX_NODES ? (unsigned int)max + 1 : TOPO_MAX_NODES;
+
+	for (unsigned int node = 0; node < node_count; node++) {
+		char path[64];
+
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+			 node);
+		parse_list(path, set_cpu_node, (void *)(uintptr_t)node);
+	}
+}
+
+unsigned int topo_node_count(void)
+{
+	pthread_once(&topo_once, init_topology);
+	return node_count;
+}
+
+unsigned int topo_current_node(void)
+{
+	pthread_once(&topo_once, init_topology);
+
+	int cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= TOPO_MAX_CPUS)
+		return 0;
+	return cpu_node[cpu];
+}
+
+int topo_bind(void *ptr, size_t len, unsigned int node)
+{
+	unsigned long mask[TOPO_MAX_NODES / (8 * sizeof(unsigned long)) + 1] = { 0 };
+
+	if (node >= TOPO_MAX_NODES)
+		return -1;
+
+	mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+
+#ifdef SYS_mbind
+	if (syscall(SYS_mbind, ptr, len, TOPO_MPOL_BIND, mask,
+		    (unsigned long)(8 * sizeof(mask)), 0) == 0)
+		return 0;
+#else
+	(void)ptr;
+	(void)len;
+#endif
+	return -1;
+}
@@ -0,0 +1,312 @@
+#include "../include/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Records buffered per thread between writes (96 KB) */
+#define TRACE_BUF_RECORDS 4096
+
+/* Largest timestamp the stamp field can hold */
+#define TRACE_TIME_MAX ((UINT64_C(1) << 48) - 1)
+
+/* Per-thread record buffer, linked into the registry while alive */
+typedef struct trace_buf {
+	struct trace_buf *next;
+	unsigned int thread;
+	size_t count;
+	trace_record_t records[TRACE_BUF_RECORDS];
+} trace_buf_t;
+
+static _Atomic(int) trace_fd = -1;
+static _Atomic(int) write_failed;
+static uint64_t start_ns;
+static _Atomic(unsigned int) next_thread;
+
+static _Thread_local trace_buf_t *self;
+static _Thread_local int busy; /* Inside the recorder: ignore nested calls */
+static trace_buf_t *buffers;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t exit_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * write(2) all of len bytes, retrying short writes.
+ */
+static int write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/**
+ * Write out a buffer's records. Records are dropped if the trace has
+ * been closed in the meantime.
+ */
+static void flush_buf(trace_buf_t *b)
+{
+	if (b->count == 0)
+		return;
+
+	pthread_mutex_lock(&write_lock);
+	int fd = atomic_load_explicit(&trace_fd, memory_order_relaxed);
+	if (fd >= 0 && write_all(fd, b->records, b->count * sizeof(trace_record_t)) != 0)
+		atomic_store_explicit(&write_failed, 1, memory_order_relaxed);
+	pthread_mutex_unlock(&write_lock);
+
+	b->count = 0;
+}
+
+/**
+ * Thread exit: write out the thread's records and release its buffer.
+ */
+static void thread_exit(void *arg)
+{
+	trace_buf_t *b = arg;
+
+	busy = 1;
+	pthread_mutex_lock(&registry_lock);
+	for (trace_buf_t **link = &buffers; *link; link = &(*link)->next) {
+		if (*link == b) {
+			*link = b->next;
+			break;
+		}
+	}
+	flush_buf(b);
+	pthread_mutex_unlock(&registry_lock);
+
+	self = NULL;
+	munmap(b, sizeof(*b));
+	busy = 0;
+}
+
+static void create_key(void)
+{
+	pthread_key_create(&exit_key, thread_exit);
+}
+
+/**
+ * Create and register the calling thread's buffer.
+ */
+static trace_buf_t *register_thread(void)
+{
+	pthread_once(&key_once, create_key);
+
+	trace_buf_t *b = mmap(NULL, sizeof(*b), PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b == MAP_FAILED)
+		return NULL;
+
+	b->count = 0;
+	b->thread = atomic_fetch_add_explicit(&next_thread, 1, memory_order_relaxed) &
+		    (TRACE_MAX_THREADS - 1);
+
+	pthread_mutex_lock(&registry_lock);
+	b->next = buffers;
+	buffers = b;
+	pthread_mutex_unlock(&registry_lock);
+
+	pthread_setspecific(exit_key, b);
+	self = b;
+	return b;
+}
+
+static void append(unsigned int op, const void *ptr, size_t size)
+{
+	if (busy)
+		return;
+	busy = 1;
+
+	trace_buf_t *b = self;
+	if (b || (b = register_thread())) {
+		uint64_t t = now_ns() - start_ns;
+		trace_record_t *r = &b->records[b->count++];
+
+		if (t > TRACE_TIME_MAX)
+			t = TRACE_TIME_MAX;
+		r->stamp = t << 16 | (uint64_t)b->thread << 4 | op;
+		r->addr = (uint64_t)(uintptr_t)ptr;
+		r->size = size;
+
+		if (b->count == TRACE_BUF_RECORDS)
+			flush_buf(b);
+	}
+
+	busy = 0;
+}
+
+int trace_open(const char *path)
+{
+	if (!path)
+		return -1;
+
+	pthread_mutex_lock(&registry_lock);
+	if (atomic_load_explicit(&trace_fd, memory_order_relaxed) >= 0) {
+		pthread_mutex_unlock(&registry_lock);
+		return -1;
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		pthread_mutex_unlock(&registry_lock);
+		return -1;
+	}
+
+	trace_header_t hdr = { .version = TRACE_VERSION,
+			       .record_size = sizeof(trace_record_t) };
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	if (write_all(fd, &hdr, sizeof(hdr)) != 0) {
+		close(fd);
+		pthread_mutex_unlock(&registry_lock);
+		return -1;
+	}
+
+	/* Drop anything left over from an earlier trace */
+	for (trace_buf_t *b = buffers; b; b = b->next)
+		b->count = 0;
+
+	start_ns = now_ns();
+	atomic_store_explicit(&write_failed, 0, memory_order_relaxed);
+	atomic_store_explicit(&trace_fd, fd, memory_order_release);
+	pthread_mutex_unlock(&registry_lock);
+
+	return 0;
+}
+
+void trace_alloc(const void *ptr, size_t size)
+{
+	if (ptr && atomic_load_explicit(&trace_fd, memory_order_acquire) >= 0)
+		append(TRACE_ALLOC, ptr, size);
+}
+
+void trace_free(const void *ptr)
+{
+	if (ptr && atomic_load_explicit(&trace_fd, memory_order_acquire) >= 0)
+		append(TRACE_FREE, ptr, 0);
+}
+
+void trace_flush(void)
+{
+	if (self) {
+		busy = 1;
+		flush_buf(self);
+		busy = 0;
+	}
+}
+
+int trace_close(void)
+{
+	busy = 1;
+	pthread_mutex_lock(&registry_lock);
+
+	int fd = atomic_load_explicit(&trace_fd, memory_order_relaxed);
+	if (fd < 0) {
+		pthread_mutex_unlock(&registry_lock);
+		busy = 0;
+		return -1;
+	}
+
+	for (trace_buf_t *b = buffers; b; b = b->next)
+		flush_buf(b);
+
+	atomic_store_explicit(&trace_fd, -1, memory_order_release);
+	int failed = atomic_load_explicit(&write_failed, memory_order_relaxed);
+	if (close(fd) != 0)
+		failed = 1;
+
+	pthread_mutex_unlock(&registry_lock);
+	busy = 0;
+	return failed ? -1 : 0;
+}
+
+/**
+ * Stable merge sort by time. Records of one thread can share a timestamp
+ * and must keep their file order, which qsort does not promise.
+ */
+static void sort_by_time(trace_record_t *r, trace_record_t *tmp, size_t n)
+{
+	for (size_t width = 1; width < n; width *= 2) {
+		for (size_t lo = 0; lo < n; lo += 2 * width) {
+			size_t mid = lo + width < n ? lo + width : n;
+			size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+			size_t i = lo, j = mid, k = lo;
+
+			while (i < mid && j < hi)
+				tmp[k++] = trace_time_ns(&r[j]) < trace_time_ns(&r[i]) ? r[j++] : r[i++];
+			while (i < mid)
+				tmp[k++] = r[i++];
+			while (j < hi)
+				tmp[k++] = r[j++];
+		}
+		memcpy(r, tmp, n * sizeof(*r));
+	}
+}
+
+trace_record_t *trace_load(const char *path, size_t *count)
+{
+	if (!path || !count)
+		return NULL;
+
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	trace_header_t hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != TRACE_VERSION || hdr.record_size != sizeof(trace_record_t)) {
+		fclose(f);
+		return NULL;
+	}
+
+	long start = ftell(f);
+	if (fseek(f, 0, SEEK_END) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	long end = ftell(f);
+	fseek(f, start, SEEK_SET);
+
+	size_t n = (size_t)(end - start) / sizeof(trace_record_t);
+	trace_record_t *records = malloc((n ? n : 1) * sizeof(trace_record_t));
+	trace_record_t *tmp = malloc((n ? n : 1) * sizeof(trace_record_t));
+	if (!records || !tmp || fread(records, sizeof(trace_record_t), n, f) != n) {
+		free(records);
+		free(tmp);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+
+	sort_by_time(records, tmp, n);
+	free(tmp);
+
+	*count = n;
+	return records;
+}
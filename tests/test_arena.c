@@ -0,0 +1,346 @@
+#include "../include/arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * Arena allocator unit tests. Each test returns 1 on success; CHECK prints
+ * the failing condition and returns 0.
+ */
+
+#define CHECK(cond)                                                        \
+	do {                                                               \
+		if (!(cond)) {                                             \
+			printf("FAIL\n    %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return 0;                                          \
+		}                                                          \
+	} while (0)
+
+#define CAPACITY 4096
+
+static int tests_run;
+static int tests_passed;
+
+static void run_test(const char *name, int (*fn)(void))
+{
+	printf("Test %d: %s... ", ++tests_run, name);
+	fflush(stdout);
+	if (fn()) {
+		printf("PASS\n");
+		tests_passed++;
+	}
+}
+
+static int test_create_destroy(void)
+{
+	arena_allocator_t *arena = arena_create(CAPACITY);
+	CHECK(arena != NULL);
+	arena_destroy(arena);
+
+	CHECK(arena_create(0) == NULL);
+	arena_destroy(NULL);
+	return 1;
+}
+
+static int test_alloc(void)
+{
+	arena_allocator_t *arena = arena_create(CAPACITY);
+	uint8_t *a = arena_alloc(arena, 100);
+	uint8_t *b = arena_alloc(arena, 100);
+
+	CHECK(a != NULL && b != NULL);
+	CHECK(b >= a + 100);
+	memset(a, 1, 100);
+	memset(b, 2, 100);
+	CHECK(a[99] == 1 && b[0] == 2);
+
+	CHECK(arena_alloc(arena, 0) == NULL);
+	CHECK(arena_alloc(NULL, 16) == NULL);
+	arena_destroy(arena);
+	return 1;
+}
+
+static int test_alignment(void)
+{
+	arena_config_t cfg = { .capacity = CAPACITY, .align = 64 };
+	arena_allocator_t *arena = arena_create_ex(&cfg);
+
+	for (int i = 1; i < 20; i++) {
+		void *p = arena_alloc(arena, (size_t)i * 3);
+		CHECK(p != NULL);
+		CHECK(((uintptr_t)p & 63) == 0);
+	}
+	arena_destroy(arena);
+
+	arena = arena_create(CAPACITY);
+	for (int i = 1; i < 20; i++)
+		CHECK(((uintptr_t)arena_alloc(arena, (size_t)i) & 15) == 0);
+	arena_destroy(arena);
+	return 1;
+}
+
+static int test_exhaustion(void)
+{
+	arena_allocator_t *arena = arena_create(CAPACITY);
+
+	CHECK(arena_alloc(arena, CAPACITY) != NULL);
+	CHECK(arena_alloc(arena, 16) == NULL);
+	CHECK(arena_alloc(arena, 2 * CAPACITY) == NULL);
+	arena_destroy(arena);
+	return 1;
+}
+
+static int test_reset(void)
+{
+	arena_allocator_t *arena = arena_create(CAPACITY);
+	void *first = arena_alloc(arena, 64);
+	size_t used, capacity;
+
+	while (arena_alloc(arena, 64))
+		;
+	arena_reset(arena);
+	arena_stats(arena, &used, &capacity);
+	CHECK(used == 0);
+	CHECK(arena_alloc(arena, 64) == first);
+	arena_destroy(arena);
+	return 1;
+}
+
+static int test_grow(void)
+{
+	arena_config_t cfg = { .capacity = CAPACITY, .flags = ARENA_F_GROW,
+			       .max_capacity = 64 * CAPACITY };
+	arena_allocator_t *arena = arena_create_ex(&cfg);
+	size_t used, capacity;
+
+	for (int i = 0; i < 100; i++) {
+		void *p = arena_alloc(arena, 256);
+		CHECK(p != NULL);
+		memset(p, i, 256);
+	}
+	arena_stats(arena, &used, &capacity);
+	CHECK(used >= 100 * 256);
+	CHECK(capacity > CAPACITY);
+
+	/* Oversized requests get a block that fits */
+	CHECK(arena_alloc(arena, 3 * CAPACITY) != NULL);
+
+	/* The cap stops growth */
+	CHECK(arena_alloc(arena, 128 * CAPACITY) == NULL);
+	arena_destroy(arena);
+	return 1;
+}
+
+static int test_trim(void)
+{
+	arena_config_t cfg = { .capacity = CAPACITY, .flags = ARENA_F_GROW };
+	arena_allocator_t *arena = arena_create_ex(&cfg);
+	arena_stats_ex_t st;
+
+	for (int i = 0; i < 16; i++)
+		CHECK(arena_alloc(arena, CAPACITY) != NULL);
+	arena_reset(arena);
+
+	/* The cached blocks go back to the OS but stay reusable */
+	CHECK(arena_trim(arena) > 0);
+	CHECK(arena_trim(arena) == 0);
+	arena_stats_ex(arena, &st);
+	CHECK(st.used == 0 && st.purged > 0);
+	for (int i = 0; i < 16; i++) {
+		void *p = arena_alloc(arena, CAPACITY);
+		CHECK(p != NULL);
+		memset(p, i, CAPACITY);
+	}
+	arena_stats_ex(arena, &st);
+	CHECK(st.purged == 0);
+	arena_destroy(arena);
+	return 1;
+}
+
+static int test_mark_rewind(void)
+{
+	arena_config_t cfg = { .capacity = CAPACITY, .flags = ARENA_F_GROW };
+	arena_allocator_t *arena = arena_create_ex(&cfg);
+	size_t used_before, used_after, capacity;
+
+	arena_alloc(arena, 100);
+	arena_stats(arena, &used_before, &capacity);
+
+	arena_mark_t mark = arena_mark(arena);
+	void *p = arena_alloc(arena, 64);
+	for (int i = 0; i < 200; i++)
+		CHECK(arena_alloc(arena, 128) != NULL); /* Chains more blocks */
+	arena_rewind(arena, mark);
+
+	arena_stats(arena, &used_after, &capacity);
+	CHECK(used_after == used_before);
+	CHECK(arena_alloc(arena, 64) == p);
+	arena_destroy(arena);
+	return 1;
+}
+
+/*
+ * Requests near SIZE_MAX must fail, not wrap the rounding or the block size
+ * into a tiny allocation.
+ */
+static int test_oversized(void)
+{
+	static const unsigned int flags[] = {
+		ARENA_F_GROW, ARENA_F_GROW | ARENA_F_PER_THREAD,
+		ARENA_F_GROW | ARENA_F_SINGLE_THREAD, 0,
+	};
+
+	for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		arena_config_t cfg = { .capacity = CAPACITY, .flags = flags[i] };
+		arena_allocator_t *arena = arena_create_ex(&cfg);
+		size_t used, capacity;
+
+		CHECK(arena != NULL);
+		CHECK(arena_alloc(arena, 64) != NULL);
+		CHECK(arena_alloc(arena, SIZE_MAX) == NULL);
+		CHECK(arena_alloc(arena, SIZE_MAX - 4) == NULL);
+		CHECK(arena_alloc(arena, SIZE_MAX - 15) == NULL);
+		CHECK(arena_alloc_local(arena, SIZE_MAX - 4) == NULL);
+		CHECK(arena_alloc_local(arena, SIZE_MAX - 15) == NULL);
+
+		/* Nothing was chained or consumed by the failures */
+		arena_stats(arena, &used, &capacity);
+		CHECK(used == 64 || (flags[i] & ARENA_F_PER_THREAD));
+		CHECK(capacity == CAPACITY);
+		CHECK(arena_alloc(arena, 64) != NULL);
+		arena_destroy(arena);
+	}
+	return 1;
+}
+
+static int test_single_thread(void)
+{
+	arena_config_t cfg = { .capacity = CAPACITY,
+			       .flags = ARENA_F_GROW | ARENA_F_SINGLE_THREAD };
+	arena_allocator_t *arena = arena_create_ex(&cfg);
+	size_t used, capacity;
+
+	CHECK(arena != NULL);
+	for (int i = 0; i < 1000; i++) {
+		uint8_t *p = arena_alloc_local(arena, 24);
+		CHECK(p != NULL);
+		CHECK(((uintptr_t)p & 15) == 0);
+		p[23] = (uint8_t)i;
+	}
+	arena_stats(arena, &used, &capacity);
+	CHECK(used >= 1000 * 24);
+	arena_destroy(arena);
+
+	cfg.flags = ARENA_F_SINGLE_THREAD | ARENA_F_PER_THREAD;
+	CHECK(arena_create_ex(&cfg) == NULL);
+	return 1;
+}
+
+static int test_per_thread_interleaved(void)
+{
+	/* More arenas than thread-table slots, so sets collide and overflow */
+	enum { ARENAS = 40, ROUNDS = 1000 };
+	arena_config_t cfg = { .capacity = 64 * 1024, .flags = ARENA_F_PER_THREAD };
+	arena_allocator_t *arenas[ARENAS];
+	size_t used, capacity;
+
+	for (int a = 0; a < ARENAS; a++) {
+		arenas[a] = arena_create_ex(&cfg);
+		CHECK(arenas[a] != NULL);
+	}
+
+	/* Alternating arenas must not evict each other's chunks */
+	for (int i = 0; i < ROUNDS; i++) {
+		for (int a = 0; a < ARENAS; a++) {
+			uint8_t *p = arena_alloc(arenas[a], 16);
+			CHECK(p != NULL);
+			p[15] = (uint8_t)i;
+		}
+	}
+
+	/* One 16 KB chunk holds all ROUNDS allocations of an arena */
+	for (int a = 0; a < ARENAS; a++) {
+		CHECK(arena_stats(arenas[a], &used, &capacity) == 0);
+		CHECK(used >= ROUNDS * 16 && used <= 16 * 1024);
+		arena_destroy(arenas[a]);
+	}
+	return 1;
+}
+
+/* Shared by the threaded test workers */
+static arena_allocator_t *shared_arena;
+
+static void *fill(void *arg)
+{
+	long *failures = arg;
+
+	for (int i = 0; i < 5000; i++) {
+		uint64_t *p = arena_alloc(shared_arena, 32);
+		if (!p) {
+			(*failures)++;
+			continue;
+		}
+		p[0] = (uint64_t)(uintptr_t)p;
+		p[3] = (uint64_t)(uintptr_t)p;
+	}
+	return NULL;
+}
+
+static int run_threads(unsigned int flags)
+{
+	enum { THREADS = 8 };
+	arena_config_t cfg = { .capacity = 64 * 1024, .flags = ARENA_F_GROW | flags };
+	pthread_t tids[THREADS];
+	long failures[THREADS] = { 0 };
+	arena_stats_ex_t stats;
+
+	shared_arena = arena_create_ex(&cfg);
+	for (int i = 0; i < THREADS; i++)
+		pthread_create(&tids[i], NULL, fill, &failures[i]);
+	for (int i = 0; i < THREADS; i++) {
+		pthread_join(tids[i], NULL);
+		CHECK(failures[i] == 0);
+	}
+
+	CHECK(arena_stats_ex(shared_arena, &stats) == 0);
+	CHECK(stats.used >= THREADS * 5000 * 32);
+	CHECK(stats.used <= stats.capacity);
+	arena_destroy(shared_arena);
+	return 1;
+}
+
+static int test_threads_shared(void)
+{
+	return run_threads(0);
+}
+
+static int test_threads_per_thread(void)
+{
+	return run_threads(ARENA_F_PER_THREAD);
+}
+
+int main(void)
+{
+	printf("=== Arena Allocator Tests ===\n\n");
+
+	run_test("Create and destroy", test_create_destroy);
+	run_test("Sequential allocation", test_alloc);
+	run_test("Alignment verification", test_alignment);
+	run_test("Exhaustion", test_exhaustion);
+	run_test("Reset", test_reset);
+	run_test("Growable arena", test_grow);
+	run_test("Trim cached blocks", test_trim);
+	run_test("Mark and rewind", test_mark_rewind);
+	run_test("Single-owner inline path", test_single_thread);
+	run_test("Interleaved private-chunk arenas", test_per_thread_interleaved);
+	run_test("Oversized requests", test_oversized);
+	run_test("Multi-threaded shared bump", test_threads_shared);
+	run_test("Multi-threaded private chunks", test_threads_per_thread);
+
+	printf("\n=== Results ===\n");
+	printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+	return tests_passed == tests_run ? 0 : 1;
+}
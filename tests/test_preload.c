@@ -0,0 +1,264 @@
+#include "../include/sizeclass.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <dlfcn.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * Smoke tests for libmempool_preload.so. The program only uses the libc
+ * malloc family; make test runs it with LD_PRELOAD set, so every call goes
+ * through the interposer: start-up, reentrant allocations from inside the
+ * library, cross-thread frees, thread exit and fork. Without LD_PRELOAD it
+ * checks glibc instead. Each test returns 1 on success; CHECK prints the
+ * failing condition and returns 0.
+ */
+
+#define CHECK(cond)                                                        \
+	do {                                                               \
+		if (!(cond)) {                                             \
+			printf("FAIL\n    %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return 0;                                          \
+		}                                                          \
+	} while (0)
+
+#define THREADS 8
+#define PER_THREAD 1000
+
+static int tests_run;
+static int tests_passed;
+
+static void run_test(const char *name, int (*fn)(void))
+{
+	printf("Test %d: %s... ", ++tests_run, name);
+	fflush(stdout);
+	if (fn()) {
+		printf("PASS\n");
+		tests_passed++;
+	}
+}
+
+/* Size i of a sweep over every class and past SC_MAX_SIZE */
+static size_t sweep_size(int i)
+{
+	return (size_t)1 + (size_t)i * 97 % (2 * SC_MAX_SIZE);
+}
+
+static int test_interposed(void)
+{
+	Dl_info info;
+	void *sym = dlsym(RTLD_DEFAULT, "malloc");
+
+	if (!getenv("LD_PRELOAD"))
+		return 1; /* Plain glibc run */
+
+	CHECK(sym != NULL && dladdr(sym, &info) != 0);
+	CHECK(info.dli_fname && strstr(info.dli_fname, "libmempool_preload"));
+	return 1;
+}
+
+static int test_malloc_free(void)
+{
+	enum { N = 2000 };
+	uint8_t *ptrs[N];
+
+	for (int i = 0; i < N; i++) {
+		ptrs[i] = malloc(sweep_size(i));
+		CHECK(ptrs[i] != NULL);
+		CHECK(((uintptr_t)ptrs[i] & 15) == 0);
+		CHECK(malloc_usable_size(ptrs[i]) >= sweep_size(i));
+		memset(ptrs[i], (uint8_t)i, sweep_size(i));
+	}
+	for (int i = 0; i < N; i++) {
+		size_t size = sweep_size(i);
+
+		CHECK(ptrs[i][0] == (uint8_t)i && ptrs[i][size - 1] == (uint8_t)i);
+		free(ptrs[i]);
+	}
+	free(NULL);
+
+	/* A recycled block comes back zeroed from calloc */
+	uint8_t *p = malloc(200);
+	CHECK(p != NULL);
+	memset(p, 0xff, 200);
+	free(p);
+	p = calloc(25, 8);
+	CHECK(p != NULL);
+	for (int i = 0; i < 200; i++)
+		CHECK(p[i] == 0);
+	free(p);
+
+	/* Volatile so the compiler cannot see the overflow coming */
+	static volatile size_t huge = SIZE_MAX / 2;
+	CHECK(calloc(huge, 4) == NULL);
+	return 1;
+}
+
+static int test_realloc(void)
+{
+	uint8_t *p = realloc(NULL, 16);
+
+	CHECK(p != NULL);
+	for (int i = 0; i < 16; i++)
+		p[i] = (uint8_t)i;
+
+	/* Grow through the classes and into glibc, then shrink back */
+	for (size_t size = 32; size <= 4 * SC_MAX_SIZE; size *= 2) {
+		p = realloc(p, size);
+		CHECK(p != NULL);
+		for (int i = 0; i < 16; i++)
+			CHECK(p[i] == (uint8_t)i);
+		memset(p + 16, 0xa5, size - 16);
+	}
+	p = realloc(p, 24);
+	CHECK(p != NULL);
+	for (int i = 0; i < 16; i++)
+		CHECK(p[i] == (uint8_t)i);
+	free(p);
+	return 1;
+}
+
+static int test_aligned(void)
+{
+	void *p;
+
+	for (size_t align = sizeof(void *); align <= 8192; align *= 2) {
+		CHECK(posix_memalign(&p, align, 100) == 0);
+		CHECK(((uintptr_t)p & (align - 1)) == 0);
+		memset(p, 0xa5, 100);
+		free(p);
+
+		p = aligned_alloc(align, 4 * align);
+		CHECK(p != NULL && ((uintptr_t)p & (align - 1)) == 0);
+		memset(p, 0xa5, 4 * align);
+		free(p);
+
+		p = memalign(align, 33);
+		CHECK(p != NULL && ((uintptr_t)p & (align - 1)) == 0);
+		free(p);
+	}
+
+	CHECK(posix_memalign(&p, 24, 100) == EINVAL);
+	p = valloc(100);
+	CHECK(p != NULL && ((uintptr_t)p & ((uintptr_t)sysconf(_SC_PAGESIZE) - 1)) == 0);
+	free(p);
+	return 1;
+}
+
+/* Allocate PER_THREAD blocks for the main thread to free after we exit */
+static void *churn(void *arg)
+{
+	void **out = arg;
+
+	for (int i = 0; i < PER_THREAD; i++) {
+		void *tmp = malloc(sweep_size(i));
+
+		out[i] = malloc(sweep_size(i + 1));
+		if (!tmp || !out[i])
+			return out;
+		memset(out[i], 0x5a, sweep_size(i + 1));
+		free(tmp);
+	}
+	return NULL;
+}
+
+static int test_threads(void)
+{
+	static void *held[THREADS][PER_THREAD];
+	pthread_t tids[THREADS];
+
+	for (int round = 0; round < 3; round++) {
+		for (int t = 0; t < THREADS; t++)
+			CHECK(pthread_create(&tids[t], NULL, churn, held[t]) == 0);
+		for (int t = 0; t < THREADS; t++) {
+			void *failed;
+
+			CHECK(pthread_join(tids[t], &failed) == 0 && failed == NULL);
+		}
+
+		/* Freed by another thread, after their allocating thread is gone */
+		for (int t = 0; t < THREADS; t++) {
+			for (int i = 0; i < PER_THREAD; i++) {
+				CHECK(((uint8_t *)held[t][i])[0] == 0x5a);
+				free(held[t][i]);
+			}
+		}
+	}
+	return 1;
+}
+
+/* Keep allocating while the main thread forks */
+static _Atomic(int) forking;
+
+static void *fork_churn(void *arg)
+{
+	(void)arg;
+	while (atomic_load(&forking)) {
+		void *p = malloc(64);
+
+		free(p);
+	}
+	return NULL;
+}
+
+static int test_fork(void)
+{
+	pthread_t tid;
+	char *shared = malloc(1000);
+
+	CHECK(shared != NULL);
+	memset(shared, 'p', 1000);
+
+	atomic_store(&forking, 1);
+	CHECK(pthread_create(&tid, NULL, fork_churn, NULL) == 0);
+	for (int i = 0; i < 20; i++) {
+		pid_t pid = fork();
+		int status;
+
+		CHECK(pid >= 0);
+		if (pid == 0) {
+			/* The child can allocate, and free what the parent allocated */
+			int ok = shared[999] == 'p';
+
+			for (int j = 0; j < 1000 && ok; j++) {
+				void *p = malloc(sweep_size(j));
+
+				ok = p != NULL;
+				free(p);
+			}
+			free(shared);
+			_exit(ok ? 0 : 1);
+		}
+		CHECK(waitpid(pid, &status, 0) == pid);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+	atomic_store(&forking, 0);
+	CHECK(pthread_join(tid, NULL) == 0);
+
+	free(shared);
+	return 1;
+}
+
+int main(void)
+{
+	printf("=== Preload Smoke Tests (%s) ===\n\n",
+	       getenv("LD_PRELOAD") ? "LD_PRELOAD" : "glibc");
+
+	run_test("malloc is interposed", test_interposed);
+	run_test("malloc, calloc and free", test_malloc_free);
+	run_test("realloc across classes", test_realloc);
+	run_test("Aligned allocation", test_aligned);
+	run_test("Cross-thread frees and thread exit", test_threads);
+	run_test("fork while allocating", test_fork);
+
+	printf("\n=== Results ===\n");
+	printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+	return tests_passed == tests_run ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include "../include/sizeclass.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Size-class allocator unit tests. Each test returns 1 on success; CHECK
+ * prints the failing condition and returns 0.
+ */
+
+#define CHECK(cond)                                                        \
+	do {                                                               \
+		if (!(cond)) {                                             \
+			printf("FAIL\n    %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return 0;                                          \
+		}                                                          \
+	} while (0)
+
+/* Small allocator for the fallback tests: 64 blocks in the 16-byte class */
+#define SMALL_MAX     1024
+#define SMALL_BLOCKS  64
+#define SMALL_EXTRA   8
+
+static int tests_run;
+static int tests_passed;
+
+static void run_test(const char *name, int (*fn)(void))
+{
+	printf("Test %d: %s... ", ++tests_run, name);
+	fflush(stdout);
+	if (fn()) {
+		printf("PASS\n");
+		tests_passed++;
+	}
+}
+
+static sizeclass_allocator_t *small_create(void)
+{
+	sc_config_t cfg = {
+		.max_size = SMALL_MAX,
+		.bytes_per_class = SMALL_BLOCKS * 16,
+		.cache_bytes = 4 * 16,
+	};
+
+	return sc_create(&cfg);
+}
+
+static int in_set(void *const *set, int n, const void *p)
+{
+	for (int i = 0; i < n; i++)
+		if (set[i] == p)
+			return 1;
+	return 0;
+}
+
+static int test_class_boundaries(void)
+{
+	static const size_t sizes[] = { 16, 128, 129, SC_MAX_SIZE, SC_MAX_SIZE + 1 };
+	static const size_t classes[] = { 16, 128, 160, SC_MAX_SIZE, 0 };
+
+	CHECK(sc_class_size(1) == 16);
+	CHECK(sc_class_size(17) == 32);
+
+	sizeclass_allocator_t *sc = sc_create(NULL);
+	CHECK(sc != NULL);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		CHECK(sc_class_size(sizes[i]) == classes[i]);
+
+		/* The whole request must be writable, whichever side serves it */
+		void *p = sc_alloc(sc, sizes[i]);
+		CHECK(p != NULL);
+		memset(p, 0xa5, sizes[i]);
+		CHECK(sc_free(sc, p) == 0);
+	}
+
+	CHECK(sc_free(sc, NULL) == 0);
+	sc_destroy(sc);
+	return 1;
+}
+
+static int test_max_size_fallback(void)
+{
+	sizeclass_allocator_t *sc = small_create();
+	CHECK(sc != NULL);
+
+	void *small = sc_alloc(sc, 16);
+	CHECK(small != NULL);
+
+	/* Above max_size: no class pool exists, malloc serves it */
+	void *big = sc_alloc(sc, 2 * SMALL_MAX);
+	void *edge = sc_alloc(sc, SMALL_MAX + 1);
+	CHECK(big != NULL && edge != NULL);
+	memset(big, 0xa5, 2 * SMALL_MAX);
+	memset(edge, 0xa5, SMALL_MAX + 1);
+
+	CHECK(sc_free(sc, big) == 0);
+	CHECK(sc_free(sc, edge) == 0);
+	CHECK(sc_free(sc, small) == 0);
+	sc_destroy(sc);
+	return 1;
+}
+
+static int test_exhausted_fallback(void)
+{
+	void *ptrs[SMALL_BLOCKS + SMALL_EXTRA];
+	void *again[SMALL_BLOCKS + SMALL_EXTRA];
+	const int total = SMALL_BLOCKS + SMALL_EXTRA;
+
+	sizeclass_allocator_t *sc = small_create();
+	CHECK(sc != NULL);
+
+	/* The class holds SMALL_BLOCKS blocks; past that, malloc serves */
+	for (int i = 0; i < total; i++) {
+		ptrs[i] = sc_alloc(sc, 16);
+		CHECK(ptrs[i] != NULL);
+		memset(ptrs[i], 0xa5, 16);
+	}
+	for (int i = 0; i < total; i++)
+		CHECK(sc_free(sc, ptrs[i]) == 0);
+
+	/*
+	 * The malloc blocks went back to malloc, not into the class: the class
+	 * hands out exactly its own blocks again, then falls back once more.
+	 */
+	for (int i = 0; i < total; i++) {
+		again[i] = sc_alloc(sc, 16);
+		CHECK(again[i] != NULL);
+		if (i < SMALL_BLOCKS)
+			CHECK(in_set(ptrs, SMALL_BLOCKS, again[i]));
+		else
+			CHECK(!in_set(ptrs, SMALL_BLOCKS, again[i]));
+	}
+	for (int i = 0; i < total; i++)
+		CHECK(sc_free(sc, again[i]) == 0);
+
+	sc_destroy(sc);
+	return 1;
+}
+
+static int test_free_routing(void)
+{
+	sizeclass_allocator_t *sc = sc_create(NULL);
+	CHECK(sc != NULL);
+
+	void *a = sc_alloc(sc, 100);
+	void *b = sc_alloc(sc, 200);
+	CHECK(a != NULL && b != NULL);
+	CHECK(sc_free(sc, b) == 0);
+	CHECK(sc_free(sc, a) == 0);
+
+	/* Each block went back to its own class: both come back as they left */
+	CHECK(sc_alloc(sc, 200) == b);
+	CHECK(sc_alloc(sc, 100) == a);
+	CHECK(sc_free(sc, a) == 0);
+	CHECK(sc_free(sc, b) == 0);
+
+	sc_destroy(sc);
+	return 1;
+}
+
+int main(void)
+{
+	printf("=== Size-Class Allocator Tests ===\n\n");
+
+	run_test("Class boundaries", test_class_boundaries);
+	run_test("Fallback above max_size", test_max_size_fallback);
+	run_test("Fallback on an exhausted class", test_exhausted_fallback);
+	run_test("Free routes to the owning class", test_free_routing);
+
+	printf("\n=== Results ===\n");
+	printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+	return tests_passed == tests_run ? 0 : 1;
+}
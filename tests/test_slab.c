@@ -0,0 +1,1164 @@
+#include "../include/slab.h"
+#include "../include/backing.h"
+#include "../include/pagemap.h"
+#include "../include/mempool.h"
+#include "../include/lockfree.h"
+#include "../include/topology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * Slab allocator unit tests. Each test returns 1 on success; CHECK prints
+ * the failing condition and returns 0.
+ */
+
+#define CHECK(cond)                                                        \
+	do {                                                               \
+		if (!(cond)) {                                             \
+			printf("FAIL\n    %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return 0;                                          \
+		}                                                          \
+	} while (0)
+
+#define NUM_BLOCKS 128
+#define BLOCK_SIZE 64
+
+static int tests_run;
+static int tests_passed;
+
+static void run_test(const char *name, int (*fn)(void))
+{
+	printf("Test %d: %s... ", ++tests_run, name);
+	fflush(stdout);
+	if (fn()) {
+		printf("PASS\n");
+		tests_passed++;
+	}
+}
+
+static int in_set(void *const *set, int n, const void *p)
+{
+	for (int i = 0; i < n; i++)
+		if (set[i] == p)
+			return 1;
+	return 0;
+}
+
+static int test_create_destroy(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	CHECK(slab != NULL);
+	slab_destroy(slab);
+
+	CHECK(slab_create(0, NUM_BLOCKS) == NULL);
+	CHECK(slab_create(BLOCK_SIZE, 0) == NULL);
+	slab_destroy(NULL);
+	return 1;
+}
+
+static int test_alloc_single(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	void *p = slab_alloc(slab);
+
+	CHECK(p != NULL);
+	memset(p, 0xAB, BLOCK_SIZE);
+	CHECK(slab_free(slab, p) == 0);
+	CHECK(slab_alloc(NULL) == NULL);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_alloc_all(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	void *ptrs[NUM_BLOCKS];
+
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+		memset(ptrs[i], i, BLOCK_SIZE);
+	}
+	CHECK(slab_alloc(slab) == NULL);
+
+	/* Blocks must not overlap: each still holds its own pattern */
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK(((uint8_t *)ptrs[i])[BLOCK_SIZE - 1] == (uint8_t)i);
+
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_free_realloc(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	void *ptrs[NUM_BLOCKS];
+
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		ptrs[i] = slab_alloc(slab);
+	CHECK(slab_free(slab, ptrs[7]) == 0);
+
+	/* The only free block must come straight back */
+	void *p = slab_alloc(slab);
+	CHECK(p == ptrs[7]);
+	CHECK(slab_alloc(slab) == NULL);
+
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		slab_free(slab, ptrs[i]);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_double_free(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	void *p = slab_alloc(slab);
+
+	CHECK(slab_free(slab, p) == 0);
+	CHECK(slab_free(slab, p) == -1);
+
+	/* Fast mode catches it only with SLAB_F_VALIDATE */
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = NUM_BLOCKS,
+			      .flags = SLAB_F_FAST | SLAB_F_VALIDATE };
+	slab_allocator_t *fast = slab_create_ex(&cfg);
+	p = slab_alloc(fast);
+	CHECK(slab_free(fast, p) == 0);
+	CHECK(slab_free(fast, p) == -1);
+
+	slab_destroy(fast);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_alignment(void)
+{
+	static const size_t aligns[] = { MEMPOOL_ALIGN_DEFAULT, 8, 64, 256,
+					 MEMPOOL_ALIGN_PAGE };
+
+	for (size_t a = 0; a < sizeof(aligns) / sizeof(aligns[0]); a++) {
+		slab_config_t cfg = { .block_size = 40, .num_blocks = 32,
+				      .align = aligns[a] };
+		slab_allocator_t *slab = slab_create_ex(&cfg);
+		size_t want = resolve_alignment(aligns[a]);
+
+		CHECK(slab != NULL);
+		for (int i = 0; i < 32; i++) {
+			void *p = slab_alloc(slab);
+			CHECK(p != NULL);
+			CHECK(((uintptr_t)p & (want - 1)) == 0);
+		}
+		slab_destroy(slab);
+	}
+
+	slab_config_t bad = { .block_size = 40, .num_blocks = 32, .align = 24 };
+	CHECK(slab_create_ex(&bad) == NULL);
+
+	/* Detected line: a plausible power of two; headers padded to it */
+	size_t line = cache_line_size();
+	CHECK(line >= 16 && (line & (line - 1)) == 0);
+	CHECK(cache_padding() >= line && cache_padding() >= CACHE_DESTRUCTIVE_SIZE);
+
+	void *hdr = cache_aligned_alloc(40);
+	CHECK(hdr != NULL);
+	CHECK(((uintptr_t)hdr & (cache_padding() - 1)) == 0);
+	free(hdr);
+	return 1;
+}
+
+static int test_stats(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	void *ptrs[10];
+	size_t used, free_blocks;
+
+	CHECK(slab_stats(slab, &used, &free_blocks) == 0);
+	CHECK(used == 0 && free_blocks == NUM_BLOCKS);
+
+	for (int i = 0; i < 10; i++)
+		ptrs[i] = slab_alloc(slab);
+	slab_stats(slab, &used, &free_blocks);
+	CHECK(used == 10 && free_blocks == NUM_BLOCKS - 10);
+
+	for (int i = 0; i < 4; i++)
+		slab_free(slab, ptrs[i]);
+	slab_stats_ex_t ex;
+	CHECK(slab_stats_ex(slab, &ex) == 0);
+	CHECK(ex.used == 6 && ex.free == NUM_BLOCKS - 6);
+
+	CHECK(slab_stats(NULL, &used, &free_blocks) == -1);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_invalid_free(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	uint8_t *p = slab_alloc(slab);
+	int local;
+
+	CHECK(slab_free(slab, NULL) == -1);
+	CHECK(slab_free(slab, &local) == -1);
+	CHECK(slab_free(slab, p + 1) == -1);
+	CHECK(slab_owns(slab, p) == 1);
+	CHECK(slab_owns(slab, &local) == 0);
+	CHECK(slab_free(slab, p) == 0);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_batch(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	void *ptrs[NUM_BLOCKS];
+	size_t used, free_blocks;
+
+	size_t got = slab_alloc_batch(slab, ptrs, 32);
+	CHECK(got > 0 && got <= 32);
+	CHECK(slab_free_batch(slab, ptrs, got) == 0);
+
+	/* All or nothing */
+	CHECK(slab_alloc_n(slab, ptrs, NUM_BLOCKS) == 0);
+	CHECK(slab_alloc(slab) == NULL);
+	CHECK(slab_free_batch(slab, ptrs, NUM_BLOCKS / 2) == 0);
+	CHECK(slab_alloc_n(slab, ptrs, NUM_BLOCKS) == -1);
+	slab_stats(slab, &used, &free_blocks);
+	CHECK(used == NUM_BLOCKS / 2);
+
+	slab_free_batch(slab, ptrs + NUM_BLOCKS / 2, NUM_BLOCKS / 2);
+	slab_destroy(slab);
+
+	/* Prefetching pools hand out the same blocks */
+	pool_config_t cfg = { .block_size = 256, .blocks_per_thread = 16,
+			      .total_blocks = NUM_BLOCKS,
+			      .flags = POOL_F_BATCH | POOL_F_PREFETCH };
+	mempool_t *pool = pool_create_ex(&cfg);
+	CHECK(pool != NULL);
+	CHECK(pool_alloc_prefetch_n(pool, ptrs, NUM_BLOCKS) == 0);
+	CHECK(pool_alloc_prefetch_n(pool, ptrs, 1) == -1);
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		memset(ptrs[i], i, 256);
+	CHECK(pool_free_n(pool, ptrs, NUM_BLOCKS) == 0);
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK((ptrs[i] = pool_alloc_fast(pool)) != NULL);
+	CHECK(pool_free_n(pool, ptrs, NUM_BLOCKS) == 0);
+	pool_destroy(pool);
+
+	/* An overflow flushes the oldest half; the recently freed blocks stay */
+	cfg = (pool_config_t){ .block_size = 64, .blocks_per_thread = 8,
+			       .total_blocks = NUM_BLOCKS, .flags = POOL_F_BATCH };
+	pool = pool_create_ex(&cfg);
+	CHECK(pool != NULL);
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK((ptrs[i] = pool_alloc(pool)) != NULL);
+	for (int i = 0; i <= 8; i++)
+		CHECK(pool_free(pool, ptrs[i]) == 0);
+	for (int i = 8; i >= 4; i--)
+		CHECK(pool_alloc(pool) == ptrs[i]);
+	for (int i = 4; i <= 8; i++)
+		CHECK(pool_free(pool, ptrs[i]) == 0);
+	CHECK(pool_free_n(pool, ptrs + 9, NUM_BLOCKS - 9) == 0);
+	pool_destroy(pool);
+	return 1;
+}
+
+/*
+ * Run bursts of 4 * ADAPT_MAX allocations and as many frees: every refill
+ * and flush is a slow event, so the magazine grows as far as it may.
+ */
+#define ADAPT_BASE 4
+#define ADAPT_MAX  32
+
+static int adapt_bursts(mempool_t *pool, int rounds)
+{
+	void *ptrs[4 * ADAPT_MAX];
+
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < 4 * ADAPT_MAX; i++)
+			CHECK((ptrs[i] = pool_alloc(pool)) != NULL);
+		for (int i = 0; i < 4 * ADAPT_MAX; i++)
+			CHECK(pool_free(pool, ptrs[i]) == 0);
+	}
+	return 1;
+}
+
+static int test_adaptive(void)
+{
+	/* Bounded by the per-thread ceiling, then by a tighter cache_limit */
+	static const size_t limits[] = { 0, ADAPT_MAX / 2 };
+
+	for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+		pool_config_t cfg = {
+			.block_size = BLOCK_SIZE,
+			.blocks_per_thread = ADAPT_BASE,
+			.total_blocks = 8 * ADAPT_MAX,
+			.flags = POOL_F_ADAPTIVE,
+			.max_blocks_per_thread = ADAPT_MAX,
+			.cache_limit = limits[l],
+		};
+		size_t bound = limits[l] ? limits[l] : ADAPT_MAX;
+		mempool_t *pool = pool_create_ex(&cfg);
+		pool_stats_ex_t st, idle;
+
+		CHECK(pool != NULL);
+		CHECK(adapt_bursts(pool, 1));
+		pool_stats_ex(pool, &st);
+		CHECK(st.grows > 0 && st.cache_capacity == bound);
+
+		/* At the bound, more bursts grow nothing */
+		CHECK(adapt_bursts(pool, 8));
+		pool_stats_ex(pool, &idle);
+		CHECK(idle.grows == st.grows && idle.cache_capacity == bound);
+		CHECK(idle.shrinks == 0 && idle.idle_returned == 0);
+
+		/*
+		 * Hits that touch a single block: the first tick boundary ends the
+		 * bursts' interval, the next one finds the rest of the full
+		 * magazine idle, returns it to the slab and halves the capacity.
+		 */
+		for (int i = 0; i < 2 * POOL_ADAPT_INTERVAL; i++) {
+			void *p = pool_alloc(pool);
+			CHECK(p != NULL && pool_free(pool, p) == 0);
+		}
+		pool_stats_ex(pool, &st);
+		CHECK(st.shrinks > 0 && st.idle_returned > 0);
+		CHECK(st.cache_capacity < bound);
+		CHECK(st.free == idle.free + st.idle_returned);
+		CHECK(st.allocated == idle.allocated - st.idle_returned);
+
+		/* Idle ticks shrink it back to blocks_per_thread, never below */
+		for (int i = 0; i < 8 * POOL_ADAPT_INTERVAL; i++) {
+			void *p = pool_alloc(pool);
+			CHECK(p != NULL && pool_free(pool, p) == 0);
+		}
+		pool_stats_ex(pool, &st);
+		CHECK(st.cache_capacity == ADAPT_BASE);
+		pool_destroy(pool);
+	}
+	return 1;
+}
+
+/*
+ * Two node slabs forced on a single-node machine: this thread always maps
+ * to node 0, so node 1 only gives blocks by stealing. On a NUMA machine the
+ * thread may migrate between nodes, and only the totals are checked.
+ */
+#define NUMA_BLOCKS 64
+
+static int test_numa(void)
+{
+	pool_config_t cfg = {
+		.block_size = BLOCK_SIZE,
+		.blocks_per_thread = 8,
+		.total_blocks = NUMA_BLOCKS,
+		.flags = POOL_F_NUMA | POOL_F_BATCH,
+		.numa_nodes = 2,
+	};
+	void *ptrs[NUMA_BLOCKS], *again[NUMA_BLOCKS / 2];
+	mempool_t *pool = pool_create_ex(&cfg);
+	pool_numa_stats_t ns;
+	size_t allocated, free_count;
+	int fixed = topo_node_count() == 1;
+
+	CHECK(pool != NULL);
+	CHECK(pool_numa_stats(pool, &ns) == 0 && ns.num_nodes == 2);
+
+	/* Half comes from the local node, the rest is stolen once it runs dry */
+	for (int i = 0; i < NUMA_BLOCKS; i++)
+		CHECK((ptrs[i] = pool_alloc(pool)) != NULL);
+	CHECK(pool_alloc(pool) == NULL);
+	pool_numa_stats(pool, &ns);
+	CHECK(ns.local_blocks + ns.remote_blocks == NUMA_BLOCKS);
+	CHECK(!fixed || (ns.local_blocks == NUMA_BLOCKS / 2 && ns.remote_frees == 0));
+
+	/* Every stolen block goes home to the other node's slab */
+	for (int i = 0; i < NUMA_BLOCKS; i++)
+		CHECK(pool_free(pool, ptrs[i]) == 0);
+	pool_trim(pool);
+	pool_numa_stats(pool, &ns);
+	CHECK(!fixed || ns.remote_frees == NUMA_BLOCKS / 2);
+	CHECK(pool_stats(pool, &allocated, &free_count) == 0);
+	CHECK(allocated == 0 && free_count == NUMA_BLOCKS);
+
+	/* The local slab got its own blocks back: no stealing this time */
+	for (int i = 0; i < NUMA_BLOCKS / 2; i++) {
+		CHECK((again[i] = pool_alloc(pool)) != NULL);
+		CHECK(!fixed || in_set(ptrs, NUMA_BLOCKS / 2, again[i]));
+	}
+	pool_numa_stats(pool, &ns);
+	CHECK(!fixed || (ns.local_blocks == NUMA_BLOCKS &&
+			 ns.remote_blocks == NUMA_BLOCKS / 2));
+	CHECK(pool_free_n(pool, again, NUMA_BLOCKS / 2) == 0);
+	pool_trim(pool);
+	pool_stats(pool, &allocated, &free_count);
+	CHECK(allocated == 0);
+	pool_destroy(pool);
+	return 1;
+}
+
+static int test_grow(void)
+{
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = 0,
+			      .flags = SLAB_F_GROW, .chunk_blocks = 16,
+			      .max_blocks = 64 };
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	void *ptrs[64];
+	size_t used, free_blocks;
+
+	CHECK(slab != NULL);
+	for (int i = 0; i < 64; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+	}
+	CHECK(slab_alloc(slab) == NULL); /* Cap reached */
+
+	slab_stats(slab, &used, &free_blocks);
+	CHECK(used == 64 && free_blocks == 0);
+	for (int i = 0; i < 64; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_backing(void)
+{
+	mempool_backing_t mmap_backing = backing_mmap(BACKING_F_POPULATE);
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = 0,
+			      .flags = SLAB_F_GROW | SLAB_F_FAST, .chunk_blocks = 64,
+			      .max_blocks = 1024, .backing = &mmap_backing };
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	void *ptrs[256];
+
+	CHECK(slab != NULL);
+	for (int i = 0; i < 256; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+		memset(ptrs[i], 0x5A, BLOCK_SIZE);
+	}
+	for (int i = 0; i < 256; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_trim(void)
+{
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = 0,
+			      .flags = SLAB_F_GROW | SLAB_F_FAST, .chunk_blocks = 256,
+			      .max_blocks = 1024 };
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	pool_config_t pcfg = { .block_size = BLOCK_SIZE, .blocks_per_thread = 8,
+			       .total_blocks = 1024 };
+	mempool_t *pool = pool_create_ex(&pcfg);
+	void *ptrs[1024];
+	slab_stats_ex_t st;
+	pool_stats_ex_t pst;
+
+	CHECK(slab != NULL && pool != NULL);
+	for (int i = 0; i < 1024; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+		memset(ptrs[i], 0x5A, BLOCK_SIZE);
+	}
+
+	/* Pages with a live block stay */
+	for (int i = 0; i < 512; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	CHECK(slab_trim(slab) >= 512 * BLOCK_SIZE - 8192);
+	slab_stats_ex(slab, &st);
+	CHECK(st.free == 512 && st.purged > 0 && st.purged <= 512);
+
+	/* Decay releases only what stayed free since its previous pass */
+	for (int i = 512; i < 1024; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	CHECK(slab_decay(slab) == 0);
+	CHECK(slab_decay(slab) >= 512 * BLOCK_SIZE - 8192);
+
+	/* Set-aside blocks come back once the free list runs dry */
+	for (int i = 0; i < 1024; i++)
+		CHECK((ptrs[i] = slab_alloc(slab)) != NULL);
+	CHECK(slab_alloc(slab) == NULL);
+	slab_stats_ex(slab, &st);
+	CHECK(st.used == 1024 && st.purged == 0);
+	for (int i = 0; i < 1024; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	slab_destroy(slab);
+
+	/* pool_trim also drains the calling thread's magazine */
+	CHECK(pool_alloc_n(pool, ptrs, 1024) == 0);
+	CHECK(pool_free_n(pool, ptrs, 1024) == 0);
+	CHECK(pool_trim(pool) > 0);
+	pool_stats_ex(pool, &pst);
+	CHECK(pst.purged > 0 && pst.free == 1024);
+	pool_destroy(pool);
+	return 1;
+}
+
+static int test_color_spread(void)
+{
+	slab_config_t cfg = { .block_size = 4096, .num_blocks = 0,
+			      .flags = SLAB_F_GROW | SLAB_F_COLOR, .chunk_blocks = 2,
+			      .max_blocks = 16 };
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	void *ptrs[NUM_BLOCKS];
+	int offsets = 0;
+
+	/* Chunks start at different lines within the page */
+	CHECK(slab != NULL);
+	for (int i = 0; i < 16; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+		CHECK(((uintptr_t)ptrs[i] & (CACHE_LINE_SIZE - 1)) == 0);
+		memset(ptrs[i], 0x5A, 4096);
+	}
+	for (int i = 2; i < 16; i += 2)
+		offsets += (uintptr_t)ptrs[i] % 4096 != (uintptr_t)ptrs[i - 2] % 4096;
+	CHECK(offsets == 7);
+	for (int i = 0; i < 16; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	slab_destroy(slab);
+
+	/* Back-to-back allocations of small blocks land on different lines */
+	slab_config_t spread = { .block_size = 16, .num_blocks = NUM_BLOCKS,
+				 .flags = SLAB_F_SPREAD | SLAB_F_FAST };
+	CHECK((slab = slab_create_ex(&spread)) != NULL);
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+		if (i > 0)
+			CHECK((uintptr_t)ptrs[i] / CACHE_LINE_SIZE !=
+			      (uintptr_t)ptrs[i - 1] / CACHE_LINE_SIZE);
+	}
+	CHECK(slab_alloc(slab) == NULL);
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK(slab_free(slab, ptrs[i]) == 0);
+	slab_destroy(slab);
+	return 1;
+}
+
+/* Constructor/destructor call counts, passed as obj_arg */
+typedef struct {
+	int ctors;
+	int dtors;
+} obj_counts_t;
+
+static void obj_ctor(void *obj, void *arg)
+{
+	((obj_counts_t *)arg)->ctors++;
+	memset(obj, 0xC7, BLOCK_SIZE);
+}
+
+static void obj_dtor(void *obj, void *arg)
+{
+	(void)obj;
+	((obj_counts_t *)arg)->dtors++;
+}
+
+static int test_ctor_cache(void)
+{
+	obj_counts_t counts = { 0, 0 };
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = 0,
+			      .flags = SLAB_F_GROW, .chunk_blocks = 16,
+			      .ctor = obj_ctor, .dtor = obj_dtor, .obj_arg = &counts };
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	unsigned char *ptrs[32];
+
+	CHECK(slab != NULL);
+	CHECK(counts.ctors == 0); /* Nothing constructed until handed out */
+	for (int i = 0; i < 32; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL && ptrs[i][0] == 0xC7);
+		ptrs[i][1] = (unsigned char)i;
+	}
+	CHECK(counts.ctors == 32);
+
+	/* Recycled blocks come back constructed, with their state intact */
+	CHECK(slab_free_batch(slab, (void **)ptrs, 32) == 0);
+	CHECK(slab_alloc_n(slab, (void **)ptrs, 32) == 0);
+	for (int i = 0; i < 32; i++)
+		CHECK(ptrs[i][0] == 0xC7);
+	CHECK(counts.ctors == 32);
+	CHECK(slab_free_batch(slab, (void **)ptrs, 32) == 0);
+
+	slab_destroy(slab);
+	CHECK(counts.dtors == 32);
+
+	/* Fast mode links free blocks through constructed state */
+	cfg.flags |= SLAB_F_FAST;
+	CHECK(slab_create_ex(&cfg) == NULL);
+	return 1;
+}
+
+static int test_handles(void)
+{
+	slab_allocator_t *slab = slab_create(BLOCK_SIZE, NUM_BLOCKS);
+	slab_handle_t h[NUM_BLOCKS];
+	size_t used, free_blocks;
+
+	CHECK(slab != NULL);
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		h[i] = slab_alloc_handle(slab);
+		CHECK(h[i] != SLAB_HANDLE_NULL);
+		CHECK(slab_deref(slab, h[i]) != NULL);
+		*(int *)slab_deref(slab, h[i]) = i;
+	}
+	CHECK(slab_alloc_handle(slab) == SLAB_HANDLE_NULL); /* Exhausted */
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK(*(int *)slab_deref(slab, h[i]) == i);
+
+	/* A freed block's handle goes stale, and stays stale after reuse */
+	void *p = slab_deref(slab, h[0]);
+	CHECK(slab_free_handle(slab, h[0]) == 0);
+	CHECK(slab_deref(slab, h[0]) == NULL);
+	CHECK(slab_free_handle(slab, h[0]) == -1);
+	slab_handle_t again = slab_alloc_handle(slab);
+	CHECK(again != h[0] && slab_deref(slab, again) == p);
+	CHECK(slab_deref(slab, h[0]) == NULL);
+
+	/* Handle and pointer frees exclude each other */
+	CHECK(slab_free(slab, slab_deref(slab, again)) == 0);
+	CHECK(slab_free_handle(slab, again) == -1);
+	for (int i = 1; i < NUM_BLOCKS; i++)
+		CHECK(slab_free_handle(slab, h[i]) == 0);
+	slab_stats(slab, &used, &free_blocks);
+	CHECK(used == 0 && free_blocks == NUM_BLOCKS);
+	slab_destroy(slab);
+
+	/* Fast mode has nowhere to keep generations */
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = 8,
+			      .flags = SLAB_F_FAST };
+	slab = slab_create_ex(&cfg);
+	CHECK(slab != NULL);
+	CHECK(slab_alloc_handle(slab) == SLAB_HANDLE_NULL);
+	slab_destroy(slab);
+	return 1;
+}
+
+static int test_pagemap(void)
+{
+	slab_config_t cfg = { .block_size = BLOCK_SIZE, .num_blocks = 0,
+			      .flags = SLAB_F_GROW | SLAB_F_REGISTER, .chunk_blocks = 16 };
+	slab_allocator_t *slab = slab_create_ex(&cfg);
+	void *ptrs[256];
+
+	CHECK(slab != NULL);
+	for (int i = 0; i < 256; i++) {
+		ptrs[i] = slab_alloc(slab);
+		CHECK(ptrs[i] != NULL);
+
+		/* Block starts and interior bytes both resolve to the slab */
+		const pagemap_entry_t *e = pagemap_lookup((char *)ptrs[i] + BLOCK_SIZE - 1);
+		CHECK(e != NULL && atomic_load(&e->slab) == slab);
+		CHECK(atomic_load(&e->owner) == NULL);
+	}
+	CHECK(slab_free(slab, (char *)ptrs[0] + 1) == -1); /* Not a block start */
+	CHECK(pagemap_lookup(&cfg) == NULL);
+
+	/* Without a pool as owner, free_any hands blocks back to the slab */
+	for (int i = 0; i < 256; i++)
+		CHECK(mempool_free_any(ptrs[i]) == 0);
+	CHECK(mempool_free_any(ptrs[0]) == -1); /* Double free */
+
+	slab_destroy(slab);
+	CHECK(pagemap_lookup(ptrs[0]) == NULL);
+	return 1;
+}
+
+static int test_retire(void)
+{
+	mempool_t *pool = pool_create(BLOCK_SIZE, 8, NUM_BLOCKS);
+	void *ptrs[NUM_BLOCKS];
+	pool_stats_ex_t st;
+
+	CHECK(pool != NULL);
+	CHECK(pool_alloc_n(pool, ptrs, NUM_BLOCKS) == 0);
+
+	/* Blocks retired inside a critical section outlive it */
+	CHECK(pool_enter(pool) == 0);
+	CHECK(pool_enter(pool) == 0);
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK(pool_retire(pool, ptrs[i]) == 0);
+	CHECK(pool_alloc(pool) == NULL); /* Nothing freed yet */
+	CHECK(pool_reclaim(pool) == NUM_BLOCKS);
+	pool_exit(pool);
+	CHECK(pool_reclaim(pool) == NUM_BLOCKS); /* Still nested */
+	pool_exit(pool);
+
+	/* Once the section is over, two epochs later they are free again */
+	CHECK(pool_reclaim(pool) == 0);
+	pool_stats_ex(pool, &st);
+	CHECK(st.ebr_retired == NUM_BLOCKS && st.ebr_reclaimed == NUM_BLOCKS);
+	CHECK(st.epoch >= 2);
+	CHECK(pool_alloc_n(pool, ptrs, NUM_BLOCKS) == 0);
+	CHECK(pool_free_n(pool, ptrs, NUM_BLOCKS) == 0);
+	pool_destroy(pool);
+	return 1;
+}
+
+/*
+ * Threaded EBR test: readers and retirers run on their own threads and hand
+ * over control through ebr_step, which each side advances in turn.
+ */
+#define EBR_ORPHANS 32
+
+static mempool_t *ebr_pool;
+static _Atomic(int) ebr_step;
+
+static void ebr_wait(int step)
+{
+	while (atomic_load(&ebr_step) < step)
+		sched_yield();
+}
+
+/* Hold a critical section open from step 1 until the test reaches step 2 */
+static void *ebr_reader(void *arg)
+{
+	(void)arg;
+	pool_enter(ebr_pool);
+	atomic_store(&ebr_step, 1);
+	ebr_wait(2);
+	pool_exit(ebr_pool);
+	atomic_store(&ebr_step, 3);
+	return NULL;
+}
+
+/* Retire EBR_ORPHANS blocks and exit without reclaiming them */
+static void *ebr_retirer(void *arg)
+{
+	void **ptrs = arg;
+
+	if (pool_alloc_n(ebr_pool, ptrs, EBR_ORPHANS) != 0)
+		return NULL;
+	for (int i = 0; i < EBR_ORPHANS; i++)
+		pool_retire(ebr_pool, ptrs[i]);
+	return NULL;
+}
+
+static int test_retire_threads(void)
+{
+	void *ptrs[NUM_BLOCKS];
+	pthread_t reader, retirer;
+	pool_stats_ex_t st;
+
+	ebr_pool = pool_create(BLOCK_SIZE, 8, NUM_BLOCKS);
+	CHECK(ebr_pool != NULL);
+	CHECK(pool_alloc_n(ebr_pool, ptrs, NUM_BLOCKS) == 0);
+
+	/* Another thread's open section holds back this thread's retires */
+	atomic_store(&ebr_step, 0);
+	pthread_create(&reader, NULL, ebr_reader, NULL);
+	ebr_wait(1);
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		CHECK(pool_retire(ebr_pool, ptrs[i]) == 0);
+	CHECK(pool_reclaim(ebr_pool) == NUM_BLOCKS);
+	CHECK(pool_reclaim(ebr_pool) == NUM_BLOCKS);
+	CHECK(pool_alloc(ebr_pool) == NULL);
+	pool_stats_ex(ebr_pool, &st);
+	CHECK(st.ebr_reclaimed == 0);
+
+	/* Once the reader leaves, the blocks come back */
+	atomic_store(&ebr_step, 2);
+	ebr_wait(3);
+	pthread_join(reader, NULL);
+	CHECK(pool_reclaim(ebr_pool) == 0);
+	pool_stats_ex(ebr_pool, &st);
+	CHECK(st.ebr_reclaimed == NUM_BLOCKS);
+
+	/* Bags of an exited thread wait for the open section too, then are freed */
+	atomic_store(&ebr_step, 0);
+	pthread_create(&reader, NULL, ebr_reader, NULL);
+	ebr_wait(1);
+	pthread_create(&retirer, NULL, ebr_retirer, ptrs);
+	pthread_join(retirer, NULL);
+	pool_reclaim(ebr_pool);
+	pool_stats_ex(ebr_pool, &st);
+	CHECK(st.ebr_retired == NUM_BLOCKS + EBR_ORPHANS);
+	CHECK(st.ebr_reclaimed == NUM_BLOCKS);
+
+	atomic_store(&ebr_step, 2);
+	ebr_wait(3);
+	pthread_join(reader, NULL);
+	CHECK(pool_reclaim(ebr_pool) == 0);
+	pool_stats_ex(ebr_pool, &st);
+	CHECK(st.ebr_reclaimed == NUM_BLOCKS + EBR_ORPHANS);
+
+	/* Every block is free again */
+	CHECK(pool_alloc_n(ebr_pool, ptrs, NUM_BLOCKS) == 0);
+	CHECK(pool_free_n(ebr_pool, ptrs, NUM_BLOCKS) == 0);
+	pool_destroy(ebr_pool);
+	return 1;
+}
+
+/*
+ * Remote-free test: the allocating thread, the freeing thread and the
+ * thread that reuses the blocks are all different. The pool holds a single
+ * span, so the reuse only succeeds if every block found its way back.
+ */
+#define SPAN_BLOCKS 16
+
+static mempool_t *remote_pool;
+static _Atomic(int) remote_step;
+
+/* Thread A: allocate the whole span, stay alive until the frees are done */
+static void *remote_owner(void *arg)
+{
+	void **ptrs = arg;
+
+	for (int i = 0; i < SPAN_BLOCKS; i++)
+		ptrs[i] = pool_alloc(remote_pool);
+	atomic_store(&remote_step, 1);
+	while (atomic_load(&remote_step) < 2)
+		sched_yield();
+	return NULL;
+}
+
+/* Thread C: adopt A's parked cache and allocate the span again */
+static void *remote_adopter(void *arg)
+{
+	void **ptrs = arg;
+
+	for (int i = 0; i < SPAN_BLOCKS; i++)
+		ptrs[i] = pool_alloc(remote_pool);
+	return NULL;
+}
+
+static int test_remote_free(void)
+{
+	pool_config_t cfg = {
+		.block_size = BLOCK_SIZE,
+		.blocks_per_thread = 8,
+		.total_blocks = SPAN_BLOCKS,
+		.span_blocks = SPAN_BLOCKS,
+		.flags = POOL_F_REMOTE_FREE,
+	};
+	void *owned[SPAN_BLOCKS], *again[SPAN_BLOCKS];
+	pthread_t tid;
+	pool_stats_ex_t st;
+	int local;
+
+	remote_pool = pool_create_ex(&cfg);
+	CHECK(remote_pool != NULL);
+
+	/* A allocates, this thread (B) frees every block into A's cache */
+	atomic_store(&remote_step, 0);
+	pthread_create(&tid, NULL, remote_owner, owned);
+	while (atomic_load(&remote_step) < 1)
+		sched_yield();
+	for (int i = 0; i < SPAN_BLOCKS; i++) {
+		CHECK(owned[i] != NULL);
+		CHECK(pool_free(remote_pool, (char *)owned[i] + 1) == -1);
+		CHECK(pool_free(remote_pool, owned[i]) == 0);
+	}
+	CHECK(pool_free(remote_pool, &local) == -1);
+
+	/* A exits and parks its cache; C adopts it and drains the remote frees */
+	atomic_store(&remote_step, 2);
+	pthread_join(tid, NULL);
+	pthread_create(&tid, NULL, remote_adopter, again);
+	pthread_join(tid, NULL);
+	for (int i = 0; i < SPAN_BLOCKS; i++) {
+		CHECK(again[i] != NULL);
+		CHECK(in_set(owned, SPAN_BLOCKS, again[i]));
+		for (int j = 0; j < i; j++)
+			CHECK(again[j] != again[i]);
+	}
+
+	CHECK(pool_stats_ex(remote_pool, &st) == 0);
+	CHECK(st.remote_frees == SPAN_BLOCKS);
+
+	/* C is gone too: freeing from here is remote once more */
+	for (int i = 0; i < SPAN_BLOCKS; i++)
+		CHECK(pool_free(remote_pool, again[i]) == 0);
+	CHECK(pool_stats_ex(remote_pool, &st) == 0);
+	CHECK(st.remote_frees == 2 * SPAN_BLOCKS);
+	pool_destroy(remote_pool);
+	return 1;
+}
+
+static int test_lockfree(void)
+{
+	mempool_t *pool = pool_create(BLOCK_SIZE, 8, NUM_BLOCKS);
+	lf_ring_t *ring = lf_ring_create(6); /* Rounds up to 8 */
+	lf_queue_t *queue = lf_queue_create(8);
+	lf_stack_t *stack = lf_stack_create(8);
+	void *ptrs[8];
+
+	CHECK(pool && ring && queue && stack);
+	CHECK(pool_alloc_n(pool, ptrs, 8) == 0);
+
+	/* Each container holds exactly its capacity, in its own order */
+	for (int i = 0; i < 8; i++) {
+		CHECK(lf_ring_push(ring, ptrs[i]) == 0);
+		CHECK(lf_queue_push(queue, ptrs[i]) == 0);
+		CHECK(lf_stack_push(stack, ptrs[i]) == 0);
+	}
+	CHECK(lf_ring_push(ring, ptrs[0]) == -1);
+	CHECK(lf_queue_push(queue, ptrs[0]) == -1);
+	CHECK(lf_stack_push(stack, ptrs[0]) == -1);
+	for (int i = 0; i < 8; i++) {
+		CHECK(lf_ring_pop(ring) == ptrs[i]);
+		CHECK(lf_queue_pop(queue) == ptrs[i]);
+		CHECK(lf_stack_pop(stack) == ptrs[7 - i]);
+	}
+	CHECK(lf_ring_pop(ring) == NULL);
+	CHECK(lf_queue_pop(queue) == NULL);
+	CHECK(lf_stack_pop(stack) == NULL);
+	CHECK(lf_queue_push(queue, NULL) == -1);
+
+	/* Nodes recycle: many more operations than there are nodes */
+	for (int i = 0; i < 1000; i++) {
+		CHECK(lf_queue_push(queue, ptrs[i % 8]) == 0);
+		CHECK(lf_ring_push(ring, lf_queue_pop(queue)) == 0);
+		CHECK(lf_stack_push(stack, lf_ring_pop(ring)) == 0);
+		CHECK(lf_stack_pop(stack) == ptrs[i % 8]);
+	}
+
+	CHECK(pool_free_n(pool, ptrs, 8) == 0);
+	lf_ring_destroy(ring);
+	lf_queue_destroy(queue);
+	lf_stack_destroy(stack);
+	pool_destroy(pool);
+	CHECK(lf_ring_create(0) == NULL && lf_queue_create(0) == NULL);
+	return 1;
+}
+
+/*
+ * Threaded container test: LF_PRODUCERS threads push LF_ITEMS distinct
+ * tokens each through a small container while LF_CONSUMERS threads drain
+ * it. The container is far smaller than the traffic, so it runs full and
+ * empty constantly and every node and ring cell is reused many times.
+ */
+#define LF_PRODUCERS 4
+#define LF_CONSUMERS 4
+#define LF_ITEMS     20000
+#define LF_TOTAL     (LF_PRODUCERS * LF_ITEMS)
+#define LF_CAPACITY  8
+
+enum { LF_RING, LF_QUEUE, LF_STACK };
+
+typedef struct {
+	int kind;
+	void *container;
+	char *tokens;                  /* Token k is &tokens[k] */
+	_Atomic(int) *seen;            /* Times each token was popped */
+	_Atomic(long) popped;
+} lf_run_t;
+
+typedef struct {
+	lf_run_t *run;
+	int id;
+} lf_worker_t;
+
+static int lf_push(lf_run_t *run, void *ptr)
+{
+	switch (run->kind) {
+	case LF_RING:
+		return lf_ring_push(run->container, ptr);
+	case LF_QUEUE:
+		return lf_queue_push(run->container, ptr);
+	default:
+		return lf_stack_push(run->container, ptr);
+	}
+}
+
+static void *lf_pop(lf_run_t *run)
+{
+	switch (run->kind) {
+	case LF_RING:
+		return lf_ring_pop(run->container);
+	case LF_QUEUE:
+		return lf_queue_pop(run->container);
+	default:
+		return lf_stack_pop(run->container);
+	}
+}
+
+static void *lf_producer(void *arg)
+{
+	lf_worker_t *w = arg;
+
+	for (int i = 0; i < LF_ITEMS; i++) {
+		void *token = &w->run->tokens[w->id * LF_ITEMS + i];
+
+		while (lf_push(w->run, token) != 0)
+			sched_yield(); /* Full: let a consumer in */
+	}
+	return NULL;
+}
+
+static void *lf_consumer(void *arg)
+{
+	lf_worker_t *w = arg;
+	lf_run_t *run = w->run;
+
+	while (atomic_load(&run->popped) < LF_TOTAL) {
+		char *token = lf_pop(run);
+
+		if (!token) {
+			sched_yield();
+			continue;
+		}
+		atomic_fetch_add(&run->seen[token - run->tokens], 1);
+		atomic_fetch_add(&run->popped, 1);
+	}
+	return NULL;
+}
+
+static int run_lockfree_threads(int kind)
+{
+	pthread_t tids[LF_PRODUCERS + LF_CONSUMERS];
+	lf_worker_t workers[LF_PRODUCERS + LF_CONSUMERS];
+	lf_run_t run = { .kind = kind };
+
+	if (kind == LF_RING)
+		run.container = lf_ring_create(LF_CAPACITY);
+	else if (kind == LF_QUEUE)
+		run.container = lf_queue_create(LF_CAPACITY);
+	else
+		run.container = lf_stack_create(LF_CAPACITY);
+	run.tokens = malloc(LF_TOTAL);
+	run.seen = calloc(LF_TOTAL, sizeof(*run.seen));
+	CHECK(run.container && run.tokens && run.seen);
+	atomic_store(&run.popped, 0);
+
+	for (int i = 0; i < LF_PRODUCERS + LF_CONSUMERS; i++) {
+		workers[i].run = &run;
+		workers[i].id = i < LF_PRODUCERS ? i : i - LF_PRODUCERS;
+		pthread_create(&tids[i], NULL, i < LF_PRODUCERS ? lf_producer : lf_consumer,
+			       &workers[i]);
+	}
+	for (int i = 0; i < LF_PRODUCERS + LF_CONSUMERS; i++)
+		pthread_join(tids[i], NULL);
+
+	/* Every token came out exactly once, and nothing is left behind */
+	CHECK(atomic_load(&run.popped) == LF_TOTAL);
+	for (int k = 0; k < LF_TOTAL; k++)
+		CHECK(atomic_load(&run.seen[k]) == 1);
+	CHECK(lf_pop(&run) == NULL);
+
+	if (kind == LF_RING)
+		lf_ring_destroy(run.container);
+	else if (kind == LF_QUEUE)
+		lf_queue_destroy(run.container);
+	else
+		lf_stack_destroy(run.container);
+	free(run.tokens);
+	free(run.seen);
+	return 1;
+}
+
+static int test_lockfree_threads(void)
+{
+	return run_lockfree_threads(LF_RING) && run_lockfree_threads(LF_QUEUE) &&
+	       run_lockfree_threads(LF_STACK);
+}
+
+/* Shared by the threaded test workers */
+static slab_allocator_t *shared_slab;
+
+static void *churn(void *arg)
+{
+	long *failures = arg;
+	void *held[8];
+
+	for (int r = 0; r < 20000; r++) {
+		for (int i = 0; i < 8; i++)
+			held[i] = slab_alloc(shared_slab);
+		for (int i = 0; i < 8; i++) {
+			if (!held[i] || slab_free(shared_slab, held[i]) != 0)
+				(*failures)++;
+		}
+	}
+	return NULL;
+}
+
+/* Allocate 8 blocks into arg and exit holding them */
+static void *hold(void *arg)
+{
+	void **held = arg;
+
+	for (int i = 0; i < 8; i++)
+		held[i] = slab_alloc(shared_slab);
+	return NULL;
+}
+
+static int test_threads(void)
+{
+	enum { THREADS = 8 };
+	pthread_t tids[THREADS];
+	long failures[THREADS] = { 0 };
+	size_t used, free_blocks;
+
+	/* Exactly enough blocks: any lost or duplicated block shows up */
+	shared_slab = slab_create(BLOCK_SIZE, THREADS * 8);
+	for (int i = 0; i < THREADS; i++)
+		pthread_create(&tids[i], NULL, churn, &failures[i]);
+	for (int i = 0; i < THREADS; i++) {
+		pthread_join(tids[i], NULL);
+		CHECK(failures[i] == 0);
+	}
+
+	slab_stats(shared_slab, &used, &free_blocks);
+	CHECK(used == 0 && free_blocks == THREADS * 8);
+
+	/* Exited threads' counts stay in the sum; later threads adopt their records */
+	void *held[THREADS][8];
+	for (int round = 0; round < 2; round++) {
+		for (int i = 0; i < THREADS / 2; i++)
+			pthread_create(&tids[i], NULL, hold, held[round * THREADS / 2 + i]);
+		for (int i = 0; i < THREADS / 2; i++)
+			pthread_join(tids[i], NULL);
+	}
+	slab_stats(shared_slab, &used, &free_blocks);
+	CHECK(used == THREADS * 8 && free_blocks == 0);
+	for (int i = 0; i < THREADS; i++) {
+		for (int j = 0; j < 8; j++)
+			CHECK(held[i][j] && slab_free(shared_slab, held[i][j]) == 0);
+	}
+	slab_stats(shared_slab, &used, &free_blocks);
+	CHECK(used == 0);
+
+	slab_destroy(shared_slab);
+	return 1;
+}
+
+int main(void)
+{
+	printf("=== Slab Allocator Tests ===\n\n");
+
+	run_test("Create and destroy", test_create_destroy);
+	run_test("Allocate single block", test_alloc_single);
+	run_test("Allocate all blocks", test_alloc_all);
+	run_test("Free and reallocate", test_free_realloc);
+	run_test("Double-free detection", test_double_free);
+	run_test("Alignment verification", test_alignment);
+	run_test("Statistics", test_stats);
+	run_test("Invalid free detection", test_invalid_free);
+	run_test("Batch allocation", test_batch);
+	run_test("Adaptive thread caches", test_adaptive);
+	run_test("NUMA node slabs", test_numa);
+	run_test("Growable slab", test_grow);
+	run_test("mmap backing", test_backing);
+	run_test("Trim and decay", test_trim);
+	run_test("Cache coloring and spreading", test_color_spread);
+	run_test("Object constructor caching", test_ctor_cache);
+	run_test("Handles and generations", test_handles);
+	run_test("Page map registration", test_pagemap);
+	run_test("Deferred reclamation", test_retire);
+	run_test("Deferred reclamation, threaded", test_retire_threads);
+	run_test("Remote frees and span adoption", test_remote_free);
+	run_test("Lock-free containers", test_lockfree);
+	run_test("Lock-free containers, threaded", test_lockfree_threads);
+	run_test("Multi-threaded alloc/free", test_threads);
+
+	printf("\n=== Results ===\n");
+	printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+	return tests_passed == tests_run ? 0 : 1;
+}